@@ -13,6 +13,11 @@
 #include <ratio>
 #include <fstream>
 #include <string>
+#include <cstring>
+#if defined(_M_X64)||(defined(_M_IX86_FP)&&_M_IX86_FP>=1)||defined(__SSE__)
+#define NEURAL_NET_SSE
+#include <xmmintrin.h>
+#endif
 namespace neural_net {
 
 	using DataType=float;
@@ -88,6 +93,84 @@ namespace neural_net {
 		}
 	}
 
+	//dst[n*rows+r] += in[n*cols+c]*mat_t[c*rows+r] for the N rows of in from n, the neurons [r0,r1) and the connections [c0,c1)
+	//each sum runs in connection order like matrix_t_col, so the vector and scalar parts give the same bits
+	template<size_t N>
+	inline void batch_tile(DataType* const dst,DataType const* const in,DataType const* const mat_t,size_t const rows,size_t const cols,size_t const r0,size_t const r1,size_t const c0,size_t const c1)
+	{
+		size_t r=r0;
+#ifdef NEURAL_NET_SSE
+		for(;r+8<=r1;r+=8)
+		{
+			__m128 acc[N][2];
+			for(size_t n=0;n<N;++n)
+			{
+				acc[n][0]=_mm_loadu_ps(dst+n*rows+r);
+				acc[n][1]=_mm_loadu_ps(dst+n*rows+r+4);
+			}
+			for(size_t c=c0;c<c1;++c)
+			{
+				auto const mat_row=mat_t+c*rows+r;
+				__m128 const w0=_mm_loadu_ps(mat_row);
+				__m128 const w1=_mm_loadu_ps(mat_row+4);
+				for(size_t n=0;n<N;++n)
+				{
+					__m128 const x=_mm_set1_ps(in[n*cols+c]);
+					acc[n][0]=_mm_add_ps(acc[n][0],_mm_mul_ps(x,w0));
+					acc[n][1]=_mm_add_ps(acc[n][1],_mm_mul_ps(x,w1));
+				}
+			}
+			for(size_t n=0;n<N;++n)
+			{
+				_mm_storeu_ps(dst+n*rows+r,acc[n][0]);
+				_mm_storeu_ps(dst+n*rows+r+4,acc[n][1]);
+			}
+		}
+#endif
+		for(;r<r1;++r)
+		{
+			for(size_t n=0;n<N;++n)
+			{
+				DataType sum=dst[n*rows+r];
+				for(size_t c=c0;c<c1;++c)
+				{
+					sum+=in[n*cols+c]*mat_t[c*rows+r];
+				}
+				dst[n*rows+r]=sum;
+			}
+		}
+	}
+
+	//dst = biases + in * mat_t for each of the count rows of in, mat_t being a rows x cols matrix transposed
+	//row n of dst is what matrix_t_col gives for row n of in, but the matrix is read once per 4 rows of in instead of once per row
+	inline void batch_t_mat(DataType* const dst,DataType const* const in,DataType const* const mat_t,DataType const* const biases,size_t const count,size_t const rows,size_t const cols)
+	{
+		//a panel of mat_t this large stays in cache while every row of in passes over it
+		constexpr size_t row_block=64;
+		constexpr size_t col_block=256;
+		for(size_t n=0;n<count;++n)
+		{
+			std::memcpy(dst+n*rows,biases,rows*sizeof(DataType));
+		}
+		for(size_t c0=0;c0<cols;c0+=col_block)
+		{
+			size_t const c1=std::min(cols,c0+col_block);
+			for(size_t r0=0;r0<rows;r0+=row_block)
+			{
+				size_t const r1=std::min(rows,r0+row_block);
+				size_t n=0;
+				for(;n+4<=count;n+=4)
+				{
+					batch_tile<4>(dst+n*rows,in+n*cols,mat_t,rows,cols,r0,r1,c0,c1);
+				}
+				for(;n<count;++n)
+				{
+					batch_tile<1>(dst+n*rows,in+n*cols,mat_t,rows,cols,r0,r1,c0,c1);
+				}
+			}
+		}
+	}
+
 	inline DataType sigmoid(DataType x)
 	{
 		return 1.0/(1.0+exp(-x));
@@ -293,6 +376,48 @@ namespace neural_net {
 		}
 	};
 
+	//weights of each layer transposed to connections x neurons, for feed_forward_batch
+	struct batch_weights:public std::unique_ptr<std::unique_ptr<DataType[]>[]> {
+		using layer_weights=std::unique_ptr<DataType[]>;
+		using base=std::unique_ptr<layer_weights[]>;
+		inline batch_weights(std::vector<layer> const& layers):
+			base(new layer_weights[layers.size()])
+		{
+			for(size_t i=1;i<layers.size();++i)
+			{
+				auto const rows=layers[i].neuron_count();
+				auto const cols=layers[i-1].neuron_count();
+				auto const weights=layers[i].weights();
+				auto& dst=(*this)[i];
+				dst=layer_weights(new DataType[rows*cols]);
+				for(size_t r=0;r<rows;++r)
+				{
+					for(size_t c=0;c<cols;++c)
+					{
+						dst[c*rows+r]=weights[r*cols+c];
+					}
+				}
+			}
+		}
+	};
+
+	//space for the hidden layers of a batch of up to capacity inputs
+	struct batch_results:public std::array<std::unique_ptr<DataType[]>,2> {
+		size_t capacity;
+		inline batch_results(std::vector<layer> const& layers,size_t capacity):capacity(capacity)
+		{
+			size_t widest=0;
+			for(size_t i=1;i+1<layers.size();++i)
+			{
+				widest=std::max(widest,layers[i].neuron_count());
+			}
+			for(auto& buffer:*this)
+			{
+				buffer.reset(new DataType[widest*capacity]);
+			}
+		}
+	};
+
 	template<typename ActivationFunc=clipped_leaky_relu_t<>,typename Deriv=typename ActivationFunc::derivative>
 	struct net:private ActivationFunc,private Deriv {
 	private:
@@ -437,6 +562,25 @@ namespace neural_net {
 			return ret;
 		}
 
+		//feeds count inputs laid one after another through the net and writes their outputs one after another to out
+		//each output is the same as the last layer of feed_forward_store for that input
+		void feed_forward_batch(DataType* out,DataType const* input,size_t count,batch_weights const& weights,batch_results& scratch) const
+		{
+			assert(count<=scratch.capacity);
+			DataType const* src=input;
+			for(size_t i=1;i<_layers.size();++i)
+			{
+				auto const nc=_layers[i].neuron_count();
+				DataType* const dst=i+1==_layers.size()?out:scratch[i%2].get();
+				batch_t_mat(dst,src,weights[i].get(),_layers[i].biases(),count,nc,_layers[i-1].neuron_count());
+				std::transform(dst,dst+count*nc,dst,[this](DataType f)
+				{
+					return ActivationFunc::operator()(f);
+				});
+				src=dst;
+			}
+		}
+
 		void update_weights(DataType* weights,DataType* biases,DataType const* activations,DataType const* deltas,size_t far_nodes,size_t near_nodes,DataType learning_rate)
 		{
 			for(size_t j=0;j<far_nodes;++j)
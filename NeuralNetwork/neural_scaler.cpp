@@ -1,6 +1,6 @@
 #include "neural_scaler.h"
 #include <assert.h>
-#include "../ScoreProcessor/lib/threadpool/thread_pool.h"
+#include "../ScoreProcessor/WorkerPool.h"
 namespace ScoreProcessor {
 	cil::CImg<unsigned char> neural_scaler::get_smart_scale(cil::CImg<unsigned char> const& img,float scale,unsigned int num_threads) const
 	{
@@ -22,8 +22,13 @@ namespace ScoreProcessor {
 			unsigned int input_dim;
 			unsigned int output_dim;
 			unsigned int scale_factor;
+			neural_net::batch_weights const* weights;
 		};
+		//windows that are not all white are fed through the net this many at a time
+		constexpr size_t batch_size=64;
+		neural_net::batch_weights const weights(_net.layers());
 		info inf;
+		inf.weights=&weights;
 		inf.input_dim=input_dim();
 		inf.output_dim=output_dim();
 		inf.scale_factor=scale_factor();
@@ -113,7 +118,20 @@ namespace ScoreProcessor {
 					size_t const input_area=size_t{inf.input_dim}*inf.input_dim;
 					size_t const output_area=size_t{inf.output_dim}*inf.output_dim;
 					std::unique_ptr<float[]> input(new float[input_area]);
-					std::unique_ptr<float[]> output(new float[output_area]);
+					std::unique_ptr<float[]> batch_input(new float[batch_size*input_area]);
+					std::unique_ptr<float[]> batch_output(new float[batch_size*output_area]);
+					neural_net::batch_results scratch(ns.net().layers(),batch_size);
+					st batch_y[batch_size];
+					size_t batched=0;
+					auto const flush=[&]()
+					{
+						ns.feed_batch(batch_output.get(),batch_input.get(),batched,*inf.weights,scratch);
+						for(size_t b=0;b<batched;++b)
+						{
+							write_to_img(out,batch_output.get()+b*output_area,batch_y[b],output_dim);
+						}
+						batched=0;
+					};
 					st const out_height=out._height;
 					st const in_height=in._height;
 					st const in_width=in._width;
@@ -180,14 +198,22 @@ namespace ScoreProcessor {
 						}
 						if(!all_white(input.get(),input_area))
 						{
-							ns.feed(output.get(),input.get());
-							write_to_img(out,output.get(),y,output_dim);
+							std::memcpy(batch_input.get()+batched*input_area,input.get(),input_area*sizeof(float));
+							batch_y[batched]=y;
+							if(++batched==batch_size)
+							{
+								flush();
+							}
 						}
 						else
 						{
 							write_to_img(out,y,output_dim);
 						}
 					}
+					if(batched)
+					{
+						flush();
+					}
 				}
 			public:
 				void execute(Img* out,Img const* in,neural_scaler const* ns,info const* inf) const
@@ -195,14 +221,11 @@ namespace ScoreProcessor {
 					scale(*out,*in,*ns,*inf);
 				}
 			};
-			exlib::thread_pool_a<Img*,Img const*,neural_scaler const*,info const*> pool(num_threads,&upscaled,&orig,this,&inf);
-			for(unsigned int x=0;x<upscaled._width;x+=inf.output_dim)
+			//columns go to the global pool so scaling inside a batch shares its threads instead of adding more
+			parallel_for((upscaled._width+inf.output_dim-1)/inf.output_dim,[&upscaled,&orig,&inf,this](size_t column)
 			{
-				pool.push_back([task=Scaler{x}](Img*out,Img const* in,neural_scaler const* ns,info const* inf) noexcept{
-					task.execute(out,in,ns,inf);
-				});;
-			}
-			pool.join();
+				Scaler{static_cast<unsigned int>(column*inf.output_dim)}.execute(&upscaled,&orig,this,&inf);
+			},num_threads);
 			if(upscaled._width>=desired_width)
 			{
 				return upscaled.resize(desired_width,desired_height);
@@ -180,6 +180,11 @@ namespace ScoreProcessor {
 			auto res=_net.feed_forward_store(in);
 			std::memcpy(out,res[_net.layers().size()-1].get(),_net.layers().back().neuron_count()*sizeof(float));
 		}
+		//feeds count windows laid one after another, writing their outputs one after another
+		inline void feed_batch(float* out,float const* in,size_t count,neural_net::batch_weights const& weights,neural_net::batch_results& scratch) const
+		{
+			_net.feed_forward_batch(out,in,count,weights,scratch);
+		}
 		neural_scaler(char const* path)
 		{
 			load(path);
@@ -1,7 +1,14 @@
 #include "stdafx.h"
 #include "CppUnitTest.h"
 #include "../ScoreProcessor/ScoreProcesses.h"
+#include "../ScoreProcessor/PixelKernels.h"
+#include "../ScoreProcessor/TemplateMatch.h"
+#include "../NeuralNetwork/neural_net.h"
+#include <algorithm>
+#include <random>
 #include <thread>
+#include <chrono>
+#include <string>
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 using namespace ScoreProcessor;
 using namespace cil;
@@ -68,6 +75,672 @@ namespace SProcUnitTests {
 			}
 			AssertEquals(exp,res);
 		}
+		TEST_METHOD(KernelsMatchScalar)
+		{
+			std::mt19937 rng(17);
+			CImg<unsigned char> src(131,37,1,3);
+			for(auto& p:src)
+			{
+				p=rng()%256;
+			}
+			auto run=[&](kernels::instruction_set is)
+			{
+				kernels::set_instruction_set(is);
+				std::vector<CImg<unsigned char>> out(5,src);
+				binarize(out[0],ImageUtils::ColorRGB({120,120,120}),ImageUtils::ColorRGB({0,10,20}),ImageUtils::ColorRGB({250,240,230}));
+				out[1].channel(0);
+				binarize(out[1],ImageUtils::Grayscale(128),ImageUtils::Grayscale(3),ImageUtils::Grayscale(200));
+				out[2].channel(0);
+				rescale_colors(out[2],40,128,210);
+				Assert::IsTrue(replace_range(out[3],30,90,255));
+				Assert::IsTrue(replace_by_brightness(out[4],60,180,ImageUtils::ColorRGB({255,255,255})));
+				return out;
+			};
+			auto const expected=run(kernels::instruction_set::scalar);
+			for(auto is:{kernels::instruction_set::sse41,kernels::instruction_set::avx2})
+			{
+				auto const actual=run(is);
+				for(size_t i=0;i<expected.size();++i)
+				{
+					AssertEquals(expected[i],actual[i]);
+				}
+			}
+			kernels::set_instruction_set(kernels::best_instruction_set());
+		}
+		TEST_METHOD(AddMin3MatchesColumnWalk)
+		{
+			std::mt19937 rng(19);
+			for(size_t n=1;n<80;++n)
+			{
+				std::vector<float> prev(n),column(n);
+				for(size_t i=0;i<n;++i)
+				{
+					prev[i]=rng()%5==0?INFINITY:float(rng()%1000)/7;
+					column[i]=float(rng()%1000)/11;
+				}
+				std::vector<float> expected(column);
+				for(size_t i=0;i<n;++i)
+				{
+					float least=prev[i];
+					if(i>0)
+					{
+						least=std::min(least,prev[i-1]);
+					}
+					if(i+1<n)
+					{
+						least=std::min(least,prev[i+1]);
+					}
+					expected[i]+=least;
+				}
+				for(auto is:{kernels::instruction_set::scalar,kernels::instruction_set::sse41,kernels::instruction_set::avx2})
+				{
+					kernels::set_instruction_set(is);
+					std::vector<float> actual(column);
+					kernels::add_min3(actual.data(),prev.data(),n);
+					Assert::IsTrue(expected==actual);
+				}
+			}
+			kernels::set_instruction_set(kernels::best_instruction_set());
+		}
+		TEST_METHOD(ClusterRunsMatchClusterRanges)
+		{
+			using R=ImageUtils::Rectangle<unsigned int>;
+			//clusters compared as sorted lists of their rectangles, as the two give them in different orders
+			auto key=[](std::vector<Cluster> const& clusters)
+			{
+				std::vector<std::vector<unsigned int>> key;
+				for(auto const& cluster:clusters)
+				{
+					auto ranges=cluster.get_ranges();
+					std::sort(ranges.begin(),ranges.end(),[](R a,R b)
+					{
+						return a.top<b.top||(a.top==b.top&&a.left<b.left);
+					});
+					std::vector<unsigned int> flat;
+					for(auto const& r:ranges)
+					{
+						flat.insert(flat.end(),{r.left,r.right,r.top,r.bottom});
+					}
+					key.push_back(std::move(flat));
+				}
+				std::sort(key.begin(),key.end());
+				return key;
+			};
+			auto keep=[](std::array<unsigned char,1> v)
+			{
+				return v[0]<128;
+			};
+			std::mt19937 rng(11);
+			for(unsigned int t=0;t<200;++t)
+			{
+				CImg<unsigned char> img(1+rng()%60,1+rng()%60);
+				unsigned int const density=rng()%100;
+				for(auto& p:img)
+				{
+					p=rng()%100<density?0:255;
+				}
+				auto const rects=global_select<1>(img,keep);
+				auto const runs=global_select<1>(img,keep,false);
+				Assert::IsTrue(key(Cluster::cluster_ranges(rects))==key(Cluster::cluster_runs(runs)));
+				Assert::IsTrue(key(Cluster::cluster_ranges_8way(rects))==key(Cluster::cluster_runs(runs,true)));
+			}
+		}
+		TEST_METHOD(ClusterRunsSpeckledPage)
+		{
+			//letter page at 600 dpi with 8% speckle
+			CImg<unsigned char> img(5100,6600);
+			std::mt19937 rng(3);
+			for(auto& p:img)
+			{
+				p=rng()%100<8?0:255;
+			}
+			auto keep=[](std::array<unsigned char,1> v)
+			{
+				return v[0]<128;
+			};
+			using clock=std::chrono::steady_clock;
+			auto const t0=clock::now();
+			auto const old_clusters=Cluster::cluster_ranges(global_select<1>(img,keep));
+			auto const t1=clock::now();
+			auto const new_clusters=select_clusters<1>(img,keep);
+			auto const t2=clock::now();
+			Assert::AreEqual(old_clusters.size(),new_clusters.size());
+			std::string msg("global_select+cluster_ranges: ");
+			msg+=std::to_string(std::chrono::duration<double>(t1-t0).count());
+			msg+="s, select_clusters: ";
+			msg+=std::to_string(std::chrono::duration<double>(t2-t1).count());
+			msg+="s, clusters: ";
+			msg+=std::to_string(new_clusters.size());
+			msg+='\n';
+			Logger::WriteMessage(msg.c_str());
+		}
+		TEST_METHOD(ClusterStripsMatchClusterRuns)
+		{
+			auto same=[](std::vector<Cluster> const& a,std::vector<Cluster> const& b)
+			{
+				if(a.size()!=b.size())
+				{
+					return false;
+				}
+				for(size_t i=0;i<a.size();++i)
+				{
+					if(a[i].get_ranges()!=b[i].get_ranges())
+					{
+						return false;
+					}
+				}
+				return true;
+			};
+			auto keep=[](std::array<unsigned char,1> v)
+			{
+				return v[0]<128;
+			};
+			std::mt19937 rng(12);
+			for(unsigned int t=0;t<200;++t)
+			{
+				CImg<unsigned char> img(1+rng()%80,1+rng()%200);
+				unsigned int const density=rng()%100;
+				for(auto& p:img)
+				{
+					p=rng()%100<density?0:255;
+				}
+				unsigned int const strip_count=1+rng()%12;
+				std::vector<std::vector<ImageUtils::Rectangle<unsigned int>>> strips(strip_count);
+				for(unsigned int s=0;s<strip_count;++s)
+				{
+					strips[s]=select_rows<1>(img,keep,img._height*s/strip_count,img._height*(s+1)/strip_count);
+				}
+				auto const runs=global_select<1>(img,keep,false);
+				Assert::IsTrue(same(Cluster::cluster_runs(runs),Cluster::cluster_strips(strips)));
+				Assert::IsTrue(same(Cluster::cluster_runs(runs,true),Cluster::cluster_strips(strips,true)));
+			}
+		}
+		TEST_METHOD(ClusterStripsSpeckledPage)
+		{
+			CImg<unsigned char> img(5100,6600);
+			std::mt19937 rng(4);
+			for(auto& p:img)
+			{
+				p=rng()%100<8?0:255;
+			}
+			auto keep=[](std::array<unsigned char,1> v)
+			{
+				return v[0]<128;
+			};
+			auto small=[](Cluster const& c)
+			{
+				return c.size()<4;
+			};
+			using clock=std::chrono::steady_clock;
+			CImg<unsigned char> serial(img);
+			auto const t0=clock::now();
+			for(auto const& cluster:Cluster::cluster_runs(global_select<1>(serial,keep,false),true))
+			{
+				if(small(cluster))
+				{
+					for(auto const& rect:cluster.get_ranges())
+					{
+						fill_selection(serial,rect,std::array<unsigned char,1>{255});
+					}
+				}
+			}
+			auto const t1=clock::now();
+			clear_clusters_8way(img,std::array<unsigned char,1>{255},keep,small);
+			auto const t2=clock::now();
+			Assert::IsTrue(img==serial);
+			std::string msg("serial despeckle: ");
+			msg+=std::to_string(std::chrono::duration<double>(t1-t0).count());
+			msg+="s, strips: ";
+			msg+=std::to_string(std::chrono::duration<double>(t2-t1).count());
+			msg+="s on ";
+			msg+=std::to_string(global_pool().num_threads());
+			msg+=" threads\n";
+			Logger::WriteMessage(msg.c_str());
+		}
+		TEST_METHOD(LabelClustersStatsMatchClusters)
+		{
+			auto keep=[](std::array<unsigned char,1> v)
+			{
+				return v[0]<128;
+			};
+			std::mt19937 rng(13);
+			for(unsigned int t=0;t<200;++t)
+			{
+				CImg<unsigned char> img(1+rng()%80,1+rng()%300);
+				unsigned int const density=rng()%100;
+				for(auto& p:img)
+				{
+					p=rng()%100<density?rng()%128:255;
+				}
+				bool const eight_way=rng()%2;
+				unsigned int const required_min=rng()%100;
+				unsigned int const required_max=required_min+rng()%60;
+				auto const labeled=label_clusters<1>(img,keep,required_min,required_max,eight_way);
+				auto const clusters=select_clusters<1>(img,keep,eight_way);
+				Assert::AreEqual(clusters.size(),labeled.clusters.size());
+				for(size_t i=0;i<clusters.size();++i)
+				{
+					auto const& stats=labeled.clusters[i];
+					auto const& cluster=clusters[i];
+					Assert::AreEqual(cluster.size(),stats.area);
+					Assert::IsTrue(cluster.bounding_box()==stats.bounding_box);
+					Assert::IsTrue(cluster.get_ranges()==labeled.cluster(i).get_ranges());
+					unsigned int required=0,min_intensity=~0U,max_intensity=0;
+					for(auto const& rect:cluster.get_ranges())
+					{
+						for(unsigned int y=rect.top;y<rect.bottom;++y)
+						{
+							for(unsigned int x=rect.left;x<rect.right;++x)
+							{
+								unsigned int const intensity=img(x,y);
+								required+=intensity>=required_min&&intensity<=required_max;
+								min_intensity=std::min(min_intensity,intensity);
+								max_intensity=std::max(max_intensity,intensity);
+							}
+						}
+					}
+					Assert::AreEqual(required,stats.required);
+					Assert::AreEqual(min_intensity,stats.min_intensity);
+					Assert::AreEqual(max_intensity,stats.max_intensity);
+				}
+				CImg<unsigned char> by_clusters(img);
+				clear_clusters(by_clusters,std::array<unsigned char,1>{255},keep,[](Cluster const& c)
+				{
+					return c.size()%3==0;
+				});
+				clear_labeled(img,labeled,std::array<unsigned char,1>{255},[](cluster_stats const& c)
+				{
+					return c.area%3==0;
+				});
+				Assert::IsTrue(img==by_clusters);
+			}
+		}
+		TEST_METHOD(ProfilesMatchColumnScan)
+		{
+			//walks each column the way the profiles used to be built
+			auto column_scan=[](CImg<unsigned char> const& img,unsigned int bg,bool top)
+			{
+				unsigned int const limit=img._height/2;
+				std::vector<unsigned int> profile(img._width,limit);
+				for(unsigned int x=0;x<img._width;++x)
+				{
+					for(unsigned int i=0;i<img._height;++i)
+					{
+						unsigned int const y=top?i:img._height-1-i;
+						if(top?y>=limit:(img._spectrum==1?y<=limit:y<limit))
+						{
+							break;
+						}
+						bool const dark=img._spectrum==1?
+							(top?img(x,y)<=bg:img(x,y)<bg):
+							unsigned int(img(x,y,0))+img(x,y,1)+img(x,y,2)<=3*bg;
+						if(dark)
+						{
+							profile[x]=y;
+							break;
+						}
+					}
+				}
+				return profile;
+			};
+			std::mt19937 rng(23);
+			for(auto is:{kernels::instruction_set::scalar,kernels::instruction_set::sse41,kernels::instruction_set::avx2})
+			{
+				kernels::set_instruction_set(is);
+				for(unsigned int t=0;t<300;++t)
+				{
+					CImg<unsigned char> img(1+rng()%90,1+rng()%40,1,t%2?3:1);
+					unsigned int const density=rng()%1000;
+					for(auto& p:img)
+					{
+						p=rng()%1000<density?rng()%256:250+rng()%6;
+					}
+					unsigned char const bg=rng()%256;
+					if(img._spectrum==1)
+					{
+						Assert::IsTrue(column_scan(img,bg,true)==build_top_profile(img,ImageUtils::Grayscale(bg)));
+						Assert::IsTrue(column_scan(img,bg,false)==build_bottom_profile(img,ImageUtils::Grayscale(bg)));
+					}
+					else
+					{
+						Assert::IsTrue(column_scan(img,bg,true)==build_top_profile(img,ImageUtils::ColorRGB({bg,bg,bg})));
+						Assert::IsTrue(column_scan(img,bg,false)==build_bottom_profile(img,ImageUtils::ColorRGB({bg,bg,bg})));
+					}
+				}
+			}
+			kernels::set_instruction_set(kernels::best_instruction_set());
+		}
+		TEST_METHOD(CutPiecesFollowSeams)
+		{
+			std::mt19937 rng(29);
+			for(unsigned int t=0;t<100;++t)
+			{
+				CImg<unsigned char> img(1+rng()%60,30+rng()%60,1,t%2?3:1);
+				for(auto& p:img)
+				{
+					p=rng()%255;
+				}
+				Assert::IsTrue(cut_piece(img,{},0)==img);
+				std::vector<std::vector<unsigned int>> cuts(1+rng()%3,std::vector<unsigned int>(img._width));
+				unsigned int const band=img._height/(cuts.size()+1);
+				for(size_t c=0;c<cuts.size();++c)
+				{
+					for(auto& y:cuts[c])
+					{
+						y=band*(c+1)-band/3+rng()%(band*2/3+1);
+					}
+				}
+				for(size_t i=0;i<=cuts.size();++i)
+				{
+					auto const piece=cut_piece(img,cuts,i);
+					unsigned int const offset=i?*std::min_element(cuts[i-1].begin(),cuts[i-1].end()):0;
+					unsigned int const bottom=i<cuts.size()?*std::max_element(cuts[i].begin(),cuts[i].end()):img._height;
+					Assert::AreEqual(bottom-offset,piece._height);
+					for(unsigned int x=0;x<img._width;++x)
+					{
+						unsigned int const begin=i?cuts[i-1][x]:0;
+						unsigned int const end=i<cuts.size()?cuts[i][x]:img._height;
+						for(unsigned int y=0;y<piece._height;++y)
+						{
+							unsigned int const ya=y+offset;
+							for(unsigned int c=0;c<img._spectrum;++c)
+							{
+								Assert::AreEqual<unsigned char>(ya>=begin&&ya<end?img(x,ya,c):255,piece(x,y,c));
+							}
+						}
+					}
+				}
+			}
+		}
+		TEST_METHOD(SlidingTemplateSsdMatchesBruteForce)
+		{
+			auto brute_force=[](CImg<unsigned char> const& img,CImg<unsigned char> const& tmplt)
+			{
+				CImg<float> scores(img._width-tmplt._width+1,img._height-tmplt._height+1);
+				for(unsigned int y=0;y<scores._height;++y)
+				{
+					for(unsigned int x=0;x<scores._width;++x)
+					{
+						unsigned long long ssd=0;
+						for(unsigned int ty=0;ty<tmplt._height;++ty)
+						{
+							for(unsigned int tx=0;tx<tmplt._width;++tx)
+							{
+								int const dif=int(img(x+tx,y+ty))-tmplt(tx,ty);
+								ssd+=dif*dif;
+							}
+						}
+						scores(x,y)=static_cast<float>(ssd/(255.0*255.0));
+					}
+				}
+				return scores;
+			};
+			std::mt19937 rng(31);
+			for(auto is:{kernels::instruction_set::scalar,kernels::instruction_set::sse41,kernels::instruction_set::avx2})
+			{
+				kernels::set_instruction_set(is);
+				for(unsigned int t=0;t<100;++t)
+				{
+					CImg<unsigned char> img(1+rng()%200,1+rng()%150);
+					unsigned int const density=rng()%100;
+					for(auto& p:img)
+					{
+						p=rng()%100<density?rng()%256:255;
+					}
+					CImg<unsigned char> tmplt(1+rng()%std::min(40U,img._width),1+rng()%std::min(40U,img._height));
+					for(auto& p:tmplt)
+					{
+						p=rng()%100<density?rng()%256:255;
+					}
+					auto const expected=brute_force(img,tmplt);
+					Assert::IsTrue(expected==sliding_template_ssd(img,tmplt,correlation_method::direct));
+					Assert::IsTrue(expected==sliding_template_ssd(img,tmplt,correlation_method::fft));
+				}
+			}
+			kernels::set_instruction_set(kernels::best_instruction_set());
+		}
+		TEST_METHOD(SlidingTemplateSsdRegionMatchesFull)
+		{
+			std::mt19937 rng(37);
+			for(unsigned int t=0;t<100;++t)
+			{
+				CImg<unsigned char> img(1+rng()%200,1+rng()%150);
+				for(auto& p:img)
+				{
+					p=rng()%256;
+				}
+				CImg<unsigned char> tmplt(1+rng()%std::min(40U,img._width),1+rng()%std::min(40U,img._height));
+				for(auto& p:tmplt)
+				{
+					p=rng()%256;
+				}
+				auto const full=sliding_template_ssd(img,tmplt);
+				ImageUtils::RectangleUINT region;
+				region.left=rng()%full._width;
+				region.top=rng()%full._height;
+				region.right=region.left+1+rng()%60;
+				region.bottom=region.top+1+rng()%60;
+				for(auto method:{correlation_method::direct,correlation_method::fft})
+				{
+					auto const part=sliding_template_ssd(img,tmplt,region,method);
+					Assert::AreEqual(std::min(region.right,full._width)-region.left,part._width);
+					Assert::AreEqual(std::min(region.bottom,full._height)-region.top,part._height);
+					for(unsigned int y=0;y<part._height;++y)
+					{
+						for(unsigned int x=0;x<part._width;++x)
+						{
+							Assert::AreEqual(full(region.left+x,region.top+y),part(x,y));
+						}
+					}
+				}
+			}
+		}
+		TEST_METHOD(TemplateSsdMinimaMatchesSeparateScans)
+		{
+			std::mt19937 rng(41);
+			for(unsigned int t=0;t<50;++t)
+			{
+				CImg<unsigned char> img(2+rng()%300,2+rng()%300);
+				for(auto& p:img)
+				{
+					p=rng()%4?255:rng()%256;
+				}
+				std::vector<CImg<unsigned char>> tmplts;
+				std::vector<float> thresholds;
+				for(unsigned int i=0,n=1+rng()%6;i<n;++i)
+				{
+					//some templates share a size, and some are large enough for the fft
+					unsigned int const w=i&&rng()%3==0?tmplts[0]._width:1+rng()%40;
+					unsigned int const h=i&&rng()%3==0?tmplts[0]._height:1+rng()%40;
+					tmplts.emplace_back(w,h);
+					for(auto& p:tmplts.back())
+					{
+						p=rng()%4?255:rng()%256;
+					}
+					thresholds.push_back(w*h*(rng()%100)/200.0f);
+				}
+				auto const found=template_ssd_minima(img,tmplts,thresholds);
+				Assert::AreEqual(tmplts.size(),found.size());
+				for(size_t i=0;i<tmplts.size();++i)
+				{
+					std::vector<ImageUtils::PointUINT> expected;
+					auto const scores=sliding_template_ssd(img,tmplts[i]);
+					for(unsigned int y=0;y<scores._height;++y)
+					{
+						for(unsigned int x=0;x<scores._width;++x)
+						{
+							bool lowest=scores(x,y)<=thresholds[i];
+							for(unsigned int ny=y?y-1:0;ny<=y+1&&ny<scores._height;++ny)
+							{
+								for(unsigned int nx=x?x-1:0;nx<=x+1&&nx<scores._width;++nx)
+								{
+									lowest=lowest&&scores(nx,ny)>=scores(x,y);
+								}
+							}
+							if(lowest)
+							{
+								expected.push_back({x,y});
+							}
+						}
+					}
+					Assert::AreEqual(expected.size(),found[i].size());
+					for(size_t j=0;j<expected.size();++j)
+					{
+						Assert::AreEqual(expected[j].x,found[i][j].x);
+						Assert::AreEqual(expected[j].y,found[i][j].y);
+					}
+				}
+			}
+		}
+		TEST_METHOD(BitImageMatchesThreshold)
+		{
+			std::mt19937 rng(43);
+			for(auto is:{kernels::instruction_set::scalar,kernels::instruction_set::sse41,kernels::instruction_set::avx2})
+			{
+				kernels::set_instruction_set(is);
+				for(unsigned int t=0;t<50;++t)
+				{
+					CImg<unsigned char> img(1+rng()%300,1+rng()%100);
+					unsigned int const density=rng()%100;
+					for(auto& p:img)
+					{
+						p=rng()%100<density?rng()%256:255;
+					}
+					unsigned char const threshold=rng()%256;
+					BitImage const bits(img,threshold);
+					for(unsigned int y=0;y<img._height;++y)
+					{
+						unsigned int count=0;
+						for(unsigned int x=0;x<img._width;++x)
+						{
+							bool const below=img(x,y)<threshold;
+							Assert::AreEqual(below,bits.test(x,y));
+							count+=below;
+						}
+						Assert::AreEqual(count,bits.count_row(y));
+					}
+					auto const expected=select_clusters<1>(img,[threshold](std::array<unsigned char,1> c)
+					{
+						return c[0]<threshold;
+					},true);
+					auto const found=select_clusters(bits,true);
+					Assert::AreEqual(expected.size(),found.size());
+					for(size_t i=0;i<expected.size();++i)
+					{
+						Assert::IsTrue(expected[i].get_ranges()==found[i].get_ranges());
+					}
+				}
+			}
+			kernels::set_instruction_set(kernels::best_instruction_set());
+		}
+		TEST_METHOD(BitImageProfilesMatchGrayProfiles)
+		{
+			std::mt19937 rng(53);
+			for(unsigned int t=0;t<100;++t)
+			{
+				CImg<unsigned char> img(2+rng()%300,1+rng()%50);
+				unsigned int const density=rng()%20;
+				for(auto& p:img)
+				{
+					p=rng()%100<density?rng()%256:255;
+				}
+				BitImage const bits(img,75);
+				Assert::IsTrue(build_left_profile(img,ImageUtils::Grayscale::WHITE)==build_left_profile(bits));
+				Assert::IsTrue(build_right_profile(img,ImageUtils::Grayscale::WHITE)==build_right_profile(bits));
+			}
+		}
+		TEST_METHOD(SlidingMedianMatchesBruteForce)
+		{
+			auto brute_force=[](CImg<unsigned char> const& img,unsigned int ww,unsigned int wh)
+			{
+				CImg<unsigned char> medians(img._width,img._height);
+				for(unsigned int y=0;y<img._height;++y)
+				{
+					for(unsigned int x=0;x<img._width;++x)
+					{
+						unsigned int const left=x>ww/2?x-ww/2:0;
+						unsigned int const top=y>wh/2?y-wh/2:0;
+						unsigned int const right=std::min(img._width,x-ww/2+ww);
+						unsigned int const bottom=std::min(img._height,y-wh/2+wh);
+						std::vector<unsigned char> window;
+						for(unsigned int wy=top;wy<bottom;++wy)
+						{
+							for(unsigned int wx=left;wx<right;++wx)
+							{
+								window.push_back(img(wx,wy));
+							}
+						}
+						std::sort(window.begin(),window.end());
+						auto const rank=window.size()/2;
+						medians(x,y)=rank?window[rank-1]:0;
+					}
+				}
+				return medians;
+			};
+			std::mt19937 rng(47);
+			for(auto is:{kernels::instruction_set::scalar,kernels::instruction_set::sse41,kernels::instruction_set::avx2})
+			{
+				kernels::set_instruction_set(is);
+				for(unsigned int t=0;t<20;++t)
+				{
+					CImg<unsigned char> img(1+rng()%120,1+rng()%200);
+					for(auto& p:img)
+					{
+						p=rng()%3?200+rng()%56:rng()%256;
+					}
+					unsigned int const ww=1+rng()%40;
+					unsigned int const wh=1+rng()%40;
+					Assert::IsTrue(brute_force(img,ww,wh)==sliding_median(img,ww,wh));
+				}
+			}
+			kernels::set_instruction_set(kernels::best_instruction_set());
+		}
+		TEST_METHOD(FeedForwardBatchMatchesFeedForward)
+		{
+			//the scaler feeds windows in batches of 64, so 150 windows leave a tail batch of 22
+			size_t const batch_size=64;
+			size_t const count=150;
+			neural_net::net<> net(27,19,13,6);
+			auto const& layers=net.layers();
+			std::mt19937 rng(23);
+			std::normal_distribution<float> dist(0,1);
+			for(size_t i=1;i<layers.size();++i)
+			{
+				auto& layer=net.layers()[i];
+				std::generate(layer.weights(),layer.weights()+layer.neuron_count()*layers[i-1].neuron_count(),[&]()
+				{
+					return dist(rng);
+				});
+				std::generate(layer.biases(),layer.biases()+layer.neuron_count(),[&]()
+				{
+					return dist(rng);
+				});
+			}
+			size_t const in_size=layers.front().neuron_count();
+			size_t const out_size=layers.back().neuron_count();
+			std::vector<float> input(count*in_size);
+			std::generate(input.begin(),input.end(),[&]()
+			{
+				return dist(rng);
+			});
+			neural_net::batch_weights const weights(layers);
+			neural_net::batch_results scratch(layers,batch_size);
+			std::vector<float> batched(count*out_size);
+			for(size_t first=0;first<count;first+=batch_size)
+			{
+				size_t const n=std::min(batch_size,count-first);
+				net.feed_forward_batch(batched.data()+first*out_size,input.data()+first*in_size,n,weights,scratch);
+			}
+			for(size_t w=0;w<count;++w)
+			{
+				auto const res=net.feed_forward_store(input.data()+w*in_size);
+				auto const expected=res[layers.size()-1].get();
+				for(size_t o=0;o<out_size;++o)
+				{
+					Assert::AreEqual(expected[o],batched[w*out_size+o]);
+				}
+			}
+		}
 		TEST_METHOD(HorizPadding1)
 		{
 			/*CImg<unsigned char> res(10,20);
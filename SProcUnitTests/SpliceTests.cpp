@@ -0,0 +1,445 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "../ScoreProcessor/Splice.h"
+#include "../ScoreProcessor/PixelKernels.h"
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <filesystem>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+using namespace ScoreProcessor;
+namespace SProcUnitTests {
+	TEST_CLASS(SpliceTests)
+	{
+	private:
+		static constexpr unsigned int opt_height=3000;
+		static constexpr unsigned int min_pad=40;
+		static constexpr unsigned int opt_pad=120;
+
+		static std::vector<Splice::page_desc> random_pages(size_t n,unsigned int seed)
+		{
+			std::mt19937 rng(seed);
+			std::vector<Splice::page_desc> pages(n);
+			for(auto& page:pages)
+			{
+				unsigned int const top=rng()%200;
+				unsigned int const bottom=top+200+rng()%1200;
+				unsigned int const kern=rng()%60;
+				page.top={top,top+kern};
+				page.bottom={bottom,bottom-kern};
+			}
+			return pages;
+		}
+
+		//the standard layout and cost, summing heights from prefix sums so that the solver dominates the timing
+		struct layout_maker {
+			Splice::page_desc const* base;
+			std::vector<unsigned int> prefix;
+			explicit layout_maker(std::vector<Splice::page_desc> const& pages):base(pages.data()),prefix(pages.size()+1,0)
+			{
+				for(size_t i=0;i<pages.size();++i)
+				{
+					prefix[i+1]=prefix[i]+pages[i].bottom.kerned-pages[i].top.kerned;
+				}
+			}
+			Splice::page_layout operator()(Splice::page_desc const* items,size_t n) const
+			{
+				size_t const first=items-base;
+				unsigned int total_height;
+				if(n==1)
+				{
+					total_height=items[0].bottom.raw-items[0].top.raw;
+				}
+				else
+				{
+					total_height=prefix[first+n]-prefix[first]
+						+items[0].top.kerned-items[0].top.raw
+						+items[n-1].bottom.raw-items[n-1].bottom.kerned;
+				}
+				unsigned int const minned=total_height+unsigned int(n+1)*min_pad;
+				if(minned>=opt_height)
+				{
+					return {min_pad,minned};
+				}
+				return {unsigned int((opt_height-total_height)/(n+1)),opt_height};
+			}
+		};
+
+		static float cost(Splice::page_layout p)
+		{
+			float const numer=p.height>opt_height?10.0f*(p.height-opt_height):float(opt_height-p.height);
+			float height_cost=numer/opt_height;
+			height_cost=height_cost*height_cost*height_cost;
+			float padding_cost=std::abs(float(p.padding)-opt_pad)/opt_pad;
+			padding_cost=padding_cost*padding_cost*padding_cost;
+			return height_cost+padding_cost;
+		}
+
+		static bool overfull(Splice::page_layout p)
+		{
+			return p.height>opt_height;
+		}
+
+		static bool same(std::vector<Splice::page_break> const& a,std::vector<Splice::page_break> const& b)
+		{
+			if(a.size()!=b.size())
+			{
+				return false;
+			}
+			for(size_t i=0;i<a.size();++i)
+			{
+				if(a[i].index!=b[i].index||a[i].padding!=b[i].padding)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		//takes every page as filled to its full height, so that the spliced pages are whole
+		struct whole_page_eval {
+			Splice::edge eval_top(cimg_library::CImg<unsigned char> const&) const
+			{
+				return {0,0};
+			}
+			Splice::edge eval_bottom(cimg_library::CImg<unsigned char> const& img) const
+			{
+				return {img._height,img._height};
+			}
+			Splice::page_desc eval_middle(cimg_library::CImg<unsigned char> const& top,cimg_library::CImg<unsigned char> const&) const
+			{
+				return {{0,0},{top._height,top._height}};
+			}
+		};
+
+		//composites one pixel at a time the way splice_images always has, onto a white canvas
+		static cimg_library::CImg<unsigned char> splice_pixelwise(std::vector<Splice::page> const& pages,unsigned int padding,unsigned int width,unsigned int height,unsigned int spectrum)
+		{
+			cimg_library::CImg<unsigned char> tog(width,height,1,spectrum);
+			tog.fill(255);
+			unsigned int ypos=padding;
+			for(auto const& page:pages)
+			{
+				auto const& img=page.img;
+				for(unsigned int y=0;y<img._height;++y)
+				{
+					unsigned int const yabs=ypos+y-page.top;
+					if((ypos<page.top&&y<page.top)||yabs>=height)
+					{
+						continue;
+					}
+					for(unsigned int x=0;x<img._width;++x)
+					{
+						unsigned int const xabs=width-img._width+x;
+						unsigned char src[4];
+						for(unsigned int c=0;c<3;++c)
+						{
+							src[c]=img(x,y,img._spectrum<3?0:c);
+						}
+						src[3]=img._spectrum==4?img(x,y,3):255;
+						if(spectrum<3)
+						{
+							tog(xabs,yabs)=std::min(tog(xabs,yabs),src[0]);
+							continue;
+						}
+						unsigned int const sum=unsigned int(tog(xabs,yabs,0))+tog(xabs,yabs,1)+tog(xabs,yabs,2);
+						unsigned int const csum=unsigned int(src[0])+src[1]+src[2];
+						bool const darker=spectrum==3?
+							csum<sum:
+							(765-csum)*src[3]>(765-sum)*tog(xabs,yabs,3);
+						if(darker)
+						{
+							for(unsigned int c=0;c<spectrum;++c)
+							{
+								tog(xabs,yabs,c)=src[c];
+							}
+						}
+					}
+				}
+				ypos+=padding+page.true_height();
+			}
+			return tog;
+		}
+	public:
+		TEST_METHOD(BandedBreakMatchesFull)
+		{
+			for(unsigned int seed=0;seed<20;++seed)
+			{
+				auto const pages=random_pages(1+seed*37,seed);
+				layout_maker const cl(pages);
+				auto const full=nongreedy_break(pages.begin(),pages.end(),cl,cost);
+				auto const banded=nongreedy_break(pages.begin(),pages.end(),cl,cost,overfull);
+				Assert::IsTrue(same(full,banded));
+			}
+		}
+		TEST_METHOD(SpliceImagesMatchesPixelwise)
+		{
+			std::mt19937 rng(29);
+			for(unsigned int t=0;t<300;++t)
+			{
+				unsigned int const spectrum=t%3==0?1:t%3==1?3:4;
+				std::vector<Splice::page> pages(1+rng()%4);
+				unsigned int width=0;
+				unsigned int height=0;
+				unsigned int const padding=rng()%8;
+				for(auto& page:pages)
+				{
+					//the first page sets the spectrum of the output, the others may have fewer channels
+					unsigned int const page_spectrum=&page==pages.data()||rng()%2?spectrum:(spectrum==4&&rng()%2?3:1);
+					page.img.assign(1+rng()%70,2+rng()%30,1,page_spectrum);
+					for(auto& p:page.img)
+					{
+						p=rng()%4?255-rng()%3:rng()%256;
+					}
+					//tops and bottoms inside the image make neighbouring pages overlap
+					page.top=rng()%page.img._height;
+					page.bottom=page.top+1+rng()%(page.img._height-page.top);
+					width=std::max(width,page.img._width);
+					height+=page.true_height()+padding;
+				}
+				height+=padding;
+				auto const expected=splice_pixelwise(pages,padding,width,height,spectrum);
+				for(auto is:{kernels::instruction_set::scalar,kernels::instruction_set::sse41,kernels::instruction_set::avx2})
+				{
+					kernels::set_instruction_set(is);
+					Assert::IsTrue(expected==splice_images(pages.data(),pages.size(),padding));
+				}
+			}
+			kernels::set_instruction_set(kernels::best_instruction_set());
+		}
+		TEST_METHOD(SpliceThroughPageSource)
+		{
+			//the pages are not files, as when splicing cut pieces, so the output has to come from the source too
+			size_t const n=8;
+			auto make_page=[](size_t page)
+			{
+				cimg_library::CImg<unsigned char> img(20,10+unsigned int(page%3));
+				std::mt19937 rng(31+unsigned int(page));
+				for(auto& p:img)
+				{
+					p=rng()%256;
+				}
+				return img;
+			};
+			std::vector<std::string> names(n,"missing.png");
+			std::atomic<unsigned int> made=0;
+			Splice::page_cache pages(names,size_t(1)<<20,3,[&](size_t page)
+			{
+				++made;
+				return make_page(page);
+			});
+			//layouts give their page count as their height, and two pages to an output page is the only free breaking
+			auto cl=[](Splice::page_desc const*,size_t num)
+			{
+				return Splice::page_layout{2,unsigned int(num)};
+			};
+			auto pair_cost=[](Splice::page_layout p)
+			{
+				return p.height==2?0.0f:p.height==1?1.0f:10.0f;
+			};
+			auto over_pair=[](Splice::page_layout p)
+			{
+				return p.height>2;
+			};
+			std::mutex mtx;
+			std::map<unsigned long,cimg_library::CImg<unsigned char>> saved;
+			auto saver=[&](cimg_library::CImg<unsigned char> const& img,char const* name)
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				saved.emplace(std::stoul(name),img);
+			};
+			SaveRules const sr("%1");
+			Assert::AreEqual(4U,splice_pages_parallel(pages,sr,0,whole_page_eval(),cl,pair_cost,over_pair,&splice_images,saver));
+			Assert::AreEqual(unsigned int(n),made.load());
+			for(size_t first=0;first<n;first+=2)
+			{
+				std::vector<Splice::page> expected(2);
+				for(size_t i=0;i<2;++i)
+				{
+					expected[i].img=make_page(first+i);
+					expected[i].top=0;
+					expected[i].bottom=expected[i].img._height;
+				}
+				auto const it=saved.find(first);
+				Assert::IsTrue(it!=saved.end());
+				Assert::IsTrue(it->second==splice_images(expected.data(),2,2));
+			}
+		}
+		TEST_METHOD(SpliceMakesEachPageOnce)
+		{
+			//making a page can mean decoding and cutting a file and running the process list over it, so both splices make each page only once
+			size_t const n=6;
+			std::atomic<unsigned int> made=0;
+			Splice::options options{0,90,false,size_t(1)<<20,0,[&made](size_t page)
+			{
+				++made;
+				cimg_library::CImg<unsigned char> img(40,30);
+				img.fill(255);
+				for(unsigned int y=8;y<20+unsigned int(page%4);++y)
+				{
+					for(unsigned int x=5;x<35;++x)
+					{
+						img(x,y)=0;
+					}
+				}
+				return img;
+			}};
+			Splice::standard_heuristics const sh{128,Splice::pv(2U),Splice::pv(100U),Splice::pv(5U),Splice::pv(2U),10.0f,1.0f};
+			cimg_library::CImg<unsigned char> divider(40,4);
+			divider.fill(255);
+			for(unsigned int x=0;x<40;++x)
+			{
+				divider(x,2)=0;
+			}
+			std::vector<std::string> const names(n,"page.png");
+			auto const dir=std::filesystem::temp_directory_path()/"sproc_splice_test";
+			std::filesystem::create_directories(dir);
+			SaveRules const sr((dir/"%3.png").string());
+			auto const count_outputs=[&dir]()
+			{
+				return size_t(std::distance(std::filesystem::directory_iterator(dir),std::filesystem::directory_iterator()));
+			};
+			auto const plain=splice_pages_parallel(names,sr,options,sh);
+			Assert::AreEqual(unsigned int(n),made.load());
+			Assert::AreEqual(size_t(plain),count_outputs());
+			std::filesystem::remove_all(dir);
+			std::filesystem::create_directories(dir);
+			made=0;
+			auto const divided=splice_pages_parallel(names,sr,options,sh,divider);
+			Assert::AreEqual(unsigned int(n),made.load());
+			Assert::AreEqual(size_t(divided),count_outputs());
+			std::filesystem::remove_all(dir);
+		}
+		TEST_METHOD(StreamingBreaksMatchFullWithLongLookahead)
+		{
+			for(unsigned int seed=0;seed<20;++seed)
+			{
+				size_t const n=2+seed*37;
+				auto const pages=random_pages(n,seed);
+				layout_maker const cl(pages);
+				Splice::break_stream<layout_maker,decltype(&cost),decltype(&overfull)> stream(n,n,cl,&cost,&overfull);
+				std::vector<Splice::page_break> streamed;
+				for(size_t i=1;i<=n;++i)
+				{
+					stream.push(pages.data(),i,[&](size_t,size_t end,unsigned int padding)
+					{
+						streamed.push_back({end,padding});
+					});
+				}
+				std::reverse(streamed.begin(),streamed.end());
+				Assert::IsTrue(same(nongreedy_break(pages.begin(),pages.end(),cl,cost,overfull),streamed));
+			}
+		}
+		TEST_METHOD(StreamingBreaksHoldFewPages)
+		{
+			for(size_t lookahead:{1,2,3,5,8})
+			{
+				for(unsigned int seed=0;seed<10;++seed)
+				{
+					size_t const n=2+seed*53;
+					auto const pages=random_pages(n,seed+100);
+					layout_maker const cl(pages);
+					Splice::break_stream<layout_maker,decltype(&cost),decltype(&overfull)> stream(n,lookahead,cl,&cost,&overfull);
+					size_t next=0;
+					for(size_t i=1;i<=n;++i)
+					{
+						stream.push(pages.data(),i,[&](size_t first,size_t end,unsigned int)
+						{
+							//every page comes out once and in order
+							Assert::AreEqual(next,first);
+							Assert::IsTrue(end>first);
+							Assert::IsTrue(end-first<=lookahead);
+							//and no page waits on more than 2*lookahead pages after it before its output page is saved
+							Assert::IsTrue(i-first<=2*lookahead);
+							next=end;
+						});
+						Assert::IsTrue(i-stream.committed()<=2*lookahead);
+					}
+					Assert::AreEqual(n,next);
+				}
+			}
+		}
+		TEST_METHOD(StreamingSpliceEmitsEveryPageOnceInOrder)
+		{
+			size_t const n=50;
+			//every pixel of a page is its number, so the output pages tell which pages went into them
+			std::atomic<unsigned int> made=0;
+			std::vector<std::string> names(n,"missing.png");
+			Splice::page_cache pages(names,1,3,[&made](size_t page)
+			{
+				++made;
+				cimg_library::CImg<unsigned char> img(4,10+unsigned int(page%3));
+				img.fill(static_cast<unsigned char>(page));
+				return img;
+			});
+			auto cl=[](Splice::page_desc const*,size_t num)
+			{
+				return Splice::page_layout{0,unsigned int(num)};
+			};
+			auto triple_cost=[](Splice::page_layout p)
+			{
+				float const off=float(p.height)-3;
+				return off*off;
+			};
+			auto over_triple=[](Splice::page_layout p)
+			{
+				return p.height>3;
+			};
+			auto list_pages=[](Splice::page const* imgs,size_t num,unsigned int)
+			{
+				cimg_library::CImg<unsigned char> list(unsigned int(num),1);
+				for(size_t i=0;i<num;++i)
+				{
+					list(unsigned int(i),0)=imgs[i].img(0,0);
+				}
+				return list;
+			};
+			std::mutex mtx;
+			std::map<unsigned long,cimg_library::CImg<unsigned char>> saved;
+			auto saver=[&](cimg_library::CImg<unsigned char> const& img,char const* name)
+			{
+				std::lock_guard<std::mutex> lock(mtx);
+				saved.emplace(std::stoul(name),img);
+			};
+			SaveRules const sr("%1");
+			size_t const lookahead=2;
+			auto const num=splice_pages_streaming(pages,sr,0,lookahead,whole_page_eval(),cl,triple_cost,over_triple,list_pages,saver);
+			Assert::AreEqual(size_t(num),saved.size());
+			Assert::AreEqual(unsigned int(n),made.load());
+			size_t next=0;
+			for(auto const& [first,list]:saved)
+			{
+				Assert::AreEqual(size_t(first),next);
+				Assert::IsTrue(list._width<=lookahead);
+				for(unsigned int i=0;i<list._width;++i)
+				{
+					Assert::AreEqual(size_t(list(i,0)),next);
+					++next;
+				}
+			}
+			Assert::AreEqual(n,next);
+		}
+		TEST_METHOD(BandedBreakTenThousandPages)
+		{
+			auto const pages=random_pages(10000,1);
+			layout_maker const cl(pages);
+			using clock=std::chrono::steady_clock;
+			auto const t0=clock::now();
+			auto const full=nongreedy_break(pages.begin(),pages.end(),cl,cost);
+			auto const t1=clock::now();
+			auto const banded=nongreedy_break(pages.begin(),pages.end(),cl,cost,overfull);
+			auto const t2=clock::now();
+			Assert::IsTrue(same(full,banded));
+			std::string msg("10000 pages, full: ");
+			msg+=std::to_string(std::chrono::duration<double>(t1-t0).count());
+			msg+="s, banded: ";
+			msg+=std::to_string(std::chrono::duration<double>(t2-t1).count());
+			msg+="s\n";
+			Logger::WriteMessage(msg.c_str());
+		}
+	};
+}
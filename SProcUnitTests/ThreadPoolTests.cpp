@@ -0,0 +1,191 @@
+#include "stdafx.h"
+#include "CppUnitTest.h"
+#include "../ScoreProcessor/lib/threadpool/work_stealing_pool.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+using namespace Microsoft::VisualStudio::CppUnitTestFramework;
+namespace SProcUnitTests {
+	TEST_CLASS(ThreadPoolTests)
+	{
+	private:
+		static void fib(exlib::work_stealing_pool::parent_ref parent,int n,std::atomic<long>& out)
+		{
+			if(n<2)
+			{
+				out+=n;
+				return;
+			}
+			std::atomic<int> left(2);
+			std::atomic<long> a(0),b(0);
+			parent.push_front([&a,&left,n](exlib::work_stealing_pool::parent_ref p) noexcept
+			{
+				fib(p,n-1,a);
+				--left;
+			});
+			parent.push_front([&b,&left,n](exlib::work_stealing_pool::parent_ref p) noexcept
+			{
+				fib(p,n-2,b);
+				--left;
+			});
+			parent.help_until([&left]()
+			{
+				return left==0;
+			});
+			out+=a+b;
+		}
+
+		//time to run outer tasks that each spawn inner small subtasks
+		template<typename Pool>
+		static double fan_out_seconds(size_t outer,size_t inner)
+		{
+			Pool pool(exlib::hardware_concurrency_or(2));
+			std::atomic<size_t> count(0);
+			auto const start=std::chrono::steady_clock::now();
+			for(size_t i=0;i<outer;++i)
+			{
+				pool.push_back([&count,inner](typename Pool::parent_ref parent) noexcept
+				{
+					for(size_t j=0;j<inner;++j)
+					{
+						parent.push_back([&count]() noexcept
+						{
+							volatile unsigned int x=0;
+							for(unsigned int k=0;k<200;++k)
+							{
+								x=x+k;
+							}
+							++count;
+						});
+					}
+				});
+			}
+			pool.wait();
+			auto const end=std::chrono::steady_clock::now();
+			Assert::AreEqual(outer*inner,count.load());
+			return std::chrono::duration<double>(end-start).count();
+		}
+
+		//time to run tasks pushed from outside the pool
+		template<typename Pool>
+		static double flat_seconds(size_t tasks)
+		{
+			Pool pool(exlib::hardware_concurrency_or(2));
+			std::atomic<size_t> count(0);
+			auto const start=std::chrono::steady_clock::now();
+			for(size_t i=0;i<tasks;++i)
+			{
+				pool.push_back([&count]() noexcept
+				{
+					++count;
+				});
+			}
+			pool.wait();
+			auto const end=std::chrono::steady_clock::now();
+			Assert::AreEqual(tasks,count.load());
+			return std::chrono::duration<double>(end-start).count();
+		}
+	public:
+		TEST_METHOD(StealingRunsAllTasks)
+		{
+			exlib::work_stealing_pool pool(4);
+			std::atomic<unsigned int> count(0);
+			for(unsigned int i=0;i<10000;++i)
+			{
+				pool.push_back([&count]() noexcept
+				{
+					++count;
+				});
+			}
+			pool.wait();
+			Assert::AreEqual(10000U,count.load());
+			pool.num_threads(2);
+			auto answer=pool.async([]() noexcept
+			{
+				return 7;
+			});
+			Assert::AreEqual(7,answer.get());
+		}
+		TEST_METHOD(StealingSubtasks)
+		{
+			exlib::work_stealing_pool pool(4);
+			std::atomic<long> result(0);
+			pool.push_back([&result](exlib::work_stealing_pool::parent_ref parent) noexcept
+			{
+				fib(parent,18,result);
+			});
+			pool.wait();
+			Assert::AreEqual(2584L,result.load());
+		}
+		TEST_METHOD(StealingArgs)
+		{
+			int value=5;
+			exlib::work_stealing_pool_a<int const*> pool(3,exlib::delay_start_t{},nullptr);
+			pool.set_args(&value);
+			std::atomic<int> sum(0);
+			for(unsigned int i=0;i<100;++i)
+			{
+				pool.push_back([&sum](int const* v) noexcept
+				{
+					sum+=*v;
+				});
+			}
+			pool.start();
+			pool.wait();
+			Assert::AreEqual(500,sum.load());
+		}
+		TEST_METHOD(GroupHelpRunsOnlyItsGroup)
+		{
+			exlib::work_stealing_pool pool(2,exlib::delay_start_t{});
+			std::atomic<bool> outer_ran(false);
+			std::atomic<unsigned int> inner_ran(0);
+			int group;
+			pool.push_back([&outer_ran]() noexcept
+			{
+				outer_ran=true;
+			});
+			for(unsigned int i=0;i<3;++i)
+			{
+				pool.push_back_in(&group,[&inner_ran]() noexcept
+				{
+					++inner_ran;
+				});
+			}
+			pool.push_front([&outer_ran]() noexcept
+			{
+				outer_ran=true;
+			});
+			//nothing else runs the tasks until the pool starts
+			pool.help_until([&inner_ran]()
+			{
+				return inner_ran==3;
+			},&group);
+			Assert::IsFalse(outer_ran.load());
+			Assert::AreEqual(size_t(2),pool.num_jobs());
+			pool.start();
+			pool.wait();
+			Assert::IsTrue(outer_ran.load());
+		}
+		TEST_METHOD(ThroughputComparison)
+		{
+			size_t const tasks=1000000;
+			size_t const outer=64,inner=20000;
+			auto const flat_old=flat_seconds<exlib::thread_pool>(tasks);
+			auto const flat_new=flat_seconds<exlib::work_stealing_pool>(tasks);
+			auto const fan_old=fan_out_seconds<exlib::thread_pool>(outer,inner);
+			auto const fan_new=fan_out_seconds<exlib::work_stealing_pool>(outer,inner);
+			auto const report=[](char const* name,size_t n,double old_s,double new_s)
+			{
+				std::string msg(name);
+				msg+=": thread_pool ";
+				msg+=std::to_string(n/old_s);
+				msg+=" tasks/s, work_stealing_pool ";
+				msg+=std::to_string(n/new_s);
+				msg+=" tasks/s\n";
+				Logger::WriteMessage(msg.c_str());
+			};
+			report("external pushes",tasks,flat_old,flat_new);
+			report("subtask fan out",outer*inner,fan_old,fan_new);
+		}
+	};
+}
@@ -0,0 +1,156 @@
+/*
+Copyright(C) 2017-2019 Edward Xie
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "stdafx.h"
+#include "BitImage.h"
+#include "PixelKernels.h"
+#include <algorithm>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+namespace ScoreProcessor {
+	namespace {
+		typedef BitImage::word word;
+
+		inline unsigned int lowest_bit(word w) noexcept
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+#ifdef _WIN64
+			_BitScanForward64(&index,w);
+#else
+			if(!_BitScanForward(&index,static_cast<unsigned long>(w)))
+			{
+				_BitScanForward(&index,static_cast<unsigned long>(w>>32));
+				index+=32;
+			}
+#endif
+			return index;
+#else
+			return unsigned int(__builtin_ctzll(w));
+#endif
+		}
+
+		inline unsigned int highest_bit(word w) noexcept
+		{
+#ifdef _MSC_VER
+			unsigned long index;
+#ifdef _WIN64
+			_BitScanReverse64(&index,w);
+#else
+			if(_BitScanReverse(&index,static_cast<unsigned long>(w>>32)))
+			{
+				index+=32;
+			}
+			else
+			{
+				_BitScanReverse(&index,static_cast<unsigned long>(w));
+			}
+#endif
+			return index;
+#else
+			return 63-unsigned int(__builtin_clzll(w));
+#endif
+		}
+
+		//first x in [begin,end) whose bit is set, reading the words through flip, or end
+		inline unsigned int find_first_in(word const* row,unsigned int begin,unsigned int end,word flip) noexcept
+		{
+			if(begin>=end)
+			{
+				return end;
+			}
+			size_t w=begin/64;
+			size_t const last=(end-1)/64;
+			word bits=(row[w]^flip)&(~word(0)<<(begin%64));
+			while(!bits)
+			{
+				if(w==last)
+				{
+					return end;
+				}
+				bits=row[++w]^flip;
+			}
+			return std::min(unsigned int(w*64+lowest_bit(bits)),end);
+		}
+	}
+
+	BitImage::BitImage(unsigned int width,unsigned int height):
+		_words((size_t{width}+63)/64*height,0),
+		_width(width),
+		_height(height),
+		_row_words((size_t{width}+63)/64)
+	{}
+
+	BitImage::BitImage(::cil::CImg<unsigned char> const& image,unsigned char threshold):
+		BitImage(image._width,image._height)
+	{
+		for(unsigned int y=0;y<_height;++y)
+		{
+			kernels::pack_below(row(y),image.data(0,y),_width,threshold);
+		}
+	}
+
+	unsigned int BitImage::count_row(unsigned int y) const
+	{
+		return unsigned int(kernels::count_bits(row(y),_row_words));
+	}
+
+	unsigned int BitImage::find_first(unsigned int y,unsigned int begin,unsigned int end) const noexcept
+	{
+		return find_first_in(row(y),begin,end,0);
+	}
+
+	unsigned int BitImage::find_last(unsigned int y,unsigned int begin,unsigned int end) const noexcept
+	{
+		if(begin>=end)
+		{
+			return end;
+		}
+		auto const r=row(y);
+		size_t w=(end-1)/64;
+		size_t const first=begin/64;
+		word bits=r[w]&(~word(0)>>(63-(end-1)%64));
+		while(!bits)
+		{
+			if(w==first)
+			{
+				return end;
+			}
+			bits=r[--w];
+		}
+		unsigned int const x=unsigned int(w*64+highest_bit(bits));
+		return x>=begin?x:end;
+	}
+
+	void BitImage::append_runs(::std::vector<ImageUtils::Rectangle<unsigned int>>& runs,unsigned int top,unsigned int bottom) const
+	{
+		for(unsigned int y=top;y<bottom;++y)
+		{
+			auto const r=row(y);
+			for(unsigned int x=0;;)
+			{
+				unsigned int const start=find_first_in(r,x,_width,0);
+				if(start==_width)
+				{
+					break;
+				}
+				x=find_first_in(r,start,_width,~word(0));
+				runs.push_back({start,x,y,y+1});
+			}
+		}
+	}
+}
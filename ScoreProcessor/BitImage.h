@@ -0,0 +1,99 @@
+/*
+Copyright(C) 2017-2019 Edward Xie
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef BIT_IMAGE_H
+#define BIT_IMAGE_H
+#include "CImg.h"
+#include "ImageUtils.h"
+#include <cstddef>
+#include <vector>
+namespace ScoreProcessor {
+	/*
+		One bit per pixel of whether it is foreground, packed 64 pixels to a word along each row.
+		Every row starts on a new word and the bits past the width are always clear,
+		so rows are counted and scanned a word at a time, in an eighth of the memory of the 8-bit image.
+	*/
+	class BitImage {
+	public:
+		typedef unsigned long long word;
+	private:
+		::std::vector<word> _words;
+		unsigned int _width;
+		unsigned int _height;
+		::std::size_t _row_words;
+	public:
+		BitImage() noexcept:_width(0),_height(0),_row_words(0)
+		{}
+		/*
+			Image of the given size with every pixel background.
+		*/
+		BitImage(unsigned int width,unsigned int height);
+		/*
+			Marks the pixels whose first channel is below threshold as foreground.
+		*/
+		BitImage(::cil::CImg<unsigned char> const& image,unsigned char threshold);
+
+		unsigned int width() const noexcept
+		{
+			return _width;
+		}
+		unsigned int height() const noexcept
+		{
+			return _height;
+		}
+		::std::size_t row_words() const noexcept
+		{
+			return _row_words;
+		}
+		word const* row(unsigned int y) const noexcept
+		{
+			return _words.data()+y*_row_words;
+		}
+		word* row(unsigned int y) noexcept
+		{
+			return _words.data()+y*_row_words;
+		}
+		bool test(unsigned int x,unsigned int y) const noexcept
+		{
+			return (row(y)[x/64]>>(x%64))&1;
+		}
+		void set(unsigned int x,unsigned int y,bool foreground=true) noexcept
+		{
+			auto& w=row(y)[x/64];
+			word const bit=word(1)<<(x%64);
+			w=foreground?w|bit:w&~bit;
+		}
+
+		/*
+			Number of foreground pixels in row y.
+		*/
+		unsigned int count_row(unsigned int y) const;
+		/*
+			Leftmost foreground x in [begin,end) of row y, or end if there is none.
+		*/
+		unsigned int find_first(unsigned int y,unsigned int begin,unsigned int end) const noexcept;
+		/*
+			Rightmost foreground x in [begin,end) of row y, or end if there is none.
+		*/
+		unsigned int find_last(unsigned int y,unsigned int begin,unsigned int end) const noexcept;
+		/*
+			Appends the single row runs of foreground in rows [top,bottom), sorted by row then left,
+			the same runs select_rows gives for the 8-bit image.
+		*/
+		void append_runs(::std::vector<ImageUtils::Rectangle<unsigned int>>& runs,unsigned int top,unsigned int bottom) const;
+	};
+}
+#endif // !BIT_IMAGE_H
@@ -16,8 +16,11 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 */
 #include "stdafx.h"
 #include "Cluster.h"
+#include "WorkerPool.h"
 #include <stack>
 #include <algorithm>
+#include <numeric>
+#include <assert.h>
 using namespace std;
 namespace ScoreProcessor {
 	unsigned int Cluster::size() const
@@ -111,4 +114,269 @@ namespace ScoreProcessor {
 		}
 		return line;
 	}
+
+	namespace {
+		using run=ImageUtils::Rectangle<unsigned int>;
+		//union-find over run indices where the smaller index stays the root,
+		//so clusters come out in order of their first run however the unions were done
+		class run_forest {
+			vector<size_t> parent;
+		public:
+			explicit run_forest(size_t n):parent(n)
+			{
+				for(size_t i=0;i<n;++i)
+				{
+					parent[i]=i;
+				}
+			}
+			size_t find(size_t i)
+			{
+				while(parent[i]!=i)
+				{
+					parent[i]=parent[parent[i]];
+					i=parent[i];
+				}
+				return i;
+			}
+			void unite(size_t a,size_t b)
+			{
+				a=find(a);
+				b=find(b);
+				if(a<b)
+				{
+					parent[b]=a;
+				}
+				else if(b<a)
+				{
+					parent[a]=b;
+				}
+			}
+		};
+
+		//joins the runs of a row to the runs they touch in the row above,
+		//with right exclusive, diagonal neighbours are runs whose ends are equal to the other's starts
+		void join_rows(
+			run const* above,size_t above_count,size_t above_index,
+			run const* row,size_t row_count,size_t row_index,
+			unsigned int reach,run_forest& forest)
+		{
+			size_t p=0;
+			for(size_t c=0;c<row_count;++c)
+			{
+				auto const& current=row[c];
+				while(p<above_count&&above[p].right+reach<=current.left)
+				{
+					++p;
+				}
+				for(size_t q=p;q<above_count&&above[q].left<current.right+reach;++q)
+				{
+					forest.unite(above_index+q,row_index+c);
+				}
+			}
+		}
+
+		size_t row_length(run const* runs,size_t n)
+		{
+			size_t length=1;
+			while(length<n&&runs[length].top==runs[0].top)
+			{
+				++length;
+			}
+			return length;
+		}
+
+		//joins runs [0,n) to each other, they being indices [index,index+n) of the forest
+		void join_runs(run const* runs,size_t n,size_t index,unsigned int reach,run_forest& forest)
+		{
+			size_t prev_begin=0,prev_end=0;
+			for(size_t row_begin=0;row_begin<n;)
+			{
+				size_t const row_end=row_begin+row_length(runs+row_begin,n-row_begin);
+				if(prev_end>prev_begin&&runs[prev_begin].top+1==runs[row_begin].top)
+				{
+					join_rows(
+						runs+prev_begin,prev_end-prev_begin,index+prev_begin,
+						runs+row_begin,row_end-row_begin,index+row_begin,
+						reach,forest);
+				}
+				prev_begin=row_begin;
+				prev_end=row_end;
+				row_begin=row_end;
+			}
+		}
+
+		//numbers the roots of the forest in order of their first index
+		vector<size_t> label_forest(run_forest& forest,size_t n,size_t& count)
+		{
+			size_t const unlabeled=~size_t(0);
+			vector<size_t> root_label(n,unlabeled);
+			vector<size_t> labels(n);
+			count=0;
+			for(size_t i=0;i<n;++i)
+			{
+				size_t const root=forest.find(i);
+				if(root_label[root]==unlabeled)
+				{
+					root_label[root]=count++;
+				}
+				labels[i]=root_label[root];
+			}
+			return labels;
+		}
+
+		//joins each strip on the pool, then the last row of each strip with the first row of the next
+		run_forest join_strips(vector<vector<run>> const& strips,unsigned int reach)
+		{
+			vector<size_t> index(strips.size()+1,0);
+			for(size_t s=0;s<strips.size();++s)
+			{
+				index[s+1]=index[s]+strips[s].size();
+			}
+			run_forest forest(index.back());
+			//each strip only unites its own indices, so all strips are joined at once
+			parallel_for(strips.size(),[&](size_t s)
+			{
+				join_runs(strips[s].data(),strips[s].size(),index[s],reach,forest);
+			});
+			size_t above=strips.size();
+			for(size_t s=0;s<strips.size();++s)
+			{
+				auto const& strip=strips[s];
+				if(strip.empty())
+				{
+					continue;
+				}
+				if(above!=strips.size()&&strips[above].back().top+1==strip.front().top)
+				{
+					auto const& prev=strips[above];
+					size_t prev_begin=prev.size()-1;
+					while(prev_begin>0&&prev[prev_begin-1].top==prev.back().top)
+					{
+						--prev_begin;
+					}
+					join_rows(
+						prev.data()+prev_begin,prev.size()-prev_begin,index[above]+prev_begin,
+						strip.data(),row_length(strip.data(),strip.size()),index[s],
+						reach,forest);
+				}
+				above=s;
+			}
+			return forest;
+		}
+
+		vector<Cluster> make_clusters(vector<vector<run>> groups)
+		{
+			parallel_for(groups.size(),[&groups](size_t i)
+			{
+				ImageUtils::compress_rectangles(groups[i]);
+			});
+			vector<Cluster> clusters;
+			clusters.reserve(groups.size());
+			for(auto& group:groups)
+			{
+				clusters.emplace_back(std::move(group));
+			}
+			return clusters;
+		}
+	}
+
+	vector<Cluster> Cluster::cluster_runs(vector<run> const& runs,bool eight_way)
+	{
+		run_forest forest(runs.size());
+		join_runs(runs.data(),runs.size(),0,eight_way?1:0,forest);
+		size_t count;
+		auto const labels=label_forest(forest,runs.size(),count);
+		vector<vector<run>> groups(count);
+		for(size_t i=0;i<runs.size();++i)
+		{
+			groups[labels[i]].push_back(runs[i]);
+		}
+		return make_clusters(std::move(groups));
+	}
+
+	vector<Cluster> Cluster::cluster_strips(vector<vector<run>> const& strips,bool eight_way)
+	{
+		auto forest=join_strips(strips,eight_way?1:0);
+		size_t n=0;
+		for(auto const& strip:strips)
+		{
+			n+=strip.size();
+		}
+		size_t count;
+		auto const labels=label_forest(forest,n,count);
+		vector<vector<run>> groups(count);
+		size_t i=0;
+		for(auto const& strip:strips)
+		{
+			for(auto const& r:strip)
+			{
+				groups[labels[i++]].push_back(r);
+			}
+		}
+		return make_clusters(std::move(groups));
+	}
+
+	void cluster_stats::add(run r,run_measure measure) noexcept
+	{
+		unsigned int const length=r.width();
+		area+=length;
+		bounding_box.left=std::min(bounding_box.left,r.left);
+		bounding_box.right=std::max(bounding_box.right,r.right);
+		bounding_box.top=std::min(bounding_box.top,r.top);
+		bounding_box.bottom=std::max(bounding_box.bottom,r.bottom);
+		x_sum+=double(length)*(double(r.left+r.right)/2);
+		y_sum+=double(length)*(double(r.top+r.bottom)/2);
+		min_intensity=std::min(min_intensity,measure.min_intensity);
+		max_intensity=std::max(max_intensity,measure.max_intensity);
+		required+=measure.required;
+	}
+
+	labeled_runs labeled_runs::label_strips(vector<vector<run>> const& strips,vector<vector<run_measure>> const& measures,bool eight_way)
+	{
+		assert(strips.size()==measures.size());
+		auto forest=join_strips(strips,eight_way?1:0);
+		labeled_runs ret;
+		for(auto const& strip:strips)
+		{
+			ret.runs.insert(ret.runs.end(),strip.begin(),strip.end());
+		}
+		size_t count;
+		ret.labels=label_forest(forest,ret.runs.size(),count);
+		ret.clusters.resize(count);
+		ret.label_starts.assign(count+1,0);
+		for(auto const label:ret.labels)
+		{
+			++ret.label_starts[label+1];
+		}
+		std::partial_sum(ret.label_starts.begin(),ret.label_starts.end(),ret.label_starts.begin());
+		ret.label_runs.resize(ret.runs.size());
+		vector<size_t> next(ret.label_starts.begin(),ret.label_starts.end()-1);
+		for(size_t r=0;r<ret.runs.size();++r)
+		{
+			ret.label_runs[next[ret.labels[r]]++]=r;
+		}
+		size_t i=0;
+		for(auto const& strip_measures:measures)
+		{
+			for(auto const& measure:strip_measures)
+			{
+				ret.clusters[ret.labels[i]].add(ret.runs[i],measure);
+				++i;
+			}
+		}
+		return ret;
+	}
+
+	Cluster labeled_runs::cluster(size_t label) const
+	{
+		assert(label+1<label_starts.size());
+		vector<run> ranges;
+		ranges.reserve(label_starts[label+1]-label_starts[label]);
+		for(size_t k=label_starts[label];k<label_starts[label+1];++k)
+		{
+			ranges.push_back(runs[label_runs[k]]);
+		}
+		ImageUtils::compress_rectangles(ranges);
+		return Cluster(std::move(ranges));
+	}
 }
\ No newline at end of file
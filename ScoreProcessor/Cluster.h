@@ -28,6 +28,9 @@ namespace ScoreProcessor {
 	private:
 		::std::vector<ImageUtils::Rectangle<unsigned int>> ranges;
 	public:
+		Cluster()=default;
+		explicit Cluster(::std::vector<ImageUtils::Rectangle<unsigned int>> ranges) noexcept:ranges(std::move(ranges))
+		{}
 		/*
 			Returns the area of the cluster
 			(i.e. the sum of the areas of all sub-rectangles)
@@ -210,6 +213,19 @@ namespace ScoreProcessor {
 			});
 		}
 
+		/*
+			Given single row runs sorted by row and then by left, as from global_select without compression,
+			returns the same clusters as cluster_ranges (or cluster_ranges_8way if eight_way), with each cluster's rectangles compressed.
+			Runs are joined to the runs they touch in the row above with union-find, so this is near linear in the number of runs.
+		*/
+		static ::std::vector<Cluster> cluster_runs(::std::vector<ImageUtils::Rectangle<unsigned int>> const& runs,bool eight_way=false);
+		/*
+			Same as cluster_runs, with the runs given as horizontal strips of the image from top to bottom.
+			The strips are joined in parallel on the global pool, then joined to each other at their seams.
+			The clusters, their order and their rectangles are identical to those of cluster_runs on all the runs together.
+		*/
+		static ::std::vector<Cluster> cluster_strips(::std::vector<::std::vector<ImageUtils::Rectangle<unsigned int>>> const& strips,bool eight_way=false);
+
 		inline static ::std::vector<Cluster> cluster_ranges_8way(::std::vector<ImageUtils::Rectangle<unsigned int>> const& ranges)
 		{
 			using R=ImageUtils::Rectangle<unsigned int>;
@@ -219,5 +235,72 @@ namespace ScoreProcessor {
 			});
 		}
 	};
+
+	/*
+		What the selection saw of the pixels of a single row run.
+		Intensity is the sum of the channels the selector looked at.
+	*/
+	struct run_measure {
+		unsigned int min_intensity;
+		unsigned int max_intensity;
+		//number of pixels whose intensity was in the required range
+		unsigned int required;
+	};
+
+	/*
+		Summary of one cluster, accumulated from its runs while labeling instead of keeping its rectangles.
+	*/
+	struct cluster_stats {
+		unsigned int area=0;
+		ImageUtils::Rectangle<unsigned int> bounding_box{~0U,0,~0U,0};
+		//sums of the pixel coordinates, over area for the center of mass
+		double x_sum=0;
+		double y_sum=0;
+		unsigned int min_intensity=~0U;
+		unsigned int max_intensity=0;
+		unsigned int required=0;
+
+		/*
+			Returns the center of mass of the cluster, the same as Cluster::center
+		*/
+		template<typename T>
+		ImageUtils::Point<T> center() const
+		{
+			if(area==0)
+			{
+				return {T(0),T(0)};
+			}
+			return {T(x_sum/area),T(y_sum/area)};
+		}
+		void add(ImageUtils::Rectangle<unsigned int> run,run_measure measure) noexcept;
+	};
+
+	/*
+		Runs of an image with the cluster each belongs to, and the stats of every cluster in order of their first run.
+	*/
+	struct labeled_runs {
+		::std::vector<ImageUtils::Rectangle<unsigned int>> runs;
+		::std::vector<size_t> labels;
+		::std::vector<cluster_stats> clusters;
+		//indices of the runs of cluster k, in order, are label_runs[label_starts[k]] up to label_runs[label_starts[k+1]]
+		::std::vector<size_t> label_starts;
+		::std::vector<size_t> label_runs;
+
+		/*
+			Labels the runs of horizontal strips of an image from top to bottom, with the measure of each run,
+			joining the strips in parallel as Cluster::cluster_strips does.
+			Clusters are numbered in the same order as cluster_strips returns them.
+		*/
+		static labeled_runs label_strips(
+			::std::vector<::std::vector<ImageUtils::Rectangle<unsigned int>>> const& strips,
+			::std::vector<::std::vector<run_measure>> const& measures,
+			bool eight_way=false);
+
+		/*
+			Builds the cluster with the given label, with rectangles identical to the ones cluster_strips would give it.
+			Only touches the runs of that cluster.
+		*/
+		Cluster cluster(size_t label) const;
+	};
 }
 #endif // !CLUSTER_H
@@ -20,6 +20,9 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 #include "ImageUtils.h"
 #include <assert.h>
 #include <type_traits>
+#include <vector>
+#include <algorithm>
+#include "lib/threadpool/work_stealing_pool.h"
 #define M_PI	3.14159265358979323846
 #define M_PI_2	1.57079632679489661923
 #define M_PI_4	0.78539816339744830962
@@ -52,14 +55,18 @@ namespace cimg_library {
 		return img;
 	}
 
+	/*
+		map_if on the pixels at offsets [begin,end) of each layer
+	*/
 	template<size_t NumLayers,typename T,typename ArrayToArray,typename ArrayToBool>
-	CImg<T>& map_if(CImg<T>& img,ArrayToArray func,ArrayToBool pred)
+	CImg<T>& map_if(CImg<T>& img,ArrayToArray func,ArrayToBool pred,size_t begin,size_t end)
 	{
 		assert(NumLayers<=img._spectrum);
 		auto const data=img._data;
 		size_t const size=size_t(img._width)*img._height; //I hope the compiler can realize this is unused if NumLayers==1
+		assert(end<=size);
 		std::array<T,NumLayers> color;
-		for(unsigned int i=0;i<size;++i)
+		for(size_t i=begin;i<end;++i)
 		{
 			auto const pix=data+i;
 			for(unsigned int s=0;s<NumLayers;++s)
@@ -79,6 +86,12 @@ namespace cimg_library {
 		return img;
 	}
 
+	template<size_t NumLayers,typename T,typename ArrayToArray,typename ArrayToBool>
+	CImg<T>& map_if(CImg<T>& img,ArrayToArray func,ArrayToBool pred)
+	{
+		return map_if<NumLayers>(img,func,pred,0,size_t(img._width)*img._height);
+	}
+
 	template<unsigned int InputLayers,unsigned int OutputLayers=-1,typename T,typename ArrayToArray>
 	auto get_map(CImg<T> const& img,ArrayToArray func)
 	{
@@ -445,18 +458,32 @@ namespace cimg_library {
 	*/
 	::cimg_library::CImg<unsigned char> get_grayscale_simple(::cimg_library::CImg<unsigned char> const& image);
 
-	inline void apply_gamma(::cil::CImg<unsigned char>& img,float gamma)
+	/*
+		Applies gamma to rows [top,bottom) of the color layers
+	*/
+	inline void apply_gamma(::cil::CImg<unsigned char>& img,float gamma,unsigned int top,unsigned int bottom)
 	{
 		assert(gamma>=0);
+		assert(top<=bottom&&bottom<=img._height);
 		size_t const size=(size_t(img._width)*img._height);
-		size_t const limit=img._spectrum<3?size:size*3;
-		auto const data=img._data;
-		for(size_t i=0;i<limit;++i)
+		unsigned int const layers=img._spectrum<3?1:3;
+		size_t const begin=size_t(top)*img._width;
+		size_t const end=size_t(bottom)*img._width;
+		for(unsigned int s=0;s<layers;++s)
 		{
-			data[i]=std::round(255.0f*std::pow(float(data[i])/255.0f,gamma));
+			auto const data=img._data+s*size;
+			for(size_t i=begin;i<end;++i)
+			{
+				data[i]=std::round(255.0f*std::pow(float(data[i])/255.0f,gamma));
+			}
 		}
 	}
 
+	inline void apply_gamma(::cil::CImg<unsigned char>& img,float gamma)
+	{
+		apply_gamma(img,gamma,0,img._height);
+	}
+
 	inline ::cil::CImg<unsigned char> get_gamma(::cil::CImg<unsigned char> const& img,float gamma)
 	{
 		assert(gamma>=0);
@@ -497,6 +524,10 @@ namespace cimg_library {
 		double angle_dif;
 		unsigned int angle_steps;
 		double precision;
+		//cos and sin of each angle step, so voting needs no trigonometry
+		void trig_tables(std::vector<double>& cos_table,std::vector<double>& sin_table) const;
+		template<typename Selector>
+		void cast_votes(CountType* acc,Selector& vote_caster,unsigned int width,unsigned int top,unsigned int bottom,double const* cos_table,double const* sin_table) const;
 	public:
 		HoughArray(
 			CImg<signed char> const& gradient,
@@ -504,6 +535,10 @@ namespace cimg_library {
 			unsigned int num_steps=300,
 			double precision=1.0f,
 			signed char threshold=64);
+		/*
+			If pool is given, rows are split among its threads, each voting into its own accumulator, and the accumulators are summed.
+			vote_caster must then be safe to call concurrently.
+		*/
 		template<typename Selector>
 		HoughArray(
 			Selector vote_caster,
@@ -511,12 +546,50 @@ namespace cimg_library {
 			unsigned int height,
 			double lower_angle=M_PI_2-M_PI_2/18,double upper_angle=M_PI_2+M_PI_2/18,
 			unsigned int num_steps=300,
-			double precision=1.0f);
+			double precision=1.0f,
+			exlib::work_stealing_pool* pool=nullptr);
 		unsigned int& operator()(double theta,double r);
 		double angle() const;
 		std::vector<ImageUtils::line_norm<double>> top_lines(size_t num) const;
 	};
 
+	template<typename CountType>
+	void HoughArray<CountType>::trig_tables(std::vector<double>& cos_table,std::vector<double>& sin_table) const
+	{
+		cos_table.resize(angle_steps+1);
+		sin_table.resize(angle_steps+1);
+		for(uint f=0;f<=angle_steps;++f)
+		{
+			double theta=angle_dif*f/angle_steps+theta_min;
+			cos_table[f]=std::cos(theta);
+			sin_table[f]=std::sin(theta);
+		}
+	}
+
+	template<typename CountType>
+	template<typename Selector>
+	void HoughArray<CountType>::cast_votes(CountType* acc,Selector& vote_caster,unsigned int width,unsigned int top,unsigned int bottom,double const* cos_table,double const* sin_table) const
+	{
+		double const step=(_height-1)/precision;
+		for(uint y=top;y<bottom;++y)
+		{
+			for(uint x=0;x<width;++x)
+			{
+				if(vote_caster(x,y))
+				{
+					for(uint f=0;f<=angle_steps;++f)
+					{
+						double r=x*cos_table[f]+y*sin_table[f];
+						unsigned int ry=((r+rmax)/(2*rmax))*step;
+						auto const inc=acc+ry*_width+f;
+						++(*inc);
+						++(*(inc+_width));
+					}
+				}
+			}
+		}
+	}
+
 	template<typename CountType>
 	template<typename Selector>
 	HoughArray<CountType>::HoughArray(
@@ -525,7 +598,8 @@ namespace cimg_library {
 		unsigned int height,
 		double lower_angle,double upper_angle,
 		unsigned int num_steps,
-		double precision):
+		double precision,
+		exlib::work_stealing_pool* pool):
 		CImg(num_steps+1,(rmax=hypot(width,height))*2/precision),
 		theta_min(lower_angle),
 		angle_dif(upper_angle-lower_angle),
@@ -533,23 +607,40 @@ namespace cimg_library {
 		precision(precision)
 	{
 		CImg<CountType>::fill(0);
-		double step=(_height-1)/precision;
-		for(uint y=0;y<height;++y)
+		std::vector<double> cos_table,sin_table;
+		trig_tables(cos_table,sin_table);
+		unsigned int const bands=pool?unsigned int(std::min<size_t>(pool->num_threads(),height/16)):0;
+		if(bands<2)
 		{
-			for(uint x=0;x<width;++x)
+			cast_votes(this->data(),vote_caster,width,0,height,cos_table.data(),sin_table.data());
+			return;
+		}
+		//counts wrap the same way whether they are summed here or incremented in place
+		std::vector<CImg<CountType>> partial(bands-1,CImg<CountType>(_width,_height,1,1,0));
+		std::atomic<unsigned int> left(bands);
+		for(unsigned int b=0;b<bands;++b)
+		{
+			unsigned int const top=unsigned int(size_t(height)*b/bands);
+			unsigned int const bottom=unsigned int(size_t(height)*(b+1)/bands);
+			CountType* const acc=b==0?this->data():partial[b-1].data();
+			pool->push_front_in(&left,[=,&vote_caster,&cos_table,&sin_table,&left]() noexcept
 			{
-				if(vote_caster(x,y))
-				{
-					for(uint f=0;f<=angle_steps;++f)
-					{
-						double theta=angle_dif*f/angle_steps+theta_min;
-						double r=x*std::cos(theta)+y*std::sin(theta);
-						unsigned int y=((r+rmax)/(2*rmax))*step;
-						auto const inc=this->data()+y*_width+f;
-						++(*inc);
-						++(*(inc+_width));
-					}
-				}
+				cast_votes(acc,vote_caster,width,top,bottom,cos_table.data(),sin_table.data());
+				--left;
+			});
+		}
+		pool->help_until([&left]()
+		{
+			return left==0;
+		},&left);
+		auto const total=this->data();
+		size_t const count=this->size();
+		for(auto const& part:partial)
+		{
+			auto const pd=part.data();
+			for(size_t i=0;i<count;++i)
+			{
+				total[i]+=pd[i];
 			}
 		}
 	}
@@ -570,27 +661,14 @@ namespace cimg_library {
 	{
 		threshold=std::abs(threshold);
 		fill(0);
-		double step=(_height-1)/precision;
+		std::vector<double> cos_table,sin_table;
+		trig_tables(cos_table,sin_table);
 		signed char const* const data=gradient.data();
-		for(uint y=0;y<gradient._height;++y)
+		auto selector=[data,width=gradient._width,threshold](unsigned int x,unsigned int y)
 		{
-			signed char const* const row=data+y*gradient._width;
-			for(uint x=0;x<gradient._width;++x)
-			{
-				if(std::abs(*(row+x))>threshold)
-				{
-					for(uint f=0;f<=angle_steps;++f)
-					{
-						double theta=angle_dif*f/angle_steps+theta_min;
-						double r=x*std::cos(theta)+y*std::sin(theta);
-						unsigned int y=((r+rmax)/(2*rmax))*step;
-						unsigned int* const inc=this->data()+y*_width+f;
-						++(*inc);
-						++(*(inc+_width));
-					}
-				}
-			}
-		}
+			return std::abs(*(data+size_t(y)*width+x))>threshold;
+		};
+		cast_votes(this->data(),selector,gradient._width,0,gradient._height,cos_table.data(),sin_table.data());
 	}
 	template<typename CountType>
 	unsigned int& HoughArray<CountType>::operator()(double theta,double r)
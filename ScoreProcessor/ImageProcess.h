@@ -22,6 +22,7 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 #include <utility>
 #include <string>
 #include "lib\threadpool\thread_pool.h"
+#include "WorkerPool.h"
 #include "lib\exstring\exstring.h"
 #include <stdexcept>
 #include <regex>
@@ -31,20 +32,72 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 #include <fstream>
 #include <filesystem>
 #include <string_view>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <exception>
 #include "support.h"
 namespace ScoreProcessor {
-	template<typename T=unsigned char>
-	/*
-		Represents processes done to an image.
-	*/
-	class ImageProcess {
-	public:
-		typedef cimg_library::CImg<T> Img;
-		virtual ~ImageProcess()
-		{};
-		//returns true if the image has been modified
-		virtual bool process(Img&) const=0;
-	};
+	namespace detail {
+		/*
+			A queue shared between threads that blocks pushes while full and pops while empty.
+			Pops fail once every producer is done and the queue is drained.
+		*/
+		template<typename T>
+		class bounded_queue {
+		private:
+			std::mutex _mtx;
+			std::condition_variable _not_full;
+			std::condition_variable _not_empty;
+			std::deque<T> _items;
+			size_t const _capacity;
+			size_t _producers;
+		public:
+			bounded_queue(size_t capacity,size_t num_producers):_capacity(capacity?capacity:1),_producers(num_producers)
+			{}
+			void push(T item)
+			{
+				std::unique_lock<std::mutex> lock(_mtx);
+				_not_full.wait(lock,[this]()
+				{
+					return _items.size()<_capacity;
+				});
+				_items.push_back(std::move(item));
+				lock.unlock();
+				_not_empty.notify_one();
+			}
+			//returns false if there are no more items to come
+			bool pop(T& item)
+			{
+				std::unique_lock<std::mutex> lock(_mtx);
+				_not_empty.wait(lock,[this]()
+				{
+					return !_items.empty()||_producers==0;
+				});
+				if(_items.empty())
+				{
+					return false;
+				}
+				item=std::move(_items.front());
+				_items.pop_front();
+				lock.unlock();
+				_not_full.notify_one();
+				return true;
+			}
+			//signals that a producer will not push any more items
+			void producer_done()
+			{
+				{
+					std::lock_guard<std::mutex> lock(_mtx);
+					--_producers;
+				}
+				_not_empty.notify_all();
+			}
+		};
+	}
+
 	/*
 		Logs to some output.
 	*/
@@ -63,6 +116,27 @@ namespace ScoreProcessor {
 		}
 	};
 
+	template<typename T=unsigned char>
+	/*
+		Represents processes done to an image.
+	*/
+	class ImageProcess {
+	public:
+		typedef cimg_library::CImg<T> Img;
+		virtual ~ImageProcess()
+		{};
+		//returns true if the image has been modified
+		virtual bool process(Img&) const=0;
+		/*
+			As process, for processes with something to say about the image, which goes to log under id.
+			log is null when nothing should be said.
+		*/
+		virtual bool process_logged(Img& img,Log* log,size_t id) const
+		{
+			return process(img);
+		}
+	};
+
 	/*
 		Template for creating an output name based on an input name.
 	*/
@@ -190,9 +264,72 @@ namespace ScoreProcessor {
 				pparent->process(fname,output,index,move,quality);
 			}
 		};
+		/*
+			One file's trip through the list, split into its decode, process, and encode steps
+			so that each step can be run by a different thread.
+		*/
+		class file_job {
+		private:
+			enum action {
+				copy_file, //output is a copy or move of the input
+				convert_file, //image is decoded and saved as another type
+				save_file //image is processed and saved if edited
+			};
+			std::filesystem::path in,out;
+			std::string output;
+			char const* fname;
+		public:
+			unsigned int index;
+		private:
+			bool do_move;
+			int quality;
+			action act;
+			std::pair<support_type,support_type> s;
+			cimg_library::CImg<T> img;
+			void load();
+		public:
+			file_job(char const* fname,std::string output,unsigned int index,bool do_move,int quality);
+			char const* input_name() const
+			{
+				return fname;
+			}
+			//checks the input, makes the output folders, and decodes the image if it needs decoding
+			void read(bool has_processes,bool recurse);
+			//runs the processes on the decoded image
+			void run(ProcessList<T> const& list);
+			//saves the image, or copies or moves the file if the image was not needed
+			void write();
+		};
 		Log* plog;
 		verbosity vb;
 	public:
+		/*
+			Thread counts and queue depth of the pipelined batch mode.
+		*/
+		struct pipeline_options {
+			unsigned int num_readers; //threads decoding images
+			unsigned int num_workers; //threads running the processes
+			unsigned int num_writers; //threads encoding and saving images
+			unsigned int queue_depth; //max images waiting between two stages, 0 for twice the workers
+		};
+		/*
+			Throughput of a single stage of the pipeline.
+		*/
+		struct stage_stats {
+			size_t count; //images that passed through the stage
+			double busy_seconds; //time spent working, summed across the stage's threads
+			double wait_seconds; //time spent blocked on the queues, summed across the stage's threads
+			unsigned int num_threads;
+		};
+		/*
+			Report of a pipelined batch.
+		*/
+		struct pipeline_stats {
+			stage_stats read,work,write;
+			double wall_seconds;
+			size_t peak_in_flight; //most decoded images alive at once
+			size_t max_in_flight; //the bound given by the queue depth and thread counts
+		};
 		ProcessList(Log* log,verbosity vb):plog(log),vb(vb)
 		{}
 		ProcessList(Log* log):ProcessList(log,1)
@@ -229,6 +366,11 @@ namespace ScoreProcessor {
 			emplace_back(std::make_unique<U>(std::forward<Args>(args)...));
 		}
 
+		/*
+			Runs the processes on an image in memory, giving them the log under index as processing a file does.
+			Returns true if any of them modified the image. Exceptions are not caught.
+		*/
+		bool process_logged(cimg_library::CImg<T>& img,size_t index) const;
 		void process_unsafe(cimg_library::CImg<T>& img,char const* output) const;
 		void process_unsafe(char const* input,char const* output,bool move,int quality,bool recurse) const;
 		/*
@@ -291,6 +433,20 @@ namespace ScoreProcessor {
 			unsigned int const num_threads,
 			unsigned int const starting_index,
 			bool move,int quality,bool recurse) const;
+
+		/*
+			Processes all the images in the vector as a pipeline:
+			readers decode images ahead, workers run the processes, and writers encode and save.
+			The stages are joined by bounded queues, so at most max_in_flight images are decoded at once.
+		*/
+		template<typename String>
+		pipeline_stats process_pipelined(std::vector<String> const& filenames,
+			SaveRules const* psr,
+			pipeline_options const& options,
+			unsigned int const starting_index,
+			bool move,
+			int quality,
+			bool recurse) const;
 	};
 	typedef ProcessList<unsigned char> IPList;
 
@@ -301,12 +457,21 @@ namespace ScoreProcessor {
 	}
 
 	template<typename T>
-	void ProcessList<T>::process_unsafe(cimg_library::CImg<T>& img,char const* output) const
+	bool ProcessList<T>::process_logged(cimg_library::CImg<T>& img,size_t index) const
 	{
+		Log* const out=vb>=loud?plog:nullptr;
+		bool edited=false;
 		for(auto& pprocess:*this)
 		{
-			pprocess->process(img);
+			edited|=pprocess->process_logged(img,out,index);
 		}
+		return edited;
+	}
+
+	template<typename T>
+	void ProcessList<T>::process_unsafe(cimg_library::CImg<T>& img,char const* output) const
+	{
+		process_logged(img,0);
 		if(output!=nullptr)
 		{
 			img.save(output);
@@ -359,10 +524,14 @@ namespace ScoreProcessor {
 	}
 
 	template<typename T>
-	void ProcessList<T>::process_unsafe(char const* fname,char const* output,bool do_move,int quality,bool recurse) const
+	ProcessList<T>::file_job::file_job(char const* fname,std::string output,unsigned int index,bool do_move,int quality):
+		in(fname),out(output),output(std::move(output)),fname(fname),index(index),do_move(do_move),quality(quality),act(copy_file)
+	{}
+
+	template<typename T>
+	void ProcessList<T>::file_job::read(bool has_processes,bool recurse)
 	{
 		using namespace std::filesystem;
-		path in(fname),out(output);
 		if(!exists(in))
 		{
 			throw std::runtime_error(std::string("Failed to open ").append(fname,in.native().size()));
@@ -371,194 +540,185 @@ namespace ScoreProcessor {
 		auto in_ext=exlib::find_extension(instr.cbegin(),instr.cend());
 		auto const& outstr=out.native();
 		auto out_ext=exlib::find_extension(outstr.cbegin(),outstr.cend());
-		auto support=[in_ext,out_ext,in_end=instr.end(),out_end=outstr.end()]()
+		auto support=[in_ext,out_ext]()
 		{
-			auto make_ext_string=[](auto begin,auto end)
-			{
-				size_t shorts=std::distance(begin,end);
-				std::string ext;ext.resize(shorts);
-				auto eit=ext.begin();
-				for(auto it=begin;it!=end;++eit,++it)
-				{
-					*eit=*it;
-				}
-				return ext;
-			};
 			auto sout=validate_extension(&*out_ext);
 			auto sin=validate_extension(&*in_ext);
 			return std::make_pair(sin,sout);
 		};
-		auto copy_or_move=[do_move,&in,&out,fname,output,recurse]()
+		if(recurse)
 		{
-			if(std::filesystem::exists(out)&&std::filesystem::equivalent(in,out))
-			{
-				return;
-			}
-			if(do_move)
+			auto const ppath=out.parent_path();
+			if(!ppath.empty())
 			{
 				try
 				{
-					rename(in,out);
+					std::filesystem::create_directories(ppath);
 				}
 				catch(std::exception const& err)
 				{
-					throw std::runtime_error(std::string("Failed to move to ").append(output).append(": ").append(err.what()));
+					throw std::runtime_error(std::string("Failed to create paths for ").append(output).append(": ").append(err.what()));
 				}
 			}
-			else
+		}
+		if(!has_processes)
+		{
+			if(!exlib::strncmp_nocase(in_ext,out_ext))
 			{
-				try
-				{
-					copy(in,out,std::filesystem::copy_options::overwrite_existing);
-				}
-				catch (std::exception const& err)
-				{
-					throw std::runtime_error(std::string("Failed to copy to ").append(output).append(": ").append(err.what()));
-				}
+				act=copy_file;
+				return;
 			}
-		};
-		auto load_s=[fname](cil::CImg<T>&img,auto s)
+			s=support();
+			if(s.first==s.second)
+			{
+				act=copy_file;
+				return;
+			}
+			act=convert_file;
+		}
+		else
 		{
+			s=support();
+			act=save_file;
+		}
+		load();
+	}
+
+	template<typename T>
+	void ProcessList<T>::file_job::load()
+	{
 #if OPTION_RESTRICTED
+		try
+		{
+#endif
+			switch(s.first)
+			{
+			case support_type::bmp:
+				img.load_bmp(fname);
+				break;
+			case support_type::jpeg:
+				img.load_jpeg(fname);
+				break;
+			case support_type::png:
+				img.load_png(fname);
+				break;
+			case support_type::tiff:
+				img.load_tiff(fname,0,0);
+			}
+#if OPTION_RESTRICTED
+		}
+		catch(std::exception const& first_try)
+		{
 			try
 			{
-#endif
-				switch (s.first)
+				if(s.first!=support_type::bmp)
 				{
-				case support_type::bmp:
 					img.load_bmp(fname);
-					break;
-				case support_type::jpeg:
-					img.load_jpeg(fname);
-					break;
-				case support_type::png:
-					img.load_png(fname);
-					break;
-				case support_type::tiff:
-					img.load_tiff(fname, 0, 0);
 				}
-#if OPTION_RESTRICTED
+				return;
 			}
-			catch (std::exception const& first_try)
+			catch(...) {}
+			try
 			{
-				try
-				{
-					if (s.first != support_type::bmp)
-					{
-						img.load_bmp(fname);
-					}
-					return;
-				}
-				catch(...) { }
-				try
-				{
-					if (s.first != support_type::jpeg)
-					{
-						img.load_jpeg(fname);
-					}
-					return;
-				}
-				catch (...) { }
-				try
+				if(s.first!=support_type::jpeg)
 				{
-					if (s.first != support_type::png)
-					{
-						img.load_png(fname);
-					}
-					return;
+					img.load_jpeg(fname);
 				}
-				catch (...) { }
-				try
+				return;
+			}
+			catch(...) {}
+			try
+			{
+				if(s.first!=support_type::png)
 				{
-					if (s.first != support_type::tiff)
-					{
-						img.load_tiff(fname);
-					}
-					return;
+					img.load_png(fname);
 				}
-				catch (...)
+				return;
+			}
+			catch(...) {}
+			try
+			{
+				if(s.first!=support_type::tiff)
 				{
-					throw first_try;
+					img.load_tiff(fname);
 				}
+				return;
+			}
+			catch(...)
+			{
+				throw first_try;
 			}
+		}
 #endif
-		};
-		auto save_s=[output,quality](cil::CImg<T>&img,auto s)
+	}
+
+	template<typename T>
+	void ProcessList<T>::file_job::run(ProcessList<T> const& list)
+	{
+		if(act!=save_file)
 		{
-			cil::save_image(img,output,s.second,quality);
-		};
-		if (recurse)
+			return;
+		}
+		bool const edited=list.process_logged(img,index)||s.first!=s.second;
+		if(!edited)
+		{
+			act=copy_file;
+			img.assign(); //no need to hold onto the pixels while waiting for the copy
+		}
+	}
+
+	template<typename T>
+	void ProcessList<T>::file_job::write()
+	{
+		if(act==copy_file)
 		{
-			auto const ppath = out.parent_path();
-			if (!ppath.empty())
+			if(std::filesystem::exists(out)&&std::filesystem::equivalent(in,out))
+			{
+				return;
+			}
+			if(do_move)
 			{
 				try
 				{
-
-					std::filesystem::create_directories(out.parent_path());
+					std::filesystem::rename(in,out);
 				}
-				catch (std::exception const& err)
+				catch(std::exception const& err)
 				{
-					throw std::runtime_error(std::string("Failed to create paths for ").append(output).append(": ").append(err.what()));
+					throw std::runtime_error(std::string("Failed to move to ").append(output).append(": ").append(err.what()));
 				}
 			}
-		}
-		if(this->empty())
-		{
-			if(!exlib::strncmp_nocase(in_ext,out_ext))
-			{
-				copy_or_move();
-			}
 			else
 			{
-				auto s=support();
-				if(s.first==s.second)
+				try
 				{
-					copy_or_move();
+					std::filesystem::copy(in,out,std::filesystem::copy_options::overwrite_existing);
 				}
-				else
+				catch(std::exception const& err)
 				{
-					cil::CImg<T> img;
-					load_s(img,s);
-					save_s(img,s);
-					if(do_move&&!std::filesystem::equivalent(in,out))
-					{
-						remove(in);
-					}
+					throw std::runtime_error(std::string("Failed to copy to ").append(output).append(": ").append(err.what()));
 				}
 			}
 		}
 		else
 		{
-			auto s=support();
-			bool edited=false;
+			cil::save_image(img,output.c_str(),s.second,quality);
+			img.assign();
+			if(do_move&&!std::filesystem::equivalent(in,out))
 			{
-				cil::CImg<T> img;
-				load_s(img,s);
-				for(auto it=this->begin();it<this->end();++it)
-				{
-					edited|=(*it)->process(img);
-				}
-				if(s.first!=s.second)
-				{
-					edited=true;
-				}
-				if(edited)
-				{
-					save_s(img,s);
-					if(do_move&&!std::filesystem::equivalent(in,out))
-					{
-						remove(in);
-					}
-				}
-			}
-			if(!edited)
-			{
-				copy_or_move();
+				std::filesystem::remove(in);
 			}
 		}
 	}
 
+	template<typename T>
+	void ProcessList<T>::process_unsafe(char const* fname,char const* output,bool do_move,int quality,bool recurse) const
+	{
+		file_job job(fname,output,0,do_move,quality);
+		job.read(!this->empty(),recurse);
+		job.run(*this);
+		job.write();
+	}
+
 	template<typename T>
 	void ProcessList<T>::process(char const* fname,char const* output,bool move,int quality,bool recurse) const
 	{
@@ -641,12 +801,10 @@ namespace ScoreProcessor {
 		int quality,
 		bool recurse) const
 	{
-		exlib::thread_pool tp(num_threads);
-		for(size_t i=0;i<imgs.size();++i)
+		parallel_for(imgs.size(),[&imgs,psr,starting_index,move,quality,recurse,this](size_t i)
 		{
-			tp.add_task<typename ProcessList<T>::ProcessTaskFName>(imgs[i],this,psr,i+starting_index,move,quality,recurse);
-		}
-		tp.start();
+			process(imgs[i],psr,i+starting_index,move,quality,recurse);
+		},std::max(1U,num_threads));
 	}
 
 	template<typename T>
@@ -660,25 +818,229 @@ namespace ScoreProcessor {
 		int quality,
 		bool recurse) const
 	{
-		if(num_threads<2) //avoid threadpool overhead
+		//num_threads bounds the images in flight; the processes inside each image share the same global pool
+		parallel_for(imgs.size(),[&imgs,psr,starting_index,move,quality,recurse,this](size_t i)
 		{
-			for(size_t i=0;i<imgs.size();++i)
+			process(imgs[i].data(),psr,i+starting_index,move,quality,recurse);
+		},std::max(1U,num_threads));
+	}
+
+	template<typename T>
+	template<typename String>
+	typename ProcessList<T>::pipeline_stats ProcessList<T>::process_pipelined(
+		std::vector<String> const& imgs,
+		SaveRules const* psr,
+		pipeline_options const& options,
+		unsigned int const starting_index,
+		bool move,
+		int quality,
+		bool recurse) const
+	{
+		using clock=std::chrono::steady_clock;
+		using job_ptr=std::unique_ptr<file_job>;
+		auto const num_readers=std::max(options.num_readers,1U);
+		auto const num_workers=std::max(options.num_workers,1U);
+		auto const num_writers=std::max(options.num_writers,1U);
+		auto const depth=options.queue_depth?options.queue_depth:2*num_workers;
+
+		pipeline_stats stats{};
+		stats.read.num_threads=num_readers;
+		stats.work.num_threads=num_workers;
+		stats.write.num_threads=num_writers;
+		//every thread holds at most one image and each queue holds at most depth images
+		stats.max_in_flight=size_t{num_readers}+num_workers+num_writers+2*size_t{depth};
+
+		detail::bounded_queue<job_ptr> decoded(depth,num_readers);
+		detail::bounded_queue<job_ptr> processed(depth,num_workers);
+		std::atomic<size_t> next_file(0);
+		std::atomic<size_t> in_flight(0);
+		std::atomic<size_t> peak_in_flight(0);
+		std::mutex stats_mtx;
+		std::exception_ptr first_error;
+		bool const out_loud=plog&&vb>=loud;
+		auto seconds_since=[](clock::time_point start)
+		{
+			return std::chrono::duration<double>(clock::now()-start).count();
+		};
+		auto merge=[&stats_mtx](stage_stats& total,stage_stats const& part)
+		{
+			std::lock_guard<std::mutex> lock(stats_mtx);
+			total.count+=part.count;
+			total.busy_seconds+=part.busy_seconds;
+			total.wait_seconds+=part.wait_seconds;
+		};
+		auto retire=[&in_flight](job_ptr& job)
+		{
+			job.reset();
+			--in_flight;
+		};
+		//logs the error, or saves it to be rethrown if there is no log
+		auto report=[&,this](char const* name,unsigned int index,std::exception const& ex)
+		{
+			if(plog)
 			{
-				process(imgs[i].data(),psr,i+starting_index,move,quality,recurse);
+				if(vb)
+				{
+					std::string log("Error processing ");
+					log.append(name);
+					log.append(": ",2);
+					log.append(ex.what());
+					log.push_back('\n');
+					plog->log_error(log,index);
+				}
 			}
-		}
-		else
+			else
+			{
+				std::lock_guard<std::mutex> lock(stats_mtx);
+				if(!first_error)
+				{
+					first_error=std::current_exception();
+				}
+			}
+		};
+		auto fail=[&](job_ptr& job,std::exception const& ex)
+		{
+			report(job->input_name(),job->index,ex);
+			retire(job);
+		};
+
+		auto const start=clock::now();
 		{
-			exlib::thread_pool tp(num_threads);
-			for(size_t i=0;i<imgs.size();++i)
+			exlib::thread_pool tp(num_readers+num_workers+num_writers);
+			for(unsigned int i=0;i<num_readers;++i)
 			{
-				tp.push_back([name=imgs[i].data(),psr,index=i+starting_index,move,quality,recurse,this]() noexcept
+				tp.push_back([&,this]() noexcept
 				{
-					process(name,psr,index,move,quality,recurse);
+					stage_stats local{};
+					while(true)
+					{
+						size_t const file=next_file++;
+						if(file>=imgs.size())
+						{
+							break;
+						}
+						auto const begin=clock::now();
+						char const* const name=imgs[file].data();
+						auto const index=static_cast<unsigned int>(file+starting_index);
+						if(out_loud)
+						{
+							std::string log("Starting ");
+							log.append(name);
+							log.push_back('\n');
+							plog->log(log,index);
+						}
+						auto const now=++in_flight;
+						auto peak=peak_in_flight.load();
+						while(now>peak&&!peak_in_flight.compare_exchange_weak(peak,now));
+						job_ptr job;
+						try
+						{
+							job=std::make_unique<file_job>(name,psr?psr->make_filename(std::string_view(name),index):std::string(name),index,move,quality);
+							job->read(!this->empty(),recurse);
+						}
+						catch(std::exception const& ex)
+						{
+							if(job)
+							{
+								fail(job,ex);
+							}
+							else
+							{
+								report(name,index,ex);
+								--in_flight;
+							}
+							continue;
+						}
+						local.busy_seconds+=seconds_since(begin);
+						++local.count;
+						auto const wait_begin=clock::now();
+						decoded.push(std::move(job));
+						local.wait_seconds+=seconds_since(wait_begin);
+					}
+					decoded.producer_done();
+					merge(stats.read,local);
 				});
 			}
-			tp.start();
+			for(unsigned int i=0;i<num_workers;++i)
+			{
+				tp.push_back([&,this]() noexcept
+				{
+					stage_stats local{};
+					job_ptr job;
+					while(true)
+					{
+						auto const wait_begin=clock::now();
+						if(!decoded.pop(job))
+						{
+							break;
+						}
+						auto const begin=clock::now();
+						local.wait_seconds+=std::chrono::duration<double>(begin-wait_begin).count();
+						try
+						{
+							job->run(*this);
+						}
+						catch(std::exception const& ex)
+						{
+							fail(job,ex);
+							continue;
+						}
+						local.busy_seconds+=seconds_since(begin);
+						++local.count;
+						auto const push_begin=clock::now();
+						processed.push(std::move(job));
+						local.wait_seconds+=seconds_since(push_begin);
+					}
+					processed.producer_done();
+					merge(stats.work,local);
+				});
+			}
+			for(unsigned int i=0;i<num_writers;++i)
+			{
+				tp.push_back([&,this]() noexcept
+				{
+					stage_stats local{};
+					job_ptr job;
+					while(true)
+					{
+						auto const wait_begin=clock::now();
+						if(!processed.pop(job))
+						{
+							break;
+						}
+						auto const begin=clock::now();
+						local.wait_seconds+=std::chrono::duration<double>(begin-wait_begin).count();
+						try
+						{
+							job->write();
+						}
+						catch(std::exception const& ex)
+						{
+							fail(job,ex);
+							continue;
+						}
+						local.busy_seconds+=seconds_since(begin);
+						++local.count;
+						if(out_loud)
+						{
+							std::string log("Finished ");
+							log.append(job->input_name());
+							log.push_back('\n');
+							plog->log(log,job->index);
+						}
+						retire(job);
+					}
+					merge(stats.write,local);
+				});
+			}
+		}
+		stats.wall_seconds=seconds_since(start);
+		stats.peak_in_flight=peak_in_flight;
+		if(first_error)
+		{
+			std::rethrow_exception(first_error);
 		}
+		return stats;
 	}
 
 
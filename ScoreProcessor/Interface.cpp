@@ -39,9 +39,14 @@ namespace ScoreProcessor {
 				"pixel prec: pixels this close are considered the same; tags: p, pp\n"
 				"boundary, vertical transition across this is considered an edge; tags: b\n"
 				"gamma: gamma correction applied; tags: g, gam\n"
-				"use horiz: whether to use horizontal or vertical lines to determine angle",
+				"use horiz: whether to use horizontal or vertical lines to determine angle\n"
+				"coarse prec: if greater than angle prec, angles are first searched at this precision,\n"
+				"  then only around the best coarse angle at angle prec; 0 disables; tags: c, cp\n"
+				"downscale: if greater than 1, the angle is first estimated on a copy shrunk by this factor,\n"
+				"  then refined within one coarse step at full size; overrides coarse prec; tags: d, ds\n"
+				"report: print pixels evaluated and time saved against a direct search, which is also run; tags: r, rep",
 				"Straighten",
-				"min_angle=-5 max_angle=5 angle_prec=0.1 pixel_prec=1 boundary=128 gamma=2 use_horiz=t");
+				"min_angle=-5 max_angle=5 angle_prec=0.1 pixel_prec=1 boundary=128 gamma=2 use_horiz=t coarse_prec=0 downscale=1 report=f");
 	}
 
 	namespace CGMaker {
@@ -252,6 +257,10 @@ namespace ScoreProcessor {
 			"pad_wgt: weight applied to padding deviation, see below; tags: pw\n"
 			"bg: background threshold to determine kerning; tags: bg\n"
 			"divider: divider between pages; tags: div\n"
+			"cache_mb: megabytes of decoded pages kept ahead of the pages in use; tags: cm, cache\n"
+			"lookahead: if not 0, pages are spliced and saved as they are read, holding about twice this many pages at once;\n"
+			"  a page break is committed once the pages after it cannot change it, or is forced after twice this many pages;\n"
+			"  no output page holds more than this many pages; 64 usually gives the same breaks as 0; not used with a divider; tags: la, look\n"
 			"pw or ph at end of tags indicates value is taken as proportion of width or height, respectively\n"
 			"if untagged, % indicates percentage of width taken, otherwise fixed amount\n"
 			"Cost function is\n"
@@ -261,9 +270,11 @@ namespace ScoreProcessor {
 			"else\n"
 			"  ((opt_height-height)/opt_height)^3+\n"
 			"  (pad_weight*abs_dif(padding,opt_padding)/opt_padding)^3\n"
-			"Dimensions are taken from the first page.",
+			"Dimensions are taken from the first page.\n"
+			"Single image commands given with it are applied to each page before splicing;\n"
+			"given with Cut, the cut pieces are spliced, without writing them out.",
 			"Splice",
-			"horiz_pad=3% opt_pad=5% min_pad=1.2% opt_hgt=55% excs_wgt=10 pad_wgt=1 bg=128 divider=\"\"");
+			"horiz_pad=3% opt_pad=5% min_pad=1.2% opt_hgt=55% excs_wgt=10 pad_wgt=1 bg=128 divider=\"\" cache_mb=512 lookahead=0");
 	}
 
 	namespace CutMaker {
@@ -283,7 +294,8 @@ namespace ScoreProcessor {
 				"  tags: hw\n"
 				"bg: colors less than or equal this brightness can be considered part of a system; tags: bg\n"
 				"pw or ph at end of tags indicates value is taken as proportion of width or height,respectively\n"
-				"if untagged, % indicates percentage of width taken, otherwise fixed amount",
+				"if untagged, % indicates percentage of width taken, otherwise fixed amount\n"
+				"Single image commands given with it are applied to each piece before it is saved.",
 				"Cut",
 				"min_width=66% min_height=8% horiz_weight=20 min_vert_space=0 bg=128");
 	}
@@ -309,6 +321,18 @@ namespace ScoreProcessor {
 		decltype(maker) maker("Set the quality of the save file [0,100], only affects jpegs", "Quality", "quality");
 	}
 
+	namespace PipelineMaker {
+		decltype(maker) maker("Runs single page operations as a pipeline: readers decode images ahead,\n"
+			"the processing threads (see -nt) run the operations, and writers encode and save images\n"
+			"At most queue depth images wait between two stages, which bounds memory use\n"
+			"A throughput report for each stage is printed at the end\n"
+			"readers: number of threads decoding images; tags: r, rd, read\n"
+			"writers: number of threads encoding and saving images; tags: w, wr, write\n"
+			"queue depth: max images waiting between stages, 0 for twice the processing threads; tags: d, qd, depth",
+			"Pipeline",
+			"readers=1 writers=1 queue_depth=0");
+	}
+
 	namespace RescaleAbsoluteMaker {
 		decltype(maker) maker{
 			"Rescale to an absolute width and height\n"
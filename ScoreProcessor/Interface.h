@@ -46,6 +46,7 @@ namespace ScoreProcessor {
 				do_splice //program splices images together
 			};
 			do_state flag;
+			bool cut_first; //whether splicing works on the cut pieces of the images instead of the images
 			enum log_type {
 				unassigned_log,
 				quiet, //no output
@@ -56,6 +57,8 @@ namespace ScoreProcessor {
 			log_type lt;
 			Splice::standard_heuristics splice_args; //args for splicing
 			cil::CImg<unsigned char> splice_divider;
+			unsigned int splice_cache_mb; //megabytes of pages splice may decode ahead
+			unsigned int splice_lookahead; //pages splice looks ahead before committing a break, 0 to break all pages at once
 			struct {
 				pv min_height,min_width,min_vert_space;
 				unsigned char background;
@@ -71,28 +74,39 @@ namespace ScoreProcessor {
 				std::string_view end;
 			};
 			std::vector<sel_boundary> selections;
-			unsigned int num_threads; //num threads to use
+			unsigned int num_threads; //num images to work on at once
 			//some processes (like SmartScale) may need multithreading in one image 
 			//and thus override the across image thread count
 			unsigned int overridden_num_threads;
+			unsigned int core_budget; //threads in the global pool that every stage shares
 			bool list_files; //whether files should be listed out to the user
 			bool check_overwrite;
 			bool make_folders;
 			int quality; //[0,100] jpeg file quality
+			bool pipelined; //whether single processes are run as a decode, process, encode pipeline
+			struct {
+				unsigned int readers,writers,queue_depth;
+			} pipeline_args; //args for the pipeline, the process stage uses num_threads
 			PMINLINE delivery():
 				starting_index(-1), //invalid values means not given by user
 				flag(do_absolutely_nothing),
+				cut_first(false),
 				num_threads(0),
 				overridden_num_threads(0),
+				core_budget(0),
 				do_move(false),
 				list_files(false),
 				check_overwrite(false),
 				make_folders(true),
 				lt(unassigned_log),
-				quality(-1)
+				quality(-1),
+				pipelined(false),
+				splice_cache_mb(512),
+				splice_lookahead(0)
 			{}
 			//assigns the default value of num threads if not assigned
 			//num_threads is limited by num_files if the thread_count has not been overridden by a process
+			//core_budget keeps the full thread count either way
 			void fix_values(size_t num_files)
 			{
 				if(num_threads==0)
@@ -103,6 +117,7 @@ namespace ScoreProcessor {
 						num_threads=2;
 					}
 				}
+				core_budget=num_threads;
 				if(starting_index==-1)
 				{
 					starting_index=1;
@@ -895,11 +910,11 @@ namespace ScoreProcessor {
 	struct SingleCheck {
 		PMINLINE static void check(CommandMaker::delivery& del)
 		{
-			if(del.flag>del.do_single)
+			//with a cut or splice, the processes are applied to each piece or page before it is saved or spliced
+			if(del.flag<del.do_single)
 			{
-				throw std::invalid_argument("Single operations cannot be performed at the same time as multi operations");
+				del.flag=del.do_single;
 			}
-			del.flag=del.do_single;
 		}
 	};
 
@@ -908,9 +923,17 @@ namespace ScoreProcessor {
 		static_assert(state>CommandMaker::delivery::do_state::do_single,"Invalid multistate");
 		static PMINLINE void check(CommandMaker::delivery& del)
 		{
-			if(del.flag>decltype(del.flag)::do_nothing)
+			using ds=CommandMaker::delivery::do_state;
+			if(del.flag==state||del.cut_first)
+			{
+				throw std::invalid_argument("Multi operations cannot be given more than once");
+			}
+			if(del.flag==ds::do_splice||del.flag==ds::do_cut)
 			{
-				throw std::invalid_argument("Multi operations cannot be performed the same time as other operations");
+				//cutting and splicing together splices the cut pieces
+				del.cut_first=true;
+				del.flag=ds::do_splice;
+				return;
 			}
 			del.flag=state;
 		}
@@ -1146,8 +1169,31 @@ namespace ScoreProcessor {
 			}
 		};
 
+		struct CoarsePrec {
+			cnnm("coarse precision");
+			clbl("c","cp");
+			cndf(double(0))
+		};
+
+		struct Downscale {
+			cnnm("downscale");
+			clbl("d","ds");
+			cndf(1U)
+		};
+
+		struct Report {
+			static PMINLINE constexpr bool parse(InputType s)
+			{
+				auto const c=s[0];
+				return c=='t'||c=='1'||c=='T'||c=='\0';
+			}
+			cnnm("report");
+			clbl("r","rep");
+			cndf(false)
+		};
+
 		struct UseTuple {
-			PMINLINE static void use_tuple(CommandMaker::delivery& del,double mn,double mx,double a,double p,unsigned char b,float g,bool use_horiz)
+			PMINLINE static void use_tuple(CommandMaker::delivery& del,double mn,double mx,double a,double p,unsigned char b,float g,bool use_horiz,double c,unsigned int d,bool r)
 			{
 				if(mn>=mx)
 				{
@@ -1157,7 +1203,7 @@ namespace ScoreProcessor {
 				{
 					throw std::invalid_argument("Difference between angles must be less than or equal to 180");
 				}
-				del.pl.add_process<Straighten>(p,mn,mx,a,b,g,use_horiz);
+				del.pl.add_process<Straighten>(p,mn,mx,a,b,g,use_horiz,c,d,r);
 			}
 		};
 
@@ -1167,7 +1213,7 @@ namespace ScoreProcessor {
 			SingMaker<UseTuple,
 			DoubleParser<MinAngle,no_check>,DoubleParser<MaxAngle,no_check>,
 			DoubleParser<AnglePrec>,DoubleParser<PixelPrec>,
-			IntegerParser<unsigned char,Boundary>,GammaParser,UseHoriz>
+			IntegerParser<unsigned char,Boundary>,GammaParser,UseHoriz,DoubleParser<CoarsePrec>,UIntParser<Downscale,force_positive>,Report>
 			maker;
 	}
 
@@ -2581,8 +2627,18 @@ namespace ScoreProcessor {
 				return Output::PatternParser::parse(in);
 			}
 		};
+		struct Cache {
+			cnnm("cache_mb");
+			clbl("cm","cache");
+			cndf(512U)
+		};
+		struct Lookahead {
+			cnnm("lookahead");
+			clbl("la","look");
+			cndf(0U)
+		};
 		struct UseTuple {
-			static PMINLINE void use_tuple(CommandMaker::delivery& del,pv hp,pv op,pv mp,pv oh,float exc,float pw,unsigned char bg,char const* divider)
+			static PMINLINE void use_tuple(CommandMaker::delivery& del,pv hp,pv op,pv mp,pv oh,float exc,float pw,unsigned char bg,char const* divider,unsigned int cache_mb,unsigned int lookahead)
 			{
 				del.splice_args.horiz_padding=hp;
 				del.splice_args.optimal_padding=op;
@@ -2595,6 +2651,8 @@ namespace ScoreProcessor {
 				{
 					del.splice_divider.load(divider);
 				}
+				del.splice_cache_mb=cache_mb;
+				del.splice_lookahead=lookahead;
 			}
 		};
 		extern
@@ -2602,7 +2660,7 @@ namespace ScoreProcessor {
 			UseTuple,
 			MultiCommand<CommandMaker::delivery::do_state::do_splice>,
 			pv_parser<HP>,pv_parser<OP>,pv_parser<MP>,pv_parser<OH>,
-			FloatParser<EXC>,FloatParser<PW>,FloatParser<BG>,Divider> maker;
+			FloatParser<EXC>,FloatParser<PW>,FloatParser<BG>,Divider,UIntParser<Cache,force_positive>,UIntParser<Lookahead>> maker;
 	}
 
 	namespace CutMaker {
@@ -2809,6 +2867,43 @@ namespace ScoreProcessor {
 		extern MakerTFull<UseTuple,Precheck,IntParser<Value>> maker;
 	}
 
+	namespace PipelineMaker {
+		struct Readers {
+			cnnm("readers");
+			clbl("r","rd","read");
+			cndf(1U)
+		};
+		struct Writers {
+			cnnm("writers");
+			clbl("w","wr","write");
+			cndf(1U)
+		};
+		struct Depth {
+			cnnm("queue depth");
+			clbl("d","qd","depth");
+			cndf(0U)
+		};
+		struct Precheck {
+			static PMINLINE void check(CommandMaker::delivery& del)
+			{
+				if(del.pipelined)
+				{
+					throw std::invalid_argument("Pipeline already set");
+				}
+			}
+		};
+		struct UseTuple {
+			static PMINLINE void use_tuple(CommandMaker::delivery& del,unsigned int readers,unsigned int writers,unsigned int depth)
+			{
+				del.pipelined=true;
+				del.pipeline_args.readers=readers;
+				del.pipeline_args.writers=writers;
+				del.pipeline_args.queue_depth=depth;
+			}
+		};
+		extern MakerTFull<UseTuple,Precheck,UIntParser<Readers,force_positive>,UIntParser<Writers,force_positive>,UIntParser<Depth>> maker;
+	}
+
 	namespace RescaleAbsoluteMaker {
 		using uint=unsigned int;
 		inline constexpr uint interpolate=-1;
@@ -3551,7 +3646,8 @@ namespace ScoreProcessor {
 			compair("si",&SIMaker::maker),
 			compair("flt",&RgxFilter::maker),
 			compair("list",&List::maker),
-			compair("q",&Quality::maker) };
+			compair("q",&Quality::maker),
+			compair("pipe",&PipelineMaker::maker) };
 #endif
 
 		constexpr auto aliases = std::array{
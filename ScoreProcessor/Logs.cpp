@@ -11,9 +11,10 @@ namespace Loggers {
 		std::cout.write(msg,len);
 	}
 
-	void AmountLog::log(char const* msg,size_t len,size_t)
+	void AmountLog::log(char const* msg,size_t len,size_t id)
 	{
-		if(msg[0]=='S')
+		std::string_view const sv(msg,len);
+		if(sv.substr(0,9)=="Starting ")
 		{
 			if(!begun)
 			{
@@ -21,6 +22,11 @@ namespace Loggers {
 				std::cout.write(message_template.get(),buffer_length);
 			}
 		}
+		else if(sv.substr(0,9)!="Finished ")
+		{
+			//anything else comes from the processes and is shown above the count
+			log_error(msg,len,id);
+		}
 		else
 		{
 			char buffer[BUFFER_SIZE];
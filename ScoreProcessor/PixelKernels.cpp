@@ -0,0 +1,1650 @@
+/*
+Copyright(C) 2017-2018 Edward Xie
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "stdafx.h"
+#include "PixelKernels.h"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#if defined(_M_X64)||defined(_M_IX86)||defined(__x86_64__)||defined(__i386__)
+#define SP_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SP_TARGET_SSE41
+#define SP_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define SP_TARGET_SSE41 __attribute__((target("sse4.1")))
+#define SP_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace ScoreProcessor {
+	namespace kernels {
+		namespace {
+			typedef unsigned char uchar;
+			typedef std::array<uchar,3> rgb;
+
+			//same expression and evaluation order as ImageUtils::brightness, the vector versions mirror it
+			inline uchar luma(uchar r,uchar g,uchar b)
+			{
+				return static_cast<uchar>(r*0.2126f+g*0.7152f+b*0.0722f);
+			}
+
+			void threshold_scalar(uchar* data,size_t n,uchar middle,uchar low,uchar high)
+			{
+				for(size_t i=0;i<n;++i)
+				{
+					data[i]=data[i]>middle?high:low;
+				}
+			}
+
+			void threshold_rgb_scalar(uchar* r,uchar* g,uchar* b,size_t n,uchar middle,rgb low,rgb high)
+			{
+				for(size_t i=0;i<n;++i)
+				{
+					auto const& c=luma(r[i],g[i],b[i])>middle?high:low;
+					r[i]=c[0];
+					g[i]=c[1];
+					b[i]=c[2];
+				}
+			}
+
+			void apply_lut_scalar(uchar* data,size_t n,uchar const* table)
+			{
+				for(size_t i=0;i<n;++i)
+				{
+					data[i]=table[data[i]];
+				}
+			}
+
+			bool replace_range_scalar(uchar* data,size_t n,uchar lower,uchar upper,uchar replacer)
+			{
+				bool edited=false;
+				for(size_t i=0;i<n;++i)
+				{
+					uchar const v=data[i];
+					if(v>=lower&&v<=upper&&v!=replacer)
+					{
+						data[i]=replacer;
+						edited=true;
+					}
+				}
+				return edited;
+			}
+
+			//(r+g+b)/3.0f>=lower exactly when r+g+b>=3*lower, likewise for upper, so integer sums are used throughout
+			bool replace_by_brightness_scalar(uchar* r,uchar* g,uchar* b,size_t n,uchar lower,uchar upper,rgb replacer)
+			{
+				unsigned int const lo3=3U*lower;
+				unsigned int const hi3=3U*upper;
+				bool edited=false;
+				for(size_t i=0;i<n;++i)
+				{
+					if(r[i]==replacer[0]&&g[i]==replacer[1]&&b[i]==replacer[2])
+					{
+						continue;
+					}
+					unsigned int const sum=unsigned(r[i])+g[i]+b[i];
+					if(sum>=lo3&&sum<=hi3)
+					{
+						r[i]=replacer[0];
+						g[i]=replacer[1];
+						b[i]=replacer[2];
+						edited=true;
+					}
+				}
+				return edited;
+			}
+
+			unsigned int count_below_scalar(uchar const* row,size_t n,unsigned int limit,unsigned short* columns)
+			{
+				unsigned int count=0;
+				for(size_t i=0;i<n;++i)
+				{
+					unsigned int const below=row[i]<limit;
+					columns[i]+=below;
+					count+=below;
+				}
+				return count;
+			}
+
+			unsigned int count_sum_below_scalar(uchar const* r,uchar const* g,uchar const* b,size_t n,unsigned int limit,unsigned short* columns)
+			{
+				unsigned int count=0;
+				for(size_t i=0;i<n;++i)
+				{
+					unsigned int const below=unsigned(r[i])+g[i]+b[i]<limit;
+					columns[i]+=below;
+					count+=below;
+				}
+				return count;
+			}
+
+			unsigned int mark_first_below_scalar(uchar const* row,size_t n,unsigned int limit,uchar* found,unsigned int* first,unsigned int y)
+			{
+				unsigned int count=0;
+				for(size_t i=0;i<n;++i)
+				{
+					if(!found[i]&&row[i]<limit)
+					{
+						found[i]=1;
+						first[i]=y;
+						++count;
+					}
+				}
+				return count;
+			}
+
+			unsigned int mark_first_sum_below_scalar(uchar const* r,uchar const* g,uchar const* b,size_t n,unsigned int limit,uchar* found,unsigned int* first,unsigned int y)
+			{
+				unsigned int count=0;
+				for(size_t i=0;i<n;++i)
+				{
+					if(!found[i]&&unsigned(r[i])+g[i]+b[i]<limit)
+					{
+						found[i]=1;
+						first[i]=y;
+						++count;
+					}
+				}
+				return count;
+			}
+
+			size_t find_below_scalar(uchar const* row,size_t n,unsigned int limit)
+			{
+				for(size_t i=0;i<n;++i)
+				{
+					if(row[i]<limit)
+					{
+						return i;
+					}
+				}
+				return n;
+			}
+
+			size_t find_sum_below_scalar(uchar const* r,uchar const* g,uchar const* b,size_t n,unsigned int limit)
+			{
+				for(size_t i=0;i<n;++i)
+				{
+					if(unsigned(r[i])+g[i]+b[i]<limit)
+					{
+						return i;
+					}
+				}
+				return n;
+			}
+
+			void min_into_scalar(uchar* dst,uchar const* src,size_t n)
+			{
+				for(size_t i=0;i<n;++i)
+				{
+					dst[i]=std::min(dst[i],src[i]);
+				}
+			}
+
+			void darker_into_scalar(uchar* r,uchar* g,uchar* b,uchar const* sr,uchar const* sg,uchar const* sb,size_t n)
+			{
+				for(size_t i=0;i<n;++i)
+				{
+					if(unsigned(sr[i])+sg[i]+sb[i]<unsigned(r[i])+g[i]+b[i])
+					{
+						r[i]=sr[i];
+						g[i]=sg[i];
+						b[i]=sb[i];
+					}
+				}
+			}
+
+			//the middle of the column, where every sample has both neighbours
+			void add_min3_scalar(float* column,float const* prev,size_t begin,size_t end)
+			{
+				for(size_t i=begin;i<end;++i)
+				{
+					column[i]+=std::min(std::min(prev[i-1],prev[i]),prev[i+1]);
+				}
+			}
+
+			void add_correlation_row_scalar(unsigned int* sums,uchar const* row,uchar const* tmplt_row,size_t begin,size_t count,size_t width)
+			{
+				for(size_t x=begin;x<count;++x)
+				{
+					unsigned int sum=0;
+					for(size_t k=0;k<width;++k)
+					{
+						sum+=unsigned int(row[x+k])*tmplt_row[k];
+					}
+					sums[x]+=sum;
+				}
+			}
+
+			size_t count_equal_scalar(uchar const* a,uchar const* b,size_t n)
+			{
+				size_t count=0;
+				for(size_t i=0;i<n;++i)
+				{
+					count+=a[i]==b[i];
+				}
+				return count;
+			}
+
+			size_t sum_abs_diff_scalar(uchar const* a,uchar const* b,size_t n)
+			{
+				size_t sum=0;
+				for(size_t i=0;i<n;++i)
+				{
+					sum+=a[i]>b[i]?a[i]-b[i]:b[i]-a[i];
+				}
+				return sum;
+			}
+
+			//packs the samples from word begin on; the last word is padded with zeros
+			void pack_below_scalar(unsigned long long* bits,uchar const* data,size_t begin,size_t n,uchar threshold)
+			{
+				for(size_t w=begin,words=(n+63)/64;w<words;++w)
+				{
+					unsigned long long word=0;
+					size_t const end=std::min<size_t>(64,n-w*64);
+					uchar const* const samples=data+w*64;
+					for(size_t b=0;b<end;++b)
+					{
+						word|=static_cast<unsigned long long>(samples[b]<threshold)<<b;
+					}
+					bits[w]=word;
+				}
+			}
+
+			inline size_t popcount(unsigned long long w)
+			{
+				w-=(w>>1)&0x5555555555555555ULL;
+				w=(w&0x3333333333333333ULL)+((w>>2)&0x3333333333333333ULL);
+				w=(w+(w>>4))&0x0F0F0F0F0F0F0F0FULL;
+				return size_t((w*0x0101010101010101ULL)>>56);
+			}
+
+			size_t count_bits_scalar(unsigned long long const* words,size_t n)
+			{
+				size_t count=0;
+				for(size_t i=0;i<n;++i)
+				{
+					count+=popcount(words[i]);
+				}
+				return count;
+			}
+
+			void add_count_difference_scalar(unsigned int* counts,unsigned int const* plus,unsigned int const* minus,size_t begin,size_t n)
+			{
+				for(size_t i=begin;i<n;++i)
+				{
+					counts[i]+=plus[i]-minus[i];
+				}
+			}
+
+#ifdef SP_KERNELS_X86
+			SP_TARGET_SSE41 void threshold_sse41(uchar* data,size_t n,uchar middle,uchar low,uchar high)
+			{
+				size_t i=0;
+				__m128i const m1=_mm_set1_epi8(char(middle+1));
+				__m128i const lowv=_mm_set1_epi8(char(low));
+				__m128i const highv=_mm_set1_epi8(char(high));
+				for(;i+16<=n;i+=16)
+				{
+					__m128i const x=_mm_loadu_si128(reinterpret_cast<__m128i const*>(data+i));
+					__m128i const above=_mm_cmpeq_epi8(_mm_max_epu8(x,m1),x);
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(data+i),_mm_blendv_epi8(lowv,highv,above));
+				}
+				threshold_scalar(data+i,n-i,middle,low,high);
+			}
+
+			SP_TARGET_AVX2 void threshold_avx2(uchar* data,size_t n,uchar middle,uchar low,uchar high)
+			{
+				size_t i=0;
+				__m256i const m1=_mm256_set1_epi8(char(middle+1));
+				__m256i const lowv=_mm256_set1_epi8(char(low));
+				__m256i const highv=_mm256_set1_epi8(char(high));
+				for(;i+32<=n;i+=32)
+				{
+					__m256i const x=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(data+i));
+					__m256i const above=_mm256_cmpeq_epi8(_mm256_max_epu8(x,m1),x);
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(data+i),_mm256_blendv_epi8(lowv,highv,above));
+				}
+				threshold_scalar(data+i,n-i,middle,low,high);
+			}
+
+			//mask of the 4 pixels starting at byte 0 of r,g,b whose luma is at least threshold
+			SP_TARGET_SSE41 inline __m128i luma_at_least_4(__m128i r,__m128i g,__m128i b,__m128 threshold)
+			{
+				__m128 const rf=_mm_cvtepi32_ps(_mm_cvtepu8_epi32(r));
+				__m128 const gf=_mm_cvtepi32_ps(_mm_cvtepu8_epi32(g));
+				__m128 const bf=_mm_cvtepi32_ps(_mm_cvtepu8_epi32(b));
+				__m128 const l=_mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(rf,_mm_set1_ps(0.2126f)),_mm_mul_ps(gf,_mm_set1_ps(0.7152f))),
+					_mm_mul_ps(bf,_mm_set1_ps(0.0722f)));
+				return _mm_castps_si128(_mm_cmpge_ps(l,threshold));
+			}
+
+			//truncating the luma gives a value greater than middle exactly when the luma is at least middle+1
+			SP_TARGET_SSE41 void threshold_rgb_sse41(uchar* r,uchar* g,uchar* b,size_t n,uchar middle,rgb low,rgb high)
+			{
+				size_t i=0;
+				if(middle<255)
+				{
+					__m128 const thresh=_mm_set1_ps(float(middle+1));
+					__m128i const lr=_mm_set1_epi8(char(low[0])),lg=_mm_set1_epi8(char(low[1])),lb=_mm_set1_epi8(char(low[2]));
+					__m128i const hr=_mm_set1_epi8(char(high[0])),hg=_mm_set1_epi8(char(high[1])),hb=_mm_set1_epi8(char(high[2]));
+					for(;i+16<=n;i+=16)
+					{
+						__m128i const x=_mm_loadu_si128(reinterpret_cast<__m128i const*>(r+i));
+						__m128i const y=_mm_loadu_si128(reinterpret_cast<__m128i const*>(g+i));
+						__m128i const z=_mm_loadu_si128(reinterpret_cast<__m128i const*>(b+i));
+						__m128i const m0=luma_at_least_4(x,y,z,thresh);
+						__m128i const m1=luma_at_least_4(_mm_srli_si128(x,4),_mm_srli_si128(y,4),_mm_srli_si128(z,4),thresh);
+						__m128i const m2=luma_at_least_4(_mm_srli_si128(x,8),_mm_srli_si128(y,8),_mm_srli_si128(z,8),thresh);
+						__m128i const m3=luma_at_least_4(_mm_srli_si128(x,12),_mm_srli_si128(y,12),_mm_srli_si128(z,12),thresh);
+						__m128i const mask=_mm_packs_epi16(_mm_packs_epi32(m0,m1),_mm_packs_epi32(m2,m3));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(r+i),_mm_blendv_epi8(lr,hr,mask));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(g+i),_mm_blendv_epi8(lg,hg,mask));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(b+i),_mm_blendv_epi8(lb,hb,mask));
+					}
+				}
+				threshold_rgb_scalar(r+i,g+i,b+i,n-i,middle,low,high);
+			}
+
+			SP_TARGET_AVX2 inline __m256i luma_at_least_8(__m128i r,__m128i g,__m128i b,__m256 threshold)
+			{
+				__m256 const rf=_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(r));
+				__m256 const gf=_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(g));
+				__m256 const bf=_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(b));
+				__m256 const l=_mm256_add_ps(
+					_mm256_add_ps(_mm256_mul_ps(rf,_mm256_set1_ps(0.2126f)),_mm256_mul_ps(gf,_mm256_set1_ps(0.7152f))),
+					_mm256_mul_ps(bf,_mm256_set1_ps(0.0722f)));
+				return _mm256_castps_si256(_mm256_cmp_ps(l,threshold,_CMP_GE_OQ));
+			}
+
+			SP_TARGET_AVX2 void threshold_rgb_avx2(uchar* r,uchar* g,uchar* b,size_t n,uchar middle,rgb low,rgb high)
+			{
+				size_t i=0;
+				if(middle<255)
+				{
+					__m256 const thresh=_mm256_set1_ps(float(middle+1));
+					__m128i const lr=_mm_set1_epi8(char(low[0])),lg=_mm_set1_epi8(char(low[1])),lb=_mm_set1_epi8(char(low[2]));
+					__m128i const hr=_mm_set1_epi8(char(high[0])),hg=_mm_set1_epi8(char(high[1])),hb=_mm_set1_epi8(char(high[2]));
+					for(;i+16<=n;i+=16)
+					{
+						__m128i const x=_mm_loadu_si128(reinterpret_cast<__m128i const*>(r+i));
+						__m128i const y=_mm_loadu_si128(reinterpret_cast<__m128i const*>(g+i));
+						__m128i const z=_mm_loadu_si128(reinterpret_cast<__m128i const*>(b+i));
+						__m256i const m0=luma_at_least_8(x,y,z,thresh);
+						__m256i const m1=luma_at_least_8(_mm_srli_si128(x,8),_mm_srli_si128(y,8),_mm_srli_si128(z,8),thresh);
+						//packs works within 128 bit lanes, so put the halves back in order before narrowing again
+						__m256i const m01=_mm256_permute4x64_epi64(_mm256_packs_epi32(m0,m1),_MM_SHUFFLE(3,1,2,0));
+						__m128i const mask=_mm_packs_epi16(_mm256_castsi256_si128(m01),_mm256_extracti128_si256(m01,1));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(r+i),_mm_blendv_epi8(lr,hr,mask));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(g+i),_mm_blendv_epi8(lg,hg,mask));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(b+i),_mm_blendv_epi8(lb,hb,mask));
+					}
+				}
+				threshold_rgb_scalar(r+i,g+i,b+i,n-i,middle,low,high);
+			}
+
+			/*
+				The table is split into 16 rows of 16 entries.
+				Each row is looked up by the low nibble with a byte shuffle and kept where the high nibble matches the row.
+			*/
+			SP_TARGET_SSE41 void apply_lut_sse41(uchar* data,size_t n,uchar const* table)
+			{
+				__m128i rows[16];
+				for(unsigned int k=0;k<16;++k)
+				{
+					rows[k]=_mm_loadu_si128(reinterpret_cast<__m128i const*>(table+16*k));
+				}
+				__m128i const nibble=_mm_set1_epi8(0x0F);
+				__m128i const one=_mm_set1_epi8(1);
+				size_t i=0;
+				for(;i+16<=n;i+=16)
+				{
+					__m128i const x=_mm_loadu_si128(reinterpret_cast<__m128i const*>(data+i));
+					__m128i const lo=_mm_and_si128(x,nibble);
+					__m128i const hi=_mm_and_si128(_mm_srli_epi16(x,4),nibble);
+					__m128i result=_mm_setzero_si128();
+					__m128i k=_mm_setzero_si128();
+					for(unsigned int row=0;row<16;++row)
+					{
+						result=_mm_or_si128(result,_mm_and_si128(_mm_cmpeq_epi8(hi,k),_mm_shuffle_epi8(rows[row],lo)));
+						k=_mm_add_epi8(k,one);
+					}
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(data+i),result);
+				}
+				apply_lut_scalar(data+i,n-i,table);
+			}
+
+			SP_TARGET_AVX2 void apply_lut_avx2(uchar* data,size_t n,uchar const* table)
+			{
+				__m256i rows[16];
+				for(unsigned int k=0;k<16;++k)
+				{
+					rows[k]=_mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<__m128i const*>(table+16*k)));
+				}
+				__m256i const nibble=_mm256_set1_epi8(0x0F);
+				__m256i const one=_mm256_set1_epi8(1);
+				size_t i=0;
+				for(;i+32<=n;i+=32)
+				{
+					__m256i const x=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(data+i));
+					__m256i const lo=_mm256_and_si256(x,nibble);
+					__m256i const hi=_mm256_and_si256(_mm256_srli_epi16(x,4),nibble);
+					__m256i result=_mm256_setzero_si256();
+					__m256i k=_mm256_setzero_si256();
+					for(unsigned int row=0;row<16;++row)
+					{
+						result=_mm256_or_si256(result,_mm256_and_si256(_mm256_cmpeq_epi8(hi,k),_mm256_shuffle_epi8(rows[row],lo)));
+						k=_mm256_add_epi8(k,one);
+					}
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(data+i),result);
+				}
+				apply_lut_scalar(data+i,n-i,table);
+			}
+
+			SP_TARGET_SSE41 bool replace_range_sse41(uchar* data,size_t n,uchar lower,uchar upper,uchar replacer)
+			{
+				__m128i const lv=_mm_set1_epi8(char(lower));
+				__m128i const uv=_mm_set1_epi8(char(upper));
+				__m128i const rv=_mm_set1_epi8(char(replacer));
+				bool edited=false;
+				size_t i=0;
+				for(;i+16<=n;i+=16)
+				{
+					__m128i const x=_mm_loadu_si128(reinterpret_cast<__m128i const*>(data+i));
+					__m128i const in=_mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(x,lv),x),_mm_cmpeq_epi8(_mm_min_epu8(x,uv),x));
+					__m128i const change=_mm_andnot_si128(_mm_cmpeq_epi8(x,rv),in);
+					if(_mm_movemask_epi8(change))
+					{
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(data+i),_mm_blendv_epi8(x,rv,change));
+						edited=true;
+					}
+				}
+				return replace_range_scalar(data+i,n-i,lower,upper,replacer)||edited;
+			}
+
+			SP_TARGET_AVX2 bool replace_range_avx2(uchar* data,size_t n,uchar lower,uchar upper,uchar replacer)
+			{
+				__m256i const lv=_mm256_set1_epi8(char(lower));
+				__m256i const uv=_mm256_set1_epi8(char(upper));
+				__m256i const rv=_mm256_set1_epi8(char(replacer));
+				bool edited=false;
+				size_t i=0;
+				for(;i+32<=n;i+=32)
+				{
+					__m256i const x=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(data+i));
+					__m256i const in=_mm256_and_si256(_mm256_cmpeq_epi8(_mm256_max_epu8(x,lv),x),_mm256_cmpeq_epi8(_mm256_min_epu8(x,uv),x));
+					__m256i const change=_mm256_andnot_si256(_mm256_cmpeq_epi8(x,rv),in);
+					if(_mm256_movemask_epi8(change))
+					{
+						_mm256_storeu_si256(reinterpret_cast<__m256i*>(data+i),_mm256_blendv_epi8(x,rv,change));
+						edited=true;
+					}
+				}
+				return replace_range_scalar(data+i,n-i,lower,upper,replacer)||edited;
+			}
+
+			SP_TARGET_SSE41 bool replace_by_brightness_sse41(uchar* r,uchar* g,uchar* b,size_t n,uchar lower,uchar upper,rgb replacer)
+			{
+				__m128i const lo3=_mm_set1_epi16(short(3*lower));
+				__m128i const hi3=_mm_set1_epi16(short(3*upper));
+				__m128i const rr=_mm_set1_epi8(char(replacer[0])),rg=_mm_set1_epi8(char(replacer[1])),rb=_mm_set1_epi8(char(replacer[2]));
+				__m128i const zero=_mm_setzero_si128();
+				bool edited=false;
+				size_t i=0;
+				for(;i+16<=n;i+=16)
+				{
+					__m128i const x=_mm_loadu_si128(reinterpret_cast<__m128i const*>(r+i));
+					__m128i const y=_mm_loadu_si128(reinterpret_cast<__m128i const*>(g+i));
+					__m128i const z=_mm_loadu_si128(reinterpret_cast<__m128i const*>(b+i));
+					__m128i const sum_lo=_mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(x,zero),_mm_unpacklo_epi8(y,zero)),_mm_unpacklo_epi8(z,zero));
+					__m128i const sum_hi=_mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(x,zero),_mm_unpackhi_epi8(y,zero)),_mm_unpackhi_epi8(z,zero));
+					__m128i const out_lo=_mm_or_si128(_mm_cmpgt_epi16(lo3,sum_lo),_mm_cmpgt_epi16(sum_lo,hi3));
+					__m128i const out_hi=_mm_or_si128(_mm_cmpgt_epi16(lo3,sum_hi),_mm_cmpgt_epi16(sum_hi,hi3));
+					__m128i const out=_mm_packs_epi16(out_lo,out_hi);
+					__m128i const same=_mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(x,rr),_mm_cmpeq_epi8(y,rg)),_mm_cmpeq_epi8(z,rb));
+					//change where neither out of range nor already the replacer
+					__m128i const keep=_mm_or_si128(out,same);
+					if(_mm_movemask_epi8(keep)!=0xFFFF)
+					{
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(r+i),_mm_blendv_epi8(rr,x,keep));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(g+i),_mm_blendv_epi8(rg,y,keep));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(b+i),_mm_blendv_epi8(rb,z,keep));
+						edited=true;
+					}
+				}
+				return replace_by_brightness_scalar(r+i,g+i,b+i,n-i,lower,upper,replacer)||edited;
+			}
+
+			SP_TARGET_AVX2 inline __m256i widen_lo(__m256i x)
+			{
+				return _mm256_cvtepu8_epi16(_mm256_castsi256_si128(x));
+			}
+
+			SP_TARGET_AVX2 inline __m256i widen_hi(__m256i x)
+			{
+				return _mm256_cvtepu8_epi16(_mm256_extracti128_si256(x,1));
+			}
+
+			SP_TARGET_AVX2 bool replace_by_brightness_avx2(uchar* r,uchar* g,uchar* b,size_t n,uchar lower,uchar upper,rgb replacer)
+			{
+				__m256i const lo3=_mm256_set1_epi16(short(3*lower));
+				__m256i const hi3=_mm256_set1_epi16(short(3*upper));
+				__m256i const rr=_mm256_set1_epi8(char(replacer[0])),rg=_mm256_set1_epi8(char(replacer[1])),rb=_mm256_set1_epi8(char(replacer[2]));
+				bool edited=false;
+				size_t i=0;
+				for(;i+32<=n;i+=32)
+				{
+					__m256i const x=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(r+i));
+					__m256i const y=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(g+i));
+					__m256i const z=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(b+i));
+					__m256i const sum_lo=_mm256_add_epi16(_mm256_add_epi16(widen_lo(x),widen_lo(y)),widen_lo(z));
+					__m256i const sum_hi=_mm256_add_epi16(_mm256_add_epi16(widen_hi(x),widen_hi(y)),widen_hi(z));
+					__m256i const out_lo=_mm256_or_si256(_mm256_cmpgt_epi16(lo3,sum_lo),_mm256_cmpgt_epi16(sum_lo,hi3));
+					__m256i const out_hi=_mm256_or_si256(_mm256_cmpgt_epi16(lo3,sum_hi),_mm256_cmpgt_epi16(sum_hi,hi3));
+					__m256i const out=_mm256_permute4x64_epi64(_mm256_packs_epi16(out_lo,out_hi),_MM_SHUFFLE(3,1,2,0));
+					__m256i const same=_mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(x,rr),_mm256_cmpeq_epi8(y,rg)),_mm256_cmpeq_epi8(z,rb));
+					__m256i const keep=_mm256_or_si256(out,same);
+					if(_mm256_movemask_epi8(keep)!=-1)
+					{
+						_mm256_storeu_si256(reinterpret_cast<__m256i*>(r+i),_mm256_blendv_epi8(rr,x,keep));
+						_mm256_storeu_si256(reinterpret_cast<__m256i*>(g+i),_mm256_blendv_epi8(rg,y,keep));
+						_mm256_storeu_si256(reinterpret_cast<__m256i*>(b+i),_mm256_blendv_epi8(rb,z,keep));
+						edited=true;
+					}
+				}
+				return replace_by_brightness_scalar(r+i,g+i,b+i,n-i,lower,upper,replacer)||edited;
+			}
+
+			//masks are 0 or -1 per lane, so subtracting one adds to the counts
+			SP_TARGET_SSE41 unsigned int count_below_sse41(uchar const* row,size_t n,unsigned int limit,unsigned short* columns)
+			{
+				__m128i const last=_mm_set1_epi8(char(limit-1));
+				__m128i const one=_mm_set1_epi8(1);
+				__m128i const zero=_mm_setzero_si128();
+				__m128i total=_mm_setzero_si128();
+				size_t i=0;
+				for(;i+16<=n;i+=16)
+				{
+					__m128i const x=_mm_loadu_si128(reinterpret_cast<__m128i const*>(row+i));
+					__m128i const below=_mm_cmpeq_epi8(_mm_min_epu8(x,last),x);
+					auto const c=reinterpret_cast<__m128i*>(columns+i);
+					_mm_storeu_si128(c,_mm_sub_epi16(_mm_loadu_si128(c),_mm_unpacklo_epi8(below,below)));
+					_mm_storeu_si128(c+1,_mm_sub_epi16(_mm_loadu_si128(c+1),_mm_unpackhi_epi8(below,below)));
+					total=_mm_add_epi64(total,_mm_sad_epu8(_mm_and_si128(below,one),zero));
+				}
+				unsigned int const count=unsigned(_mm_cvtsi128_si32(total)+_mm_extract_epi32(total,2));
+				return count+count_below_scalar(row+i,n-i,limit,columns+i);
+			}
+
+			SP_TARGET_AVX2 unsigned int count_below_avx2(uchar const* row,size_t n,unsigned int limit,unsigned short* columns)
+			{
+				__m256i const last=_mm256_set1_epi8(char(limit-1));
+				__m256i const one=_mm256_set1_epi8(1);
+				__m256i const zero=_mm256_setzero_si256();
+				__m256i total=_mm256_setzero_si256();
+				size_t i=0;
+				for(;i+32<=n;i+=32)
+				{
+					__m256i const x=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(row+i));
+					__m256i const below=_mm256_cmpeq_epi8(_mm256_min_epu8(x,last),x);
+					auto const c=reinterpret_cast<__m256i*>(columns+i);
+					_mm256_storeu_si256(c,_mm256_sub_epi16(_mm256_loadu_si256(c),_mm256_cvtepi8_epi16(_mm256_castsi256_si128(below))));
+					_mm256_storeu_si256(c+1,_mm256_sub_epi16(_mm256_loadu_si256(c+1),_mm256_cvtepi8_epi16(_mm256_extracti128_si256(below,1))));
+					total=_mm256_add_epi64(total,_mm256_sad_epu8(_mm256_and_si256(below,one),zero));
+				}
+				__m128i const half=_mm_add_epi64(_mm256_castsi256_si128(total),_mm256_extracti128_si256(total,1));
+				unsigned int const count=unsigned(_mm_cvtsi128_si32(half)+_mm_extract_epi32(half,2));
+				return count+count_below_scalar(row+i,n-i,limit,columns+i);
+			}
+
+			SP_TARGET_SSE41 unsigned int count_sum_below_sse41(uchar const* r,uchar const* g,uchar const* b,size_t n,unsigned int limit,unsigned short* columns)
+			{
+				__m128i const lim=_mm_set1_epi16(short(limit));
+				__m128i const one=_mm_set1_epi8(1);
+				__m128i const zero=_mm_setzero_si128();
+				__m128i total=_mm_setzero_si128();
+				size_t i=0;
+				for(;i+16<=n;i+=16)
+				{
+					__m128i const x=_mm_loadu_si128(reinterpret_cast<__m128i const*>(r+i));
+					__m128i const y=_mm_loadu_si128(reinterpret_cast<__m128i const*>(g+i));
+					__m128i const z=_mm_loadu_si128(reinterpret_cast<__m128i const*>(b+i));
+					__m128i const sum_lo=_mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(x,zero),_mm_unpacklo_epi8(y,zero)),_mm_unpacklo_epi8(z,zero));
+					__m128i const sum_hi=_mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(x,zero),_mm_unpackhi_epi8(y,zero)),_mm_unpackhi_epi8(z,zero));
+					__m128i const below_lo=_mm_cmpgt_epi16(lim,sum_lo);
+					__m128i const below_hi=_mm_cmpgt_epi16(lim,sum_hi);
+					auto const c=reinterpret_cast<__m128i*>(columns+i);
+					_mm_storeu_si128(c,_mm_sub_epi16(_mm_loadu_si128(c),below_lo));
+					_mm_storeu_si128(c+1,_mm_sub_epi16(_mm_loadu_si128(c+1),below_hi));
+					total=_mm_add_epi64(total,_mm_sad_epu8(_mm_and_si128(_mm_packs_epi16(below_lo,below_hi),one),zero));
+				}
+				unsigned int const count=unsigned(_mm_cvtsi128_si32(total)+_mm_extract_epi32(total,2));
+				return count+count_sum_below_scalar(r+i,g+i,b+i,n-i,limit,columns+i);
+			}
+
+			SP_TARGET_AVX2 unsigned int count_sum_below_avx2(uchar const* r,uchar const* g,uchar const* b,size_t n,unsigned int limit,unsigned short* columns)
+			{
+				__m256i const lim=_mm256_set1_epi16(short(limit));
+				__m256i const one=_mm256_set1_epi8(1);
+				__m256i const zero=_mm256_setzero_si256();
+				__m256i total=_mm256_setzero_si256();
+				size_t i=0;
+				for(;i+32<=n;i+=32)
+				{
+					__m256i const x=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(r+i));
+					__m256i const y=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(g+i));
+					__m256i const z=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(b+i));
+					__m256i const sum_lo=_mm256_add_epi16(_mm256_add_epi16(widen_lo(x),widen_lo(y)),widen_lo(z));
+					__m256i const sum_hi=_mm256_add_epi16(_mm256_add_epi16(widen_hi(x),widen_hi(y)),widen_hi(z));
+					__m256i const below_lo=_mm256_cmpgt_epi16(lim,sum_lo);
+					__m256i const below_hi=_mm256_cmpgt_epi16(lim,sum_hi);
+					auto const c=reinterpret_cast<__m256i*>(columns+i);
+					_mm256_storeu_si256(c,_mm256_sub_epi16(_mm256_loadu_si256(c),below_lo));
+					_mm256_storeu_si256(c+1,_mm256_sub_epi16(_mm256_loadu_si256(c+1),below_hi));
+					//lane order does not matter for the total
+					total=_mm256_add_epi64(total,_mm256_sad_epu8(_mm256_and_si256(_mm256_packs_epi16(below_lo,below_hi),one),zero));
+				}
+				__m128i const half=_mm_add_epi64(_mm256_castsi256_si128(total),_mm256_extracti128_si256(total,1));
+				unsigned int const count=unsigned(_mm_cvtsi128_si32(half)+_mm_extract_epi32(half,2));
+				return count+count_sum_below_scalar(r+i,g+i,b+i,n-i,limit,columns+i);
+			}
+
+			inline unsigned int lowest_bit(unsigned int mask)
+			{
+#ifdef _MSC_VER
+				unsigned long index;
+				_BitScanForward(&index,mask);
+				return index;
+#else
+				return __builtin_ctz(mask);
+#endif
+			}
+
+			//marks the lanes set in fresh, which are few over a whole image, one by one
+			inline unsigned int mark_lanes(unsigned int fresh,uchar* found,unsigned int* first,unsigned int y)
+			{
+				unsigned int count=0;
+				for(;fresh;fresh&=fresh-1)
+				{
+					unsigned int const lane=lowest_bit(fresh);
+					found[lane]=1;
+					first[lane]=y;
+					++count;
+				}
+				return count;
+			}
+
+			SP_TARGET_SSE41 unsigned int mark_first_below_sse41(uchar const* row,size_t n,unsigned int limit,uchar* found,unsigned int* first,unsigned int y)
+			{
+				__m128i const last=_mm_set1_epi8(char(limit-1));
+				__m128i const zero=_mm_setzero_si128();
+				unsigned int count=0;
+				size_t i=0;
+				for(;i+16<=n;i+=16)
+				{
+					__m128i const x=_mm_loadu_si128(reinterpret_cast<__m128i const*>(row+i));
+					__m128i const below=_mm_cmpeq_epi8(_mm_min_epu8(x,last),x);
+					__m128i const unmarked=_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(found+i)),zero);
+					unsigned int const fresh=unsigned(_mm_movemask_epi8(_mm_and_si128(below,unmarked)));
+					if(fresh)
+					{
+						count+=mark_lanes(fresh,found+i,first+i,y);
+					}
+				}
+				return count+mark_first_below_scalar(row+i,n-i,limit,found+i,first+i,y);
+			}
+
+			SP_TARGET_AVX2 unsigned int mark_first_below_avx2(uchar const* row,size_t n,unsigned int limit,uchar* found,unsigned int* first,unsigned int y)
+			{
+				__m256i const last=_mm256_set1_epi8(char(limit-1));
+				__m256i const zero=_mm256_setzero_si256();
+				unsigned int count=0;
+				size_t i=0;
+				for(;i+32<=n;i+=32)
+				{
+					__m256i const x=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(row+i));
+					__m256i const below=_mm256_cmpeq_epi8(_mm256_min_epu8(x,last),x);
+					__m256i const unmarked=_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(found+i)),zero);
+					unsigned int const fresh=unsigned(_mm256_movemask_epi8(_mm256_and_si256(below,unmarked)));
+					if(fresh)
+					{
+						count+=mark_lanes(fresh,found+i,first+i,y);
+					}
+				}
+				return count+mark_first_below_scalar(row+i,n-i,limit,found+i,first+i,y);
+			}
+
+			//byte mask of the pixels whose channel sum is less than lim, in pixel order
+			SP_TARGET_SSE41 inline __m128i sum_below_sse41(uchar const* r,uchar const* g,uchar const* b,__m128i lim)
+			{
+				__m128i const zero=_mm_setzero_si128();
+				__m128i const x=_mm_loadu_si128(reinterpret_cast<__m128i const*>(r));
+				__m128i const y=_mm_loadu_si128(reinterpret_cast<__m128i const*>(g));
+				__m128i const z=_mm_loadu_si128(reinterpret_cast<__m128i const*>(b));
+				__m128i const sum_lo=_mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(x,zero),_mm_unpacklo_epi8(y,zero)),_mm_unpacklo_epi8(z,zero));
+				__m128i const sum_hi=_mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(x,zero),_mm_unpackhi_epi8(y,zero)),_mm_unpackhi_epi8(z,zero));
+				return _mm_packs_epi16(_mm_cmpgt_epi16(lim,sum_lo),_mm_cmpgt_epi16(lim,sum_hi));
+			}
+
+			SP_TARGET_AVX2 inline __m256i sum_below_avx2(uchar const* r,uchar const* g,uchar const* b,__m256i lim)
+			{
+				__m256i const x=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(r));
+				__m256i const y=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(g));
+				__m256i const z=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(b));
+				__m256i const sum_lo=_mm256_add_epi16(_mm256_add_epi16(widen_lo(x),widen_lo(y)),widen_lo(z));
+				__m256i const sum_hi=_mm256_add_epi16(_mm256_add_epi16(widen_hi(x),widen_hi(y)),widen_hi(z));
+				//packing works within 128 bit lanes, so the middle quarters are swapped back
+				__m256i const packed=_mm256_packs_epi16(_mm256_cmpgt_epi16(lim,sum_lo),_mm256_cmpgt_epi16(lim,sum_hi));
+				return _mm256_permute4x64_epi64(packed,0xD8);
+			}
+
+			SP_TARGET_SSE41 unsigned int mark_first_sum_below_sse41(uchar const* r,uchar const* g,uchar const* b,size_t n,unsigned int limit,uchar* found,unsigned int* first,unsigned int y)
+			{
+				__m128i const lim=_mm_set1_epi16(short(limit));
+				__m128i const zero=_mm_setzero_si128();
+				unsigned int count=0;
+				size_t i=0;
+				for(;i+16<=n;i+=16)
+				{
+					__m128i const below=sum_below_sse41(r+i,g+i,b+i,lim);
+					__m128i const unmarked=_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(found+i)),zero);
+					unsigned int const fresh=unsigned(_mm_movemask_epi8(_mm_and_si128(below,unmarked)));
+					if(fresh)
+					{
+						count+=mark_lanes(fresh,found+i,first+i,y);
+					}
+				}
+				return count+mark_first_sum_below_scalar(r+i,g+i,b+i,n-i,limit,found+i,first+i,y);
+			}
+
+			SP_TARGET_AVX2 unsigned int mark_first_sum_below_avx2(uchar const* r,uchar const* g,uchar const* b,size_t n,unsigned int limit,uchar* found,unsigned int* first,unsigned int y)
+			{
+				__m256i const lim=_mm256_set1_epi16(short(limit));
+				__m256i const zero=_mm256_setzero_si256();
+				unsigned int count=0;
+				size_t i=0;
+				for(;i+32<=n;i+=32)
+				{
+					__m256i const below=sum_below_avx2(r+i,g+i,b+i,lim);
+					__m256i const unmarked=_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(found+i)),zero);
+					unsigned int const fresh=unsigned(_mm256_movemask_epi8(_mm256_and_si256(below,unmarked)));
+					if(fresh)
+					{
+						count+=mark_lanes(fresh,found+i,first+i,y);
+					}
+				}
+				return count+mark_first_sum_below_scalar(r+i,g+i,b+i,n-i,limit,found+i,first+i,y);
+			}
+
+			SP_TARGET_SSE41 size_t find_below_sse41(uchar const* row,size_t n,unsigned int limit)
+			{
+				__m128i const last=_mm_set1_epi8(char(limit-1));
+				size_t i=0;
+				for(;i+16<=n;i+=16)
+				{
+					__m128i const x=_mm_loadu_si128(reinterpret_cast<__m128i const*>(row+i));
+					unsigned int const below=unsigned(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(x,last),x)));
+					if(below)
+					{
+						return i+lowest_bit(below);
+					}
+				}
+				return i+find_below_scalar(row+i,n-i,limit);
+			}
+
+			SP_TARGET_AVX2 size_t find_below_avx2(uchar const* row,size_t n,unsigned int limit)
+			{
+				__m256i const last=_mm256_set1_epi8(char(limit-1));
+				size_t i=0;
+				for(;i+32<=n;i+=32)
+				{
+					__m256i const x=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(row+i));
+					unsigned int const below=unsigned(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(x,last),x)));
+					if(below)
+					{
+						return i+lowest_bit(below);
+					}
+				}
+				return i+find_below_scalar(row+i,n-i,limit);
+			}
+
+			SP_TARGET_SSE41 size_t find_sum_below_sse41(uchar const* r,uchar const* g,uchar const* b,size_t n,unsigned int limit)
+			{
+				__m128i const lim=_mm_set1_epi16(short(limit));
+				size_t i=0;
+				for(;i+16<=n;i+=16)
+				{
+					unsigned int const below=unsigned(_mm_movemask_epi8(sum_below_sse41(r+i,g+i,b+i,lim)));
+					if(below)
+					{
+						return i+lowest_bit(below);
+					}
+				}
+				return i+find_sum_below_scalar(r+i,g+i,b+i,n-i,limit);
+			}
+
+			SP_TARGET_AVX2 size_t find_sum_below_avx2(uchar const* r,uchar const* g,uchar const* b,size_t n,unsigned int limit)
+			{
+				__m256i const lim=_mm256_set1_epi16(short(limit));
+				size_t i=0;
+				for(;i+32<=n;i+=32)
+				{
+					unsigned int const below=unsigned(_mm256_movemask_epi8(sum_below_avx2(r+i,g+i,b+i,lim)));
+					if(below)
+					{
+						return i+lowest_bit(below);
+					}
+				}
+				return i+find_sum_below_scalar(r+i,g+i,b+i,n-i,limit);
+			}
+
+			SP_TARGET_SSE41 void min_into_sse41(uchar* dst,uchar const* src,size_t n)
+			{
+				size_t i=0;
+				for(;i+16<=n;i+=16)
+				{
+					__m128i const x=_mm_loadu_si128(reinterpret_cast<__m128i const*>(dst+i));
+					__m128i const y=_mm_loadu_si128(reinterpret_cast<__m128i const*>(src+i));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(dst+i),_mm_min_epu8(x,y));
+				}
+				min_into_scalar(dst+i,src+i,n-i);
+			}
+
+			SP_TARGET_AVX2 void min_into_avx2(uchar* dst,uchar const* src,size_t n)
+			{
+				size_t i=0;
+				for(;i+32<=n;i+=32)
+				{
+					__m256i const x=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(dst+i));
+					__m256i const y=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(src+i));
+					_mm256_storeu_si256(reinterpret_cast<__m256i*>(dst+i),_mm256_min_epu8(x,y));
+				}
+				min_into_scalar(dst+i,src+i,n-i);
+			}
+
+			SP_TARGET_SSE41 void darker_into_sse41(uchar* r,uchar* g,uchar* b,uchar const* sr,uchar const* sg,uchar const* sb,size_t n)
+			{
+				__m128i const zero=_mm_setzero_si128();
+				size_t i=0;
+				for(;i+16<=n;i+=16)
+				{
+					__m128i const x=_mm_loadu_si128(reinterpret_cast<__m128i const*>(r+i));
+					__m128i const y=_mm_loadu_si128(reinterpret_cast<__m128i const*>(g+i));
+					__m128i const z=_mm_loadu_si128(reinterpret_cast<__m128i const*>(b+i));
+					__m128i const sx=_mm_loadu_si128(reinterpret_cast<__m128i const*>(sr+i));
+					__m128i const sy=_mm_loadu_si128(reinterpret_cast<__m128i const*>(sg+i));
+					__m128i const sz=_mm_loadu_si128(reinterpret_cast<__m128i const*>(sb+i));
+					__m128i const sum_lo=_mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(x,zero),_mm_unpacklo_epi8(y,zero)),_mm_unpacklo_epi8(z,zero));
+					__m128i const sum_hi=_mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(x,zero),_mm_unpackhi_epi8(y,zero)),_mm_unpackhi_epi8(z,zero));
+					__m128i const ssum_lo=_mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(sx,zero),_mm_unpacklo_epi8(sy,zero)),_mm_unpacklo_epi8(sz,zero));
+					__m128i const ssum_hi=_mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(sx,zero),_mm_unpackhi_epi8(sy,zero)),_mm_unpackhi_epi8(sz,zero));
+					__m128i const darker=_mm_packs_epi16(_mm_cmpgt_epi16(sum_lo,ssum_lo),_mm_cmpgt_epi16(sum_hi,ssum_hi));
+					if(_mm_movemask_epi8(darker))
+					{
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(r+i),_mm_blendv_epi8(x,sx,darker));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(g+i),_mm_blendv_epi8(y,sy,darker));
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(b+i),_mm_blendv_epi8(z,sz,darker));
+					}
+				}
+				darker_into_scalar(r+i,g+i,b+i,sr+i,sg+i,sb+i,n-i);
+			}
+
+			SP_TARGET_AVX2 void darker_into_avx2(uchar* r,uchar* g,uchar* b,uchar const* sr,uchar const* sg,uchar const* sb,size_t n)
+			{
+				size_t i=0;
+				for(;i+32<=n;i+=32)
+				{
+					__m256i const x=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(r+i));
+					__m256i const y=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(g+i));
+					__m256i const z=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(b+i));
+					__m256i const sx=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(sr+i));
+					__m256i const sy=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(sg+i));
+					__m256i const sz=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(sb+i));
+					__m256i const sum_lo=_mm256_add_epi16(_mm256_add_epi16(widen_lo(x),widen_lo(y)),widen_lo(z));
+					__m256i const sum_hi=_mm256_add_epi16(_mm256_add_epi16(widen_hi(x),widen_hi(y)),widen_hi(z));
+					__m256i const ssum_lo=_mm256_add_epi16(_mm256_add_epi16(widen_lo(sx),widen_lo(sy)),widen_lo(sz));
+					__m256i const ssum_hi=_mm256_add_epi16(_mm256_add_epi16(widen_hi(sx),widen_hi(sy)),widen_hi(sz));
+					__m256i const darker=_mm256_permute4x64_epi64(_mm256_packs_epi16(_mm256_cmpgt_epi16(sum_lo,ssum_lo),_mm256_cmpgt_epi16(sum_hi,ssum_hi)),_MM_SHUFFLE(3,1,2,0));
+					if(_mm256_movemask_epi8(darker))
+					{
+						_mm256_storeu_si256(reinterpret_cast<__m256i*>(r+i),_mm256_blendv_epi8(x,sx,darker));
+						_mm256_storeu_si256(reinterpret_cast<__m256i*>(g+i),_mm256_blendv_epi8(y,sy,darker));
+						_mm256_storeu_si256(reinterpret_cast<__m256i*>(b+i),_mm256_blendv_epi8(z,sz,darker));
+					}
+				}
+				darker_into_scalar(r+i,g+i,b+i,sr+i,sg+i,sb+i,n-i);
+			}
+
+			SP_TARGET_SSE41 void add_min3_sse41(float* column,float const* prev,size_t begin,size_t end)
+			{
+				size_t i=begin;
+				for(;i+4<=end;i+=4)
+				{
+					__m128 const m=_mm_min_ps(_mm_min_ps(_mm_loadu_ps(prev+i-1),_mm_loadu_ps(prev+i)),_mm_loadu_ps(prev+i+1));
+					_mm_storeu_ps(column+i,_mm_add_ps(_mm_loadu_ps(column+i),m));
+				}
+				add_min3_scalar(column,prev,i,end);
+			}
+
+			SP_TARGET_AVX2 void add_min3_avx2(float* column,float const* prev,size_t begin,size_t end)
+			{
+				size_t i=begin;
+				for(;i+8<=end;i+=8)
+				{
+					__m256 const m=_mm256_min_ps(_mm256_min_ps(_mm256_loadu_ps(prev+i-1),_mm256_loadu_ps(prev+i)),_mm256_loadu_ps(prev+i+1));
+					_mm256_storeu_ps(column+i,_mm256_add_ps(_mm256_loadu_ps(column+i),m));
+				}
+				add_min3_scalar(column,prev,i,end);
+			}
+
+			//the template is taken two samples at a time, which madd multiplies against two neighbouring samples of the row for each offset
+			SP_TARGET_SSE41 void add_correlation_row_sse41(unsigned int* sums,uchar const* row,uchar const* tmplt_row,size_t count,size_t width)
+			{
+				size_t x=0;
+				for(;x+8<=count;x+=8)
+				{
+					__m128i lo=_mm_setzero_si128();
+					__m128i hi=_mm_setzero_si128();
+					size_t k=0;
+					for(;k+2<=width;k+=2)
+					{
+						__m128i const t=_mm_set1_epi32(int(tmplt_row[k])|int(tmplt_row[k+1])<<16);
+						__m128i const a=_mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(row+x+k)));
+						__m128i const b=_mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(row+x+k+1)));
+						lo=_mm_add_epi32(lo,_mm_madd_epi16(_mm_unpacklo_epi16(a,b),t));
+						hi=_mm_add_epi32(hi,_mm_madd_epi16(_mm_unpackhi_epi16(a,b),t));
+					}
+					if(k<width)
+					{
+						__m128i const t=_mm_set1_epi32(int(tmplt_row[k]));
+						__m128i const a=_mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<__m128i const*>(row+x+k)));
+						__m128i const zero=_mm_setzero_si128();
+						lo=_mm_add_epi32(lo,_mm_madd_epi16(_mm_unpacklo_epi16(a,zero),t));
+						hi=_mm_add_epi32(hi,_mm_madd_epi16(_mm_unpackhi_epi16(a,zero),t));
+					}
+					auto const out=reinterpret_cast<__m128i*>(sums+x);
+					_mm_storeu_si128(out,_mm_add_epi32(_mm_loadu_si128(out),lo));
+					_mm_storeu_si128(out+1,_mm_add_epi32(_mm_loadu_si128(out+1),hi));
+				}
+				add_correlation_row_scalar(sums,row,tmplt_row,x,count,width);
+			}
+
+			SP_TARGET_AVX2 void add_correlation_row_avx2(unsigned int* sums,uchar const* row,uchar const* tmplt_row,size_t count,size_t width)
+			{
+				size_t x=0;
+				for(;x+16<=count;x+=16)
+				{
+					//lo holds offsets 0-3 and 8-11, hi 4-7 and 12-15
+					__m256i lo=_mm256_setzero_si256();
+					__m256i hi=_mm256_setzero_si256();
+					size_t k=0;
+					for(;k+2<=width;k+=2)
+					{
+						__m256i const t=_mm256_set1_epi32(int(tmplt_row[k])|int(tmplt_row[k+1])<<16);
+						__m256i const a=_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(row+x+k)));
+						__m256i const b=_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(row+x+k+1)));
+						lo=_mm256_add_epi32(lo,_mm256_madd_epi16(_mm256_unpacklo_epi16(a,b),t));
+						hi=_mm256_add_epi32(hi,_mm256_madd_epi16(_mm256_unpackhi_epi16(a,b),t));
+					}
+					if(k<width)
+					{
+						__m256i const t=_mm256_set1_epi32(int(tmplt_row[k]));
+						__m256i const a=_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<__m128i const*>(row+x+k)));
+						__m256i const zero=_mm256_setzero_si256();
+						lo=_mm256_add_epi32(lo,_mm256_madd_epi16(_mm256_unpacklo_epi16(a,zero),t));
+						hi=_mm256_add_epi32(hi,_mm256_madd_epi16(_mm256_unpackhi_epi16(a,zero),t));
+					}
+					auto const out=reinterpret_cast<__m256i*>(sums+x);
+					_mm256_storeu_si256(out,_mm256_add_epi32(_mm256_loadu_si256(out),_mm256_permute2x128_si256(lo,hi,0x20)));
+					_mm256_storeu_si256(out+1,_mm256_add_epi32(_mm256_loadu_si256(out+1),_mm256_permute2x128_si256(lo,hi,0x31)));
+				}
+				add_correlation_row_scalar(sums,row,tmplt_row,x,count,width);
+			}
+
+			//sum of the two 64 bit lanes, through memory so it also builds for 32 bit
+			SP_TARGET_SSE41 inline size_t sum_epi64(__m128i v)
+			{
+				alignas(16) unsigned long long lanes[2];
+				_mm_store_si128(reinterpret_cast<__m128i*>(lanes),v);
+				return size_t(lanes[0]+lanes[1]);
+			}
+
+			SP_TARGET_SSE41 size_t count_equal_sse41(uchar const* a,uchar const* b,size_t n)
+			{
+				size_t i=0;
+				__m128i const zero=_mm_setzero_si128();
+				__m128i acc=zero;
+				for(;i+16<=n;i+=16)
+				{
+					__m128i const eq=_mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(a+i)),_mm_loadu_si128(reinterpret_cast<__m128i const*>(b+i)));
+					acc=_mm_add_epi64(acc,_mm_sad_epu8(_mm_sub_epi8(zero,eq),zero));
+				}
+				return sum_epi64(acc)+count_equal_scalar(a+i,b+i,n-i);
+			}
+
+			SP_TARGET_AVX2 size_t count_equal_avx2(uchar const* a,uchar const* b,size_t n)
+			{
+				size_t i=0;
+				__m256i const zero=_mm256_setzero_si256();
+				__m256i acc=zero;
+				for(;i+32<=n;i+=32)
+				{
+					__m256i const eq=_mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(a+i)),_mm256_loadu_si256(reinterpret_cast<__m256i const*>(b+i)));
+					acc=_mm256_add_epi64(acc,_mm256_sad_epu8(_mm256_sub_epi8(zero,eq),zero));
+				}
+				return sum_epi64(_mm_add_epi64(_mm256_castsi256_si128(acc),_mm256_extracti128_si256(acc,1)))+count_equal_scalar(a+i,b+i,n-i);
+			}
+
+			SP_TARGET_SSE41 size_t sum_abs_diff_sse41(uchar const* a,uchar const* b,size_t n)
+			{
+				size_t i=0;
+				__m128i acc=_mm_setzero_si128();
+				for(;i+16<=n;i+=16)
+				{
+					acc=_mm_add_epi64(acc,_mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<__m128i const*>(a+i)),_mm_loadu_si128(reinterpret_cast<__m128i const*>(b+i))));
+				}
+				return sum_epi64(acc)+sum_abs_diff_scalar(a+i,b+i,n-i);
+			}
+
+			SP_TARGET_AVX2 size_t sum_abs_diff_avx2(uchar const* a,uchar const* b,size_t n)
+			{
+				size_t i=0;
+				__m256i acc=_mm256_setzero_si256();
+				for(;i+32<=n;i+=32)
+				{
+					acc=_mm256_add_epi64(acc,_mm256_sad_epu8(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(a+i)),_mm256_loadu_si256(reinterpret_cast<__m256i const*>(b+i))));
+				}
+				return sum_epi64(_mm_add_epi64(_mm256_castsi256_si128(acc),_mm256_extracti128_si256(acc,1)))+sum_abs_diff_scalar(a+i,b+i,n-i);
+			}
+
+			//max(v,threshold)==v marks the samples at or above threshold, so the mask is inverted
+			SP_TARGET_SSE41 void pack_below_sse41(unsigned long long* bits,uchar const* data,size_t n,uchar threshold)
+			{
+				size_t w=0;
+				__m128i const t=_mm_set1_epi8(char(threshold));
+				for(;(w+1)*64<=n;++w)
+				{
+					unsigned long long word=0;
+					for(unsigned int part=0;part<4;++part)
+					{
+						__m128i const v=_mm_loadu_si128(reinterpret_cast<__m128i const*>(data+w*64+part*16));
+						unsigned int const at_least=unsigned int(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v,t),v)));
+						word|=static_cast<unsigned long long>(~at_least&0xFFFFU)<<(part*16);
+					}
+					bits[w]=word;
+				}
+				pack_below_scalar(bits,data,w,n,threshold);
+			}
+
+			SP_TARGET_AVX2 void pack_below_avx2(unsigned long long* bits,uchar const* data,size_t n,uchar threshold)
+			{
+				size_t w=0;
+				__m256i const t=_mm256_set1_epi8(char(threshold));
+				for(;(w+1)*64<=n;++w)
+				{
+					__m256i const lo=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(data+w*64));
+					__m256i const hi=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(data+w*64+32));
+					unsigned int const lo_at_least=unsigned int(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(lo,t),lo)));
+					unsigned int const hi_at_least=unsigned int(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(hi,t),hi)));
+					bits[w]=~(static_cast<unsigned long long>(hi_at_least)<<32|lo_at_least);
+				}
+				pack_below_scalar(bits,data,w,n,threshold);
+			}
+
+			//bit counts of each nibble, looked up with a shuffle and summed per 64 bits with sad
+			SP_TARGET_SSE41 size_t count_bits_sse41(unsigned long long const* words,size_t n)
+			{
+				size_t i=0;
+				__m128i const table=_mm_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+				__m128i const low=_mm_set1_epi8(0x0F);
+				__m128i acc=_mm_setzero_si128();
+				for(;i+2<=n;i+=2)
+				{
+					__m128i const v=_mm_loadu_si128(reinterpret_cast<__m128i const*>(words+i));
+					__m128i const counts=_mm_add_epi8(
+						_mm_shuffle_epi8(table,_mm_and_si128(v,low)),
+						_mm_shuffle_epi8(table,_mm_and_si128(_mm_srli_epi16(v,4),low)));
+					acc=_mm_add_epi64(acc,_mm_sad_epu8(counts,_mm_setzero_si128()));
+				}
+				return sum_epi64(acc)+count_bits_scalar(words+i,n-i);
+			}
+
+			SP_TARGET_AVX2 size_t count_bits_avx2(unsigned long long const* words,size_t n)
+			{
+				size_t i=0;
+				__m256i const table=_mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+				__m256i const low=_mm256_set1_epi8(0x0F);
+				__m256i acc=_mm256_setzero_si256();
+				for(;i+4<=n;i+=4)
+				{
+					__m256i const v=_mm256_loadu_si256(reinterpret_cast<__m256i const*>(words+i));
+					__m256i const counts=_mm256_add_epi8(
+						_mm256_shuffle_epi8(table,_mm256_and_si256(v,low)),
+						_mm256_shuffle_epi8(table,_mm256_and_si256(_mm256_srli_epi16(v,4),low)));
+					acc=_mm256_add_epi64(acc,_mm256_sad_epu8(counts,_mm256_setzero_si256()));
+				}
+				return sum_epi64(_mm_add_epi64(_mm256_castsi256_si128(acc),_mm256_extracti128_si256(acc,1)))+count_bits_scalar(words+i,n-i);
+			}
+
+			SP_TARGET_SSE41 void add_count_difference_sse41(unsigned int* counts,unsigned int const* plus,unsigned int const* minus,size_t n)
+			{
+				size_t i=0;
+				for(;i+4<=n;i+=4)
+				{
+					__m128i* const out=reinterpret_cast<__m128i*>(counts+i);
+					__m128i const difference=_mm_sub_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(plus+i)),_mm_loadu_si128(reinterpret_cast<__m128i const*>(minus+i)));
+					_mm_storeu_si128(out,_mm_add_epi32(_mm_loadu_si128(out),difference));
+				}
+				add_count_difference_scalar(counts,plus,minus,i,n);
+			}
+
+			SP_TARGET_AVX2 void add_count_difference_avx2(unsigned int* counts,unsigned int const* plus,unsigned int const* minus,size_t n)
+			{
+				size_t i=0;
+				for(;i+8<=n;i+=8)
+				{
+					__m256i* const out=reinterpret_cast<__m256i*>(counts+i);
+					__m256i const difference=_mm256_sub_epi32(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(plus+i)),_mm256_loadu_si256(reinterpret_cast<__m256i const*>(minus+i)));
+					_mm256_storeu_si256(out,_mm256_add_epi32(_mm256_loadu_si256(out),difference));
+				}
+				add_count_difference_scalar(counts,plus,minus,i,n);
+			}
+
+			void cpuid(int info[4],int leaf,int subleaf)
+			{
+#ifdef _MSC_VER
+				__cpuidex(info,leaf,subleaf);
+#else
+				unsigned int a,b,c,d;
+				__cpuid_count(leaf,subleaf,a,b,c,d);
+				info[0]=int(a);
+				info[1]=int(b);
+				info[2]=int(c);
+				info[3]=int(d);
+#endif
+			}
+
+			unsigned long long xcr0()
+			{
+#ifdef _MSC_VER
+				return _xgetbv(0);
+#else
+				unsigned int lo,hi;
+				__asm__ volatile("xgetbv":"=a"(lo),"=d"(hi):"c"(0));
+				return (static_cast<unsigned long long>(hi)<<32)|lo;
+#endif
+			}
+
+			instruction_set detect()
+			{
+				int info[4];
+				cpuid(info,0,0);
+				int const max_leaf=info[0];
+				if(max_leaf<1)
+				{
+					return instruction_set::scalar;
+				}
+				cpuid(info,1,0);
+				bool const sse41=(info[2]&(1<<19))!=0;
+				bool const osxsave=(info[2]&(1<<27))!=0;
+				bool const avx=(info[2]&(1<<28))!=0;
+				if(!sse41)
+				{
+					return instruction_set::scalar;
+				}
+				//the os has to save the ymm registers for avx to be usable
+				if(max_leaf>=7&&osxsave&&avx&&(xcr0()&6)==6)
+				{
+					cpuid(info,7,0);
+					if(info[1]&(1<<5))
+					{
+						return instruction_set::avx2;
+					}
+				}
+				return instruction_set::sse41;
+			}
+#else
+			instruction_set detect()
+			{
+				return instruction_set::scalar;
+			}
+#endif
+
+			std::atomic<instruction_set>& current()
+			{
+				static std::atomic<instruction_set> level(best_instruction_set());
+				return level;
+			}
+		}
+
+		instruction_set best_instruction_set()
+		{
+			static instruction_set const best=detect();
+			return best;
+		}
+
+		instruction_set current_instruction_set()
+		{
+			return current().load(std::memory_order_relaxed);
+		}
+
+		instruction_set set_instruction_set(instruction_set is)
+		{
+			auto const best=best_instruction_set();
+			if(is>best)
+			{
+				is=best;
+			}
+			current().store(is,std::memory_order_relaxed);
+			return is;
+		}
+
+		void threshold(unsigned char* data,size_t n,unsigned char middle,unsigned char low,unsigned char high)
+		{
+			if(middle==255)
+			{
+				std::memset(data,low,n);
+				return;
+			}
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					threshold_avx2(data,n,middle,low,high);
+					return;
+				case instruction_set::sse41:
+					threshold_sse41(data,n,middle,low,high);
+					return;
+				default:
+					break;
+			}
+#endif
+			threshold_scalar(data,n,middle,low,high);
+		}
+
+		void threshold_rgb(unsigned char* r,unsigned char* g,unsigned char* b,size_t n,unsigned char middle,std::array<unsigned char,3> low,std::array<unsigned char,3> high)
+		{
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					threshold_rgb_avx2(r,g,b,n,middle,low,high);
+					return;
+				case instruction_set::sse41:
+					threshold_rgb_sse41(r,g,b,n,middle,low,high);
+					return;
+				default:
+					break;
+			}
+#endif
+			threshold_rgb_scalar(r,g,b,n,middle,low,high);
+		}
+
+		void apply_lut(unsigned char* data,size_t n,std::array<unsigned char,256> const& table)
+		{
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					apply_lut_avx2(data,n,table.data());
+					return;
+				case instruction_set::sse41:
+					apply_lut_sse41(data,n,table.data());
+					return;
+				default:
+					break;
+			}
+#endif
+			apply_lut_scalar(data,n,table.data());
+		}
+
+		bool replace_range(unsigned char* data,size_t n,unsigned char lower,unsigned char upper,unsigned char replacer)
+		{
+			if(lower>upper)
+			{
+				return false;
+			}
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return replace_range_avx2(data,n,lower,upper,replacer);
+				case instruction_set::sse41:
+					return replace_range_sse41(data,n,lower,upper,replacer);
+				default:
+					break;
+			}
+#endif
+			return replace_range_scalar(data,n,lower,upper,replacer);
+		}
+
+		bool replace_by_brightness(unsigned char* r,unsigned char* g,unsigned char* b,size_t n,unsigned char lower,unsigned char upper,std::array<unsigned char,3> replacer)
+		{
+			if(lower>upper)
+			{
+				return false;
+			}
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return replace_by_brightness_avx2(r,g,b,n,lower,upper,replacer);
+				case instruction_set::sse41:
+					return replace_by_brightness_sse41(r,g,b,n,lower,upper,replacer);
+				default:
+					break;
+			}
+#endif
+			return replace_by_brightness_scalar(r,g,b,n,lower,upper,replacer);
+		}
+
+		unsigned int count_below(unsigned char const* row,size_t n,unsigned int limit,unsigned short* columns)
+		{
+			if(limit==0)
+			{
+				return 0;
+			}
+			if(limit>255)
+			{
+				for(size_t i=0;i<n;++i)
+				{
+					++columns[i];
+				}
+				return unsigned(n);
+			}
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return count_below_avx2(row,n,limit,columns);
+				case instruction_set::sse41:
+					return count_below_sse41(row,n,limit,columns);
+				default:
+					break;
+			}
+#endif
+			return count_below_scalar(row,n,limit,columns);
+		}
+
+		unsigned int count_sum_below(unsigned char const* r,unsigned char const* g,unsigned char const* b,size_t n,unsigned int limit,unsigned short* columns)
+		{
+			if(limit>3*255)
+			{
+				limit=3*255+1;
+			}
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return count_sum_below_avx2(r,g,b,n,limit,columns);
+				case instruction_set::sse41:
+					return count_sum_below_sse41(r,g,b,n,limit,columns);
+				default:
+					break;
+			}
+#endif
+			return count_sum_below_scalar(r,g,b,n,limit,columns);
+		}
+
+		unsigned int mark_first_below(unsigned char const* row,size_t n,unsigned int limit,unsigned char* found,unsigned int* first,unsigned int y)
+		{
+			if(limit==0)
+			{
+				return 0;
+			}
+			if(limit>255)
+			{
+				return mark_first_below_scalar(row,n,256,found,first,y);
+			}
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return mark_first_below_avx2(row,n,limit,found,first,y);
+				case instruction_set::sse41:
+					return mark_first_below_sse41(row,n,limit,found,first,y);
+				default:
+					break;
+			}
+#endif
+			return mark_first_below_scalar(row,n,limit,found,first,y);
+		}
+
+		unsigned int mark_first_sum_below(unsigned char const* r,unsigned char const* g,unsigned char const* b,size_t n,unsigned int limit,unsigned char* found,unsigned int* first,unsigned int y)
+		{
+			if(limit>3*255)
+			{
+				limit=3*255+1;
+			}
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return mark_first_sum_below_avx2(r,g,b,n,limit,found,first,y);
+				case instruction_set::sse41:
+					return mark_first_sum_below_sse41(r,g,b,n,limit,found,first,y);
+				default:
+					break;
+			}
+#endif
+			return mark_first_sum_below_scalar(r,g,b,n,limit,found,first,y);
+		}
+
+		size_t find_below(unsigned char const* row,size_t n,unsigned int limit)
+		{
+			if(limit==0)
+			{
+				return n;
+			}
+			if(limit>255)
+			{
+				return 0;
+			}
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return find_below_avx2(row,n,limit);
+				case instruction_set::sse41:
+					return find_below_sse41(row,n,limit);
+				default:
+					break;
+			}
+#endif
+			return find_below_scalar(row,n,limit);
+		}
+
+		size_t find_sum_below(unsigned char const* r,unsigned char const* g,unsigned char const* b,size_t n,unsigned int limit)
+		{
+			if(limit>3*255)
+			{
+				limit=3*255+1;
+			}
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return find_sum_below_avx2(r,g,b,n,limit);
+				case instruction_set::sse41:
+					return find_sum_below_sse41(r,g,b,n,limit);
+				default:
+					break;
+			}
+#endif
+			return find_sum_below_scalar(r,g,b,n,limit);
+		}
+
+		void min_into(unsigned char* dst,unsigned char const* src,size_t n)
+		{
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return min_into_avx2(dst,src,n);
+				case instruction_set::sse41:
+					return min_into_sse41(dst,src,n);
+				default:
+					break;
+			}
+#endif
+			min_into_scalar(dst,src,n);
+		}
+
+		void darker_into(unsigned char* r,unsigned char* g,unsigned char* b,unsigned char const* sr,unsigned char const* sg,unsigned char const* sb,size_t n)
+		{
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return darker_into_avx2(r,g,b,sr,sg,sb,n);
+				case instruction_set::sse41:
+					return darker_into_sse41(r,g,b,sr,sg,sb,n);
+				default:
+					break;
+			}
+#endif
+			darker_into_scalar(r,g,b,sr,sg,sb,n);
+		}
+
+		void add_min3(float* column,float const* prev,size_t n)
+		{
+			if(n<2)
+			{
+				if(n)
+				{
+					column[0]+=prev[0];
+				}
+				return;
+			}
+			column[0]+=std::min(prev[0],prev[1]);
+			column[n-1]+=std::min(prev[n-1],prev[n-2]);
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return add_min3_avx2(column,prev,1,n-1);
+				case instruction_set::sse41:
+					return add_min3_sse41(column,prev,1,n-1);
+				default:
+					break;
+			}
+#endif
+			add_min3_scalar(column,prev,1,n-1);
+		}
+	
+		void add_correlation_row(unsigned int* sums,unsigned char const* row,unsigned char const* tmplt_row,size_t count,size_t width)
+		{
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return add_correlation_row_avx2(sums,row,tmplt_row,count,width);
+				case instruction_set::sse41:
+					return add_correlation_row_sse41(sums,row,tmplt_row,count,width);
+				default:
+					break;
+			}
+#endif
+			add_correlation_row_scalar(sums,row,tmplt_row,0,count,width);
+		}
+
+		size_t count_equal(unsigned char const* a,unsigned char const* b,size_t n)
+		{
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return count_equal_avx2(a,b,n);
+				case instruction_set::sse41:
+					return count_equal_sse41(a,b,n);
+				default:
+					break;
+			}
+#endif
+			return count_equal_scalar(a,b,n);
+		}
+
+		size_t sum_abs_diff(unsigned char const* a,unsigned char const* b,size_t n)
+		{
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return sum_abs_diff_avx2(a,b,n);
+				case instruction_set::sse41:
+					return sum_abs_diff_sse41(a,b,n);
+				default:
+					break;
+			}
+#endif
+			return sum_abs_diff_scalar(a,b,n);
+		}
+	
+		void pack_below(unsigned long long* bits,unsigned char const* data,size_t n,unsigned char threshold)
+		{
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return pack_below_avx2(bits,data,n,threshold);
+				case instruction_set::sse41:
+					return pack_below_sse41(bits,data,n,threshold);
+				default:
+					break;
+			}
+#endif
+			pack_below_scalar(bits,data,0,n,threshold);
+		}
+
+		size_t count_bits(unsigned long long const* words,size_t n)
+		{
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return count_bits_avx2(words,n);
+				case instruction_set::sse41:
+					return count_bits_sse41(words,n);
+				default:
+					break;
+			}
+#endif
+			return count_bits_scalar(words,n);
+		}
+	
+		void add_count_difference(unsigned int* counts,unsigned int const* plus,unsigned int const* minus,size_t n)
+		{
+#ifdef SP_KERNELS_X86
+			switch(current_instruction_set())
+			{
+				case instruction_set::avx2:
+					return add_count_difference_avx2(counts,plus,minus,n);
+				case instruction_set::sse41:
+					return add_count_difference_sse41(counts,plus,minus,n);
+				default:
+					break;
+			}
+#endif
+			add_count_difference_scalar(counts,plus,minus,0,n);
+		}
+	}
+}
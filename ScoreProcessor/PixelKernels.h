@@ -0,0 +1,158 @@
+/*
+Copyright(C) 2017-2018 Edward Xie
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef PIXEL_KERNELS_H
+#define PIXEL_KERNELS_H
+#include <array>
+#include <cstddef>
+namespace ScoreProcessor {
+	/*
+		Flat kernels over runs of 8-bit samples.
+		Each one has an AVX2, an SSE4.1 and a scalar version; the version used is picked once at runtime from what the cpu supports.
+		All versions give byte-identical results.
+	*/
+	namespace kernels {
+		enum class instruction_set {
+			scalar,
+			sse41,
+			avx2
+		};
+
+		/*
+			Best instruction set supported by this cpu and os.
+		*/
+		instruction_set best_instruction_set();
+
+		/*
+			Instruction set the kernels currently dispatch to.
+		*/
+		instruction_set current_instruction_set();
+
+		/*
+			Limits the kernels to the given instruction set, clamped to what is supported.
+			Returns the instruction set actually in use.
+		*/
+		instruction_set set_instruction_set(instruction_set);
+
+		/*
+			Every sample greater than middle becomes high, everything else becomes low.
+		*/
+		void threshold(unsigned char* data,size_t n,unsigned char middle,unsigned char low,unsigned char high);
+
+		/*
+			Planar rgb version of threshold. A pixel is compared by its ImageUtils::brightness.
+		*/
+		void threshold_rgb(unsigned char* r,unsigned char* g,unsigned char* b,size_t n,unsigned char middle,std::array<unsigned char,3> low,std::array<unsigned char,3> high);
+
+		/*
+			Replaces every sample with table[sample].
+		*/
+		void apply_lut(unsigned char* data,size_t n,std::array<unsigned char,256> const& table);
+
+		/*
+			Every sample in [lower,upper] becomes replacer.
+			Returns whether any sample changed.
+		*/
+		bool replace_range(unsigned char* data,size_t n,unsigned char lower,unsigned char upper,unsigned char replacer);
+
+		/*
+			Every planar rgb pixel whose mean channel value is in [lower,upper] becomes replacer.
+			Returns whether any pixel changed.
+		*/
+		bool replace_by_brightness(unsigned char* r,unsigned char* g,unsigned char* b,size_t n,unsigned char lower,unsigned char upper,std::array<unsigned char,3> replacer);
+
+		/*
+			Adds one to columns[i] for every row[i] less than limit.
+			Returns how many samples were counted.
+		*/
+		unsigned int count_below(unsigned char const* row,size_t n,unsigned int limit,unsigned short* columns);
+
+		/*
+			Planar rgb version of count_below. A pixel is counted when the sum of its channels is less than limit.
+		*/
+		unsigned int count_sum_below(unsigned char const* r,unsigned char const* g,unsigned char const* b,size_t n,unsigned int limit,unsigned short* columns);
+
+		/*
+			For every i not yet marked in found with row[i] less than limit, marks found[i] and sets first[i] to y.
+			Returns how many columns were marked.
+		*/
+		unsigned int mark_first_below(unsigned char const* row,size_t n,unsigned int limit,unsigned char* found,unsigned int* first,unsigned int y);
+
+		/*
+			Planar rgb version of mark_first_below. A pixel is below when the sum of its channels is less than limit.
+		*/
+		unsigned int mark_first_sum_below(unsigned char const* r,unsigned char const* g,unsigned char const* b,size_t n,unsigned int limit,unsigned char* found,unsigned int* first,unsigned int y);
+
+		/*
+			Index of the first sample less than limit, or n if there is none.
+		*/
+		size_t find_below(unsigned char const* row,size_t n,unsigned int limit);
+
+		/*
+			Planar rgb version of find_below, comparing the sum of the channels.
+		*/
+		size_t find_sum_below(unsigned char const* r,unsigned char const* g,unsigned char const* b,size_t n,unsigned int limit);
+
+		/*
+			dst[i] becomes the lesser of dst[i] and src[i].
+		*/
+		void min_into(unsigned char* dst,unsigned char const* src,size_t n);
+
+		/*
+			Every planar rgb pixel of sr,sg,sb whose channel sum is less than that of the pixel in r,g,b replaces it.
+		*/
+		void darker_into(unsigned char* r,unsigned char* g,unsigned char* b,unsigned char const* sr,unsigned char const* sg,unsigned char const* sb,size_t n);
+
+		/*
+			column[i] increases by the least of prev[i-1], prev[i] and prev[i+1], leaving out the ones past either end.
+			One step of the minimum energy seam search, with prev the already accumulated previous column.
+		*/
+		void add_min3(float* column,float const* prev,size_t n);
+
+		/*
+			sums[x] increases by the sum of row[x+k]*tmplt_row[k] for every k less than width, for every x less than count.
+			row holds count+width-1 samples. The sums of a template must fit in 32 bits.
+		*/
+		void add_correlation_row(unsigned int* sums,unsigned char const* row,unsigned char const* tmplt_row,size_t count,size_t width);
+
+		/*
+			Number of i for which a[i]==b[i].
+		*/
+		size_t count_equal(unsigned char const* a,unsigned char const* b,size_t n);
+
+		/*
+			Sum of the absolute differences between a[i] and b[i].
+		*/
+		size_t sum_abs_diff(unsigned char const* a,unsigned char const* b,size_t n);
+
+		/*
+			Sets bit i%64 of bits[i/64] if data[i]<threshold and clears it otherwise, for i<n.
+			Writes (n+63)/64 words; the bits past n in the last one are cleared.
+		*/
+		void pack_below(unsigned long long* bits,unsigned char const* data,size_t n,unsigned char threshold);
+
+		/*
+			Number of set bits in the n words.
+		*/
+		size_t count_bits(unsigned long long const* words,size_t n);
+
+		/*
+			counts[i]+=plus[i]-minus[i], for merging histograms. Wraps like unsigned arithmetic.
+		*/
+		void add_count_difference(unsigned int* counts,unsigned int const* plus,unsigned int const* minus,size_t n);
+	}
+}
+#endif // !PIXEL_KERNELS_H
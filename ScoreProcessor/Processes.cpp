@@ -1,5 +1,7 @@
 #include "stdafx.h"
 #include "Processes.h"
+#include "TemplateMatch.h"
+#include <string>
 
 namespace ScoreProcessor {
 
@@ -33,42 +35,339 @@ namespace ScoreProcessor {
 			throw std::invalid_argument("Remove process requires Grayscale image");
 		}
 	}
-	bool FilterGray::process(Img& img) const
+	bool TileableProcess::process(Img& img) const
+	{
+		check(img);
+		size_t const row_bytes = size_t(img._width) * img._spectrum * sizeof(Img::value_type);
+		return process_strips(img._height, row_bytes, [&img, this](unsigned int top, unsigned int bottom)
+			{
+				return process_rows(img, top, bottom);
+			});
+	}
+
+	bool FilterGray::process_rows(Img& img, unsigned int top, unsigned int bottom) const
 	{
 		if(img._spectrum < 3)
 		{
-			return replace_range(img, min, max, replacer);
+			return replace_range(img, min, max, replacer, top, bottom);
 		}
 		else
 		{
-			return replace_by_brightness(img, min, max, ImageUtils::ColorRGB({replacer,replacer,replacer}));
+			return replace_by_brightness(img, min, max, ImageUtils::ColorRGB({replacer,replacer,replacer}), top, bottom);
+		}
+	}
+
+	namespace {
+		using lut_table = std::array<unsigned char, 256>;
+
+		//runs the given whole image function on every possible value to get its table
+		template<typename Func>
+		lut_table make_table(Func func)
+		{
+			cil::CImg<unsigned char> values(256, 1);
+			for(unsigned int v = 0; v < 256; ++v)
+			{
+				values(v) = v;
+			}
+			func(values);
+			lut_table table;
+			std::copy(values.begin(), values.end(), table.begin());
+			return table;
+		}
+
+		pixel_step lut_step(lut_table const& table, bool all_layers, bool conditional)
+		{
+			pixel_step step;
+			step.type = pixel_step::lut;
+			step.all_layers = all_layers;
+			step.conditional = conditional;
+			step.table = table;
+			return step;
 		}
+
+		//a composition of lut steps; touched[v] is whether any conditional step changes v on its way through
+		struct fused_lut {
+			lut_table table;
+			std::array<bool, 256> touched;
+			fused_lut()
+			{
+				for(unsigned int v = 0; v < 256; ++v)
+				{
+					table[v] = v;
+				}
+				touched.fill(false);
+			}
+			void add(pixel_step const& step)
+			{
+				for(unsigned int v = 0; v < 256; ++v)
+				{
+					auto const old = table[v];
+					auto const next = step.table[old];
+					if(step.conditional && next != old)
+					{
+						touched[v] = true;
+					}
+					table[v] = next;
+				}
+			}
+			bool does_anything() const
+			{
+				for(unsigned int v = 0; v < 256; ++v)
+				{
+					if(table[v] != v || touched[v])
+					{
+						return true;
+					}
+				}
+				return false;
+			}
+		};
 	}
 
-	bool FilterHSV::process(Img& img) const
+	void FilterGray::add_steps(unsigned int spectrum, std::vector<pixel_step>& steps) const
 	{
-		if(img._spectrum >= 3)
+		if(spectrum < 3)
 		{
-			return replace_by_hsv(img, start, end, replacer);
+			lut_table table;
+			for(unsigned int v = 0; v < 256; ++v)
+			{
+				table[v] = (v >= min && v <= max) ? replacer : v;
+			}
+			steps.push_back(lut_step(table, true, true));
 		}
 		else
 		{
-			throw std::invalid_argument("Color (3+ spectrum) image required");
+			pixel_step step;
+			step.type = pixel_step::brightness_filter;
+			step.all_layers = false;
+			step.conditional = true;
+			step.lower = min;
+			step.upper = max;
+			step.replacer = {replacer,replacer,replacer};
+			steps.push_back(step);
 		}
 	}
 
-	bool FilterRGB::process(Img& img) const
+	void RescaleGray::add_steps(unsigned int, std::vector<pixel_step>& steps) const
 	{
-		if(img._spectrum >= 3)
+		steps.push_back(lut_step(make_table([this](Img& values)
+			{
+				rescale_colors(values, min, mid, max);
+			}), false, false));
+	}
+
+	void Gamma::add_steps(unsigned int, std::vector<pixel_step>& steps) const
+	{
+		steps.push_back(lut_step(make_table([this](Img& values)
+			{
+				apply_gamma(values, gamma);
+			}), false, false));
+	}
+
+	void Invert::add_steps(unsigned int spectrum, std::vector<pixel_step>& steps) const
+	{
+		lut_table table;
+		for(unsigned int v = 0; v < 256; ++v)
 		{
-			return replace_by_rgb(img, start, end, replacer);
+			//Invert leaves images with more than 4 layers alone
+			table[v] = spectrum > 4 ? v : ~v;
 		}
-		else
+		steps.push_back(lut_step(table, false, false));
+	}
+
+	bool FusedProcess::process(Img& img) const
+	{
+		std::vector<pixel_step> steps;
+		for(auto const& part : parts)
+		{
+			part->add_steps(img._spectrum, steps);
+		}
+		bool const always_edits = std::any_of(steps.begin(), steps.end(), [](pixel_step const& step)
+			{
+				return !step.conditional;
+			});
+		std::size_t const size = img._width * std::size_t(img._height);
+		std::size_t const row_bytes = img._width * std::size_t(img._spectrum);
+		if(img._spectrum < 3)
+		{
+			//every step is a lut, so each layer gets one composed table
+			std::vector<fused_lut> layers(img._spectrum);
+			for(auto const& step : steps)
+			{
+				auto const num_layers = step.all_layers ? layers.size() : std::min<std::size_t>(1, layers.size());
+				for(std::size_t s = 0; s < num_layers; ++s)
+				{
+					layers[s].add(step);
+				}
+			}
+			std::vector<char> active(layers.size());
+			std::transform(layers.begin(), layers.end(), active.begin(), [](fused_lut const& lut)
+				{
+					return lut.does_anything();
+				});
+			bool const edited = process_strips(img._height, row_bytes, [&](unsigned int top, unsigned int bottom)
+				{
+					bool edited = false;
+					auto const begin = img._width * std::size_t(top);
+					auto const end = img._width * std::size_t(bottom);
+					for(std::size_t s = 0; s < layers.size(); ++s)
+					{
+						if(!active[s])
+						{
+							continue;
+						}
+						auto const& lut = layers[s];
+						auto const data = img._data + s * size;
+						for(std::size_t i = begin; i < end; ++i)
+						{
+							auto const v = data[i];
+							edited |= lut.touched[v];
+							data[i] = lut.table[v];
+						}
+					}
+					return edited;
+				});
+			return edited || always_edits;
+		}
+		//color images: runs of luts are composed, brightness filters are done between them
+		struct color_op {
+			bool is_lut;
+			fused_lut lut;
+			pixel_step const* filter;
+		};
+		std::vector<color_op> ops;
+		for(auto const& step : steps)
+		{
+			if(step.type == pixel_step::lut)
+			{
+				if(ops.empty() || !ops.back().is_lut)
+				{
+					ops.push_back({true,{},nullptr});
+				}
+				ops.back().lut.add(step);
+			}
+			else
+			{
+				ops.push_back({false,{},&step});
+			}
+		}
+		bool const edited = process_strips(img._height, row_bytes, [&](unsigned int top, unsigned int bottom)
+			{
+				bool edited = false;
+				auto const red = img._data;
+				auto const green = red + size;
+				auto const blue = green + size;
+				auto const end = img._width * std::size_t(bottom);
+				for(std::size_t i = img._width * std::size_t(top); i < end; ++i)
+				{
+					std::array<unsigned char, 3> color{red[i],green[i],blue[i]};
+					for(auto const& op : ops)
+					{
+						if(op.is_lut)
+						{
+							edited |= op.lut.touched[color[0]] | op.lut.touched[color[1]] | op.lut.touched[color[2]];
+							color = {op.lut.table[color[0]],op.lut.table[color[1]],op.lut.table[color[2]]};
+						}
+						else if(color != op.filter->replacer)
+						{
+							auto const brightness = (float(color[0]) + color[1] + color[2]) / 3.0f;
+							if(brightness >= op.filter->lower && brightness <= op.filter->upper)
+							{
+								edited = true;
+								color = op.filter->replacer;
+							}
+						}
+					}
+					red[i] = color[0];
+					green[i] = color[1];
+					blue[i] = color[2];
+				}
+				return edited;
+			});
+		return edited || always_edits;
+	}
+
+	std::string FusedProcess::description() const
+	{
+		std::string desc("Fused ");
+		for(std::size_t i = 0; i < parts.size(); ++i)
+		{
+			if(i)
+			{
+				desc.append(", ");
+			}
+			desc.append(parts[i]->name());
+		}
+		desc.append(" into one pass");
+		return desc;
+	}
+
+	std::vector<std::string> fuse_pixel_processes(ProcessList<unsigned char>& pl)
+	{
+		std::vector<std::string> fusions;
+		std::vector<std::unique_ptr<ImageProcess<>>> processes;
+		std::vector<std::unique_ptr<FusableProcess>> run;
+		auto end_run = [&]()
+		{
+			if(run.size() == 1)
+			{
+				processes.push_back(std::move(run.back()));
+			}
+			else if(run.size() > 1)
+			{
+				auto fused = std::make_unique<FusedProcess>(std::move(run));
+				fusions.push_back(fused->description());
+				processes.push_back(std::move(fused));
+			}
+			run.clear();
+		};
+		for(auto& process : pl)
+		{
+			if(dynamic_cast<FusableProcess*>(process.get()))
+			{
+				run.emplace_back(static_cast<FusableProcess*>(process.release()));
+			}
+			else
+			{
+				end_run();
+				processes.push_back(std::move(process));
+			}
+		}
+		end_run();
+		pl.clear();
+		for(auto& process : processes)
+		{
+			pl.push_back(std::move(process));
+		}
+		return fusions;
+	}
+
+	void FilterHSV::check(Img const& img) const
+	{
+		if(img._spectrum < 3)
 		{
 			throw std::invalid_argument("Color (3+ spectrum) image required");
 		}
 	}
 
+	bool FilterHSV::process_rows(Img& img, unsigned int top, unsigned int bottom) const
+	{
+		return replace_by_hsv(img, start, end, replacer, top, bottom);
+	}
+
+	void FilterRGB::check(Img const& img) const
+	{
+		if(img._spectrum < 3)
+		{
+			throw std::invalid_argument("Color (3+ spectrum) image required");
+		}
+	}
+
+	bool FilterRGB::process_rows(Img& img, unsigned int top, unsigned int bottom) const
+	{
+		return replace_by_rgb(img, start, end, replacer, top, bottom);
+	}
+
 	bool PadHoriz::process(Img& img) const
 	{
 		std::array<unsigned int, 2> dims{{img._width,img._height}};
@@ -174,85 +473,39 @@ namespace ScoreProcessor {
 			auto brightness = static_cast<unsigned int>(v[0]) + v[1] + v[2];
 			return brightness >= smn && brightness <= smx;
 		};
-		auto clear_base = [this, &img](auto func)
+		auto clear = [this](cluster_stats const& c)
 		{
-			return [this, &img, func](Cluster const& c)
+			if(c.area >= min_size && c.area <= max_size)
 			{
-				auto const size = c.size();
-				if(size >= min_size && size <= max_size)
-				{
-					return true;
-				}
-				if(sel_min >= required_min && sel_max <= required_max)
-				{
-					return false;
-				};
-				for(auto rect : c.get_ranges())
-				{
-					for(unsigned int y = rect.top; y < rect.bottom; ++y)
-					{
-						auto row = img._data + y * img._width;
-						for(unsigned int x = rect.left; x < rect.right; ++x)
-						{
-							auto pix = row + x;
-							if(func(pix))
-							{
-								return false;
-							}
-						}
-					}
-				}
 				return true;
-			};
-		};
-		auto grayscale_clear = clear_base([rmn = required_min, rmx = required_max](unsigned char const* pix)
-			{
-				return *pix >= rmn && *pix <= rmx;
-			});
-		auto color_clear = clear_base([rmn = 3U * required_min, rmx = 3U * required_max, img_size = size_t{img._height}*img._width](unsigned char const* pix)
-		{
-			unsigned int brightness = 0;
-			for(int s = 0; s < 3; ++s)
-			{
-				brightness += *(pix + s * img_size);
 			}
-			return brightness >= rmn && brightness <= rmx;
-		});
-		if(!eight)
+			return c.required == 0;
+		};
+		if(img._spectrum < 3)
 		{
-			if(img._spectrum < 3)
-			{
-				return clear_clusters(img, std::array<unsigned char, 1>({background}), grayscale_sel, grayscale_clear);
-			}
-			else
-			{
-				return clear_clusters(img, std::array<unsigned char, 3>({background,background,background}), color_sel, color_clear);
-			}
+			auto const labeled = label_clusters<1>(img, grayscale_sel, required_min, required_max, eight);
+			return clear_labeled(img, labeled, std::array<unsigned char, 1>({background}), clear);
 		}
 		else
 		{
-			if(img._spectrum < 3)
-			{
-				return clear_clusters_8way(img, std::array<unsigned char, 1>({background}), grayscale_sel, grayscale_clear);
-			}
-			else
-			{
-				return clear_clusters_8way(img, std::array<unsigned char, 3>({background,background,background}), color_sel, color_clear);
-			}
+			auto const labeled = label_clusters<3>(img, color_sel, 3U * required_min, 3U * required_max, eight);
+			return clear_labeled(img, labeled, std::array<unsigned char, 3>({background,background,background}), clear);
 		}
 	}
 
-	bool RescaleGray::process(Img& img) const
+	bool RescaleGray::process_rows(Img& img, unsigned int top, unsigned int bottom) const
 	{
 		if(img._spectrum < 3)
 		{
-			rescale_colors(img, min, mid, max);
+			rescale_colors(img, min, mid, max, top, bottom);
 		}
 		else
 		{
-			rescale_colors(img, min, mid, max);
-			rescale_colors(img.get_shared_channel(1), min, mid, max);
-			rescale_colors(img.get_shared_channel(2), min, mid, max);
+			rescale_colors(img, min, mid, max, top, bottom);
+			auto green = img.get_shared_channel(1);
+			rescale_colors(green, min, mid, max, top, bottom);
+			auto blue = img.get_shared_channel(2);
+			rescale_colors(blue, min, mid, max, top, bottom);
 		}
 		return true;
 	}
@@ -371,9 +624,60 @@ namespace ScoreProcessor {
 		return true;
 	}
 
+	static std::string deskew_report_message(deskew_report const& rep, unsigned int downscale, float angle)
+	{
+		std::string out = "Straighten: cast ";
+		out += std::to_string(rep.coarse_votes + rep.fine_votes);
+		out += " votes (";
+		out += std::to_string(rep.coarse_votes);
+		out += " at 1/";
+		out += std::to_string(downscale);
+		out += " scale over ";
+		out += std::to_string(rep.coarse_steps);
+		out += " steps, ";
+		out += std::to_string(rep.fine_votes);
+		out += " at full scale over ";
+		out += std::to_string(rep.fine_steps);
+		out += " steps) vs ";
+		out += std::to_string(rep.direct_votes);
+		out += " over ";
+		out += std::to_string(rep.direct_steps);
+		out += " steps direct; took ";
+		out += std::to_string(rep.seconds);
+		out += "s vs ";
+		out += std::to_string(rep.direct_seconds);
+		out += "s direct, saved ";
+		out += std::to_string(rep.direct_seconds - rep.seconds);
+		out += "s; angle ";
+		out += std::to_string(angle * RAD_DEG);
+		out += " vs ";
+		out += std::to_string(rep.direct_angle * RAD_DEG);
+		out += " direct\n";
+		return out;
+	}
+
 	bool Straighten::process(Img& img) const
 	{
-		auto angle = find_angle_bare(img, pixel_prec, min_angle, max_angle, num_steps, boundary, use_horiz);
+		return process_logged(img, nullptr, 0);
+	}
+
+	bool Straighten::process_logged(Img& img, Log* log, size_t id) const
+	{
+		float angle;
+		if(downscale > 1)
+		{
+			deskew_report rep;
+			bool const reporting = report && log;
+			angle = find_angle_downscaled(img, pixel_prec, min_angle, max_angle, num_steps, downscale, boundary, use_horiz, reporting ? &rep : nullptr);
+			if(reporting)
+			{
+				log->log(deskew_report_message(rep, downscale, angle), id);
+			}
+		}
+		else
+		{
+			angle = find_angle_bare(img, pixel_prec, min_angle, max_angle, num_steps, boundary, use_horiz, coarse_steps);
+		}
 		if(angle == 0)
 		{
 			return false;
@@ -390,9 +694,9 @@ namespace ScoreProcessor {
 		return true;
 	}
 
-	bool Gamma::process(Img& img) const
+	bool Gamma::process_rows(Img& img, unsigned int top, unsigned int bottom) const
 	{
-		apply_gamma(img, gamma);
+		apply_gamma(img, gamma, top, bottom);
 		return true;
 	}
 
@@ -650,11 +954,7 @@ namespace ScoreProcessor {
 	}
 	bool TemplateMatchErase::process(Img& img) const
 	{
-		auto rects = global_select<1>(img, [](std::array<unsigned char, 1> val)
-			{
-				return val[0] != 255;
-			});
-		auto clusters = Cluster::cluster_ranges(rects);
+		auto clusters = select_clusters(BitImage(img, 255));
 		return cluster_template_match_erase(img, clusters, this->tmplt, this->threshold);
 	}
 	bool SlidingTemplateMatchEraseExact::process(Img& img) const
@@ -664,57 +964,104 @@ namespace ScoreProcessor {
 			cil::CImg(img, true) :
 			integral_downscale(img, downscaling, region);
 		//downsized.display();
-		using Gray = std::array<unsigned char, 1>;
+		std::vector<float> thresholds;
+		thresholds.reserve(downsized_tmplts.size());
+		for(auto const& downsized_tmplt : downsized_tmplts)
+		{
+			thresholds.push_back((1 - threshold) * downsized_tmplt._width * downsized_tmplt._height);
+		}
+		auto const matches = template_ssd_minima(downsized, downsized_tmplts, thresholds);
 		bool found = false;
-		for(std::size_t i = 0; i < downsized_tmplts.size(); ++i)
+		for(std::size_t i = 0; i < matches.size(); ++i)
 		{
-			auto& downsized_tmplt = downsized_tmplts[i];
-			auto counts = sliding_template_match<1, float>(downsized, downsized_tmplt, [](Gray t, Gray i)
-				{
-					return ImageUtils::gray_diff({t[0]}, {i[0]});
-				});
-			auto const real_threshold = (1 - threshold) * downsized_tmplt._width * downsized_tmplt._height;
-			//unsigned char white[]={255,255,255,255};
-			//counts.display();
 			auto& tmplt = tmplts[i];
-			find_local_min_below_thresh(counts, real_threshold, [&](unsigned int x, unsigned int y)
-				{
-					found = true;
-					auto point = downscaling * ImageUtils::PointUINT{x,y}+region.top_left();
-					replacer(img, tmplt, point);
-				});
+			for(auto const match : matches[i])
+			{
+				found = true;
+				auto point = downscaling * match + region.top_left();
+				replacer(img, tmplt, point);
+			}
 		}
 		return found;
 	}
 
 	bool PyramidTemplateErase::process(Img& img) const
 	{
-		auto const smallest = get_downscale(img, scales[0]);
-		using Gray = std::array<unsigned char, 1>;
-		std::vector<unsigned char> downscale_buffer;
-		std::vector<ImageUtils::PointUINT> valid_points;
-		decltype(valid_points) valid_points_buff;
-		for(size_t i = 0; i < num_images; ++i)
-		{
-			auto& smallest_template = tmplts[i * (scales.size() + 1)];
-			auto counts = sliding_template_match<1, float>(smallest, tmplts[i * (scales.size() + 1)], [](Gray t, Gray i)
-				{
-					return ImageUtils::gray_diff({t[0]}, {i[0]});
-				});
-			auto const real_threshold = (1 - threshold) * smallest_template._width * smallest_template._height;
-			find_local_min_below_thresh(counts, real_threshold, [&](unsigned int x, unsigned int y)
+		//levels run from the coarsest scale to the image itself
+		std::vector<cil::CImg<unsigned char>> levels;
+		levels.reserve(scales.size()+1);
+		for(auto const scale:scales)
+		{
+			levels.push_back(get_downscale(img, scale));
+		}
+		levels.emplace_back(img, true);
+		auto const level_scale = [this](std::size_t j)
+		{
+			return j < scales.size() ? scales[j] : 1U;
+		};
+		auto const level_threshold = [this](cil::CImg<unsigned char> const& tmplt)
+		{
+			return (1 - threshold) * tmplt._width * tmplt._height;
+		};
+		bool found = false;
+		std::vector<ImageUtils::PointUINT> candidates;
+		decltype(candidates) refined;
+		for(std::size_t i = 0; i < num_images; ++i)
+		{
+			auto const first = i * (scales.size() + 1);
+			candidates.clear();
+			auto const& coarse_template = tmplts[first];
+			auto const counts = sliding_template_ssd(levels[0], coarse_template);
+			find_local_min_below_thresh(counts, level_threshold(coarse_template), [&](unsigned int x, unsigned int y)
 				{
-					valid_points.push_back({x,y});
+					candidates.push_back({x,y});
 				});
-			for(size_t j = 1; j < scales.size(); ++j)
+			//each candidate is only rescored in the neighborhood its coarser point covers
+			for(std::size_t j = 1; j < levels.size() && !candidates.empty(); ++j)
 			{
-
+				auto const& level = levels[j];
+				auto const& tmplt = tmplts[first + j];
+				auto const ratio = level_scale(j - 1) / level_scale(j);
+				auto const real_threshold = level_threshold(tmplt);
+				refined.clear();
+				for(auto const point : candidates)
+				{
+					auto const cx = point.x * ratio;
+					auto const cy = point.y * ratio;
+					ImageUtils::RectangleUINT const region{
+						cx < ratio ? 0 : cx - ratio,cx + ratio + 1,
+						cy < ratio ? 0 : cy - ratio,cy + ratio + 1};
+					auto const scores = sliding_template_ssd(level, tmplt, region);
+					if(scores.is_empty())
+					{
+						continue;
+					}
+					auto const best = std::min_element(scores.begin(), scores.end());
+					if(*best <= real_threshold)
+					{
+						unsigned int const offset = unsigned int(best - scores.begin());
+						refined.push_back({region.left + offset % scores._width,region.top + offset / scores._width});
+					}
+				}
+				//neighboring coarse points can settle on the same fine point
+				std::sort(refined.begin(), refined.end(), [](auto a, auto b)
+					{
+						return a.y < b.y || (a.y == b.y && a.x < b.x);
+					});
+				refined.erase(std::unique(refined.begin(), refined.end(), [](auto a, auto b)
+					{
+						return a.x == b.x && a.y == b.y;
+					}), refined.end());
+				candidates.swap(refined);
 			}
-			for(auto const point : valid_points)
+			auto const& tmplt = tmplts[first + scales.size()];
+			for(auto const point : candidates)
 			{
-				replacer(img, tmplts[(i + 1) * (scales.size() + 1) - 1], point);
+				found = true;
+				replacer(img, tmplt, point);
 			}
 		}
+		return found;
 	}
 
 	bool RemoveEmptyLines::process(Img& img) const
@@ -779,24 +1126,20 @@ namespace ScoreProcessor {
 
 	bool ClusterWiden::process(Img& img) const
 	{
-		auto const rects = global_select<1>(img, [this](std::array<unsigned char, 1> pixel)
+		auto const clusters = label_clusters<1>(img, [this](std::array<unsigned char, 1> pixel)
 			{
 				return (pixel[0] >= _lower_bound) && (pixel[0] <= _upper_bound);
-			});
-		if(rects.empty())
+			}).clusters;
+		if(clusters.empty())
 		{
 			return false;
 		}
-		auto const clusters = Cluster::cluster_ranges(rects);
-		auto largest = clusters.begin();
-		auto largest_bbox = largest->bounding_box();
-		for(auto it = next(largest); it != clusters.end(); ++it)
+		auto largest_bbox = clusters.front().bounding_box;
+		for(auto const& cluster : clusters)
 		{
-			auto const bbox = it->bounding_box();
-			if(bbox.width() > largest_bbox.width())
+			if(cluster.bounding_box.width() > largest_bbox.width())
 			{
-				largest = it;
-				largest_bbox = bbox;
+				largest_bbox = cluster.bounding_box;
 			}
 		}
 		auto const rescale_ratio = float(_widen_to) / float(largest_bbox.width());
@@ -812,51 +1155,72 @@ namespace ScoreProcessor {
 		return false;
 	}
 
-	bool Invert::process(Img& img) const
+	bool Invert::process_rows(Img& img, unsigned int top, unsigned int bottom) const
 	{
-		auto const size = [&img]() -> std::size_t
+		auto const num_layers = [&img]() -> unsigned int
 		{
 			switch (img._spectrum)
 			{
 			case 1:
 			case 2:
-				return img._width * std::size_t(img._height);
+				return 1;
 			case 3:
 			case 4:
-				return img._width * std::size_t(img._height) * 3;
+				return 3;
 			default:
 				return 0;
 			}
 		}();
-		auto const data = img.data();
-		for(std::size_t i = 0; i < size; ++i)
+		auto const size = img._width * std::size_t(img._height);
+		auto const begin = img._width * std::size_t(top);
+		auto const end = img._width * std::size_t(bottom);
+		for(unsigned int s = 0; s < num_layers; ++s)
 		{
-			data[i] = ~data[i];
+			auto const data = img.data() + s * size;
+			for(std::size_t i = begin; i < end; ++i)
+			{
+				data[i] = ~data[i];
+			}
 		}
 		return true;
 	}
 
 	bool WhiteToTransparent::process(Img& img) const
 	{
-		switch(img._spectrum)
+		using uchar = unsigned char;
+		if(img._spectrum != 1 && img._spectrum != 3)
 		{
-			using uchar = unsigned char;
-		case 1:
-			img = cil::get_map<1>(img, [](std::array<uchar, 1> color)
-				{
-					return exlib::make_array<uchar>(0, 0, 0, 255 - color[0]);
-				});
-			break;
-		case 3:
-			img = cil::get_map<3>(img, [](std::array<uchar, 3> color)
-				{
-					uchar const brightness = ImageUtils::brightness({color[0], color[1], color[2]});
-					return exlib::make_array<uchar>(0, 0, 0, 255 - brightness);
-				});
-			break;
-		default:
 			return false;
 		}
+		Img ret(img._width, img._height, 1, 4);
+		std::size_t const size = img._width * std::size_t(img._height);
+		//color layers are all 0, only the alpha depends on the image
+		std::memset(ret._data, 0, 3 * size);
+		auto const alpha = ret._data + 3 * size;
+		auto const in = img._data;
+		size_t const row_bytes = size_t(img._width) * (img._spectrum + 4);
+		process_strips(img._height, row_bytes, [&, spectrum = img._spectrum](unsigned int top, unsigned int bottom)
+			{
+				auto const begin = img._width * std::size_t(top);
+				auto const end = img._width * std::size_t(bottom);
+				if(spectrum == 1)
+				{
+					for(std::size_t i = begin; i < end; ++i)
+					{
+						alpha[i] = 255 - in[i];
+					}
+				}
+				else
+				{
+					for(std::size_t i = begin; i < end; ++i)
+					{
+						uchar const brightness = ImageUtils::brightness({in[i], in[i + size], in[i + 2 * size]});
+						alpha[i] = 255 - brightness;
+					}
+				}
+				return true;
+			});
+		img = std::move(ret);
 		return true;
 	}
 
@@ -1074,23 +1438,12 @@ namespace ScoreProcessor {
 		return true;
 	}
 
-	template<typename T>
-	constexpr T saturated_subtract(T a, T b)
-	{
-		if (b >= a)
-		{
-			return T{};
-		}
-		return a - b;
-	}
-
 	bool MedianAdaptiveThreshold::process(Img& img) const
 	{
 		if (img._width == 0 || img._height == 0 || img._spectrum == 0 || img._spectrum > 4)
 		{
 			return false;
 		}
-		std::array<unsigned int, 256> histogram{};
 		auto const gray_image = [&img, gamma = _gamma]()
 		{
 			if (gamma != 1)
@@ -1119,7 +1472,8 @@ namespace ScoreProcessor {
 				switch (img._spectrum)
 				{
 				case 1:
-					return img;
+					//the medians are all found before any pixel is replaced, so the image can be read in place
+					return cil::CImg(img, true);
 				case 2:
 					return cil::get_map<1>(img, [](std::array<unsigned char, 1> color)
 										   {
@@ -1135,127 +1489,25 @@ namespace ScoreProcessor {
 			}
 			return cil::CImg(img, true);
 		}();
-		auto const hwidth = _window_width / 2;
-		auto const hheight = _window_height / 2;
-		auto const hwidth_inv = _window_width - hwidth;
-		auto const hheight_inv = _window_height - hheight;
-		unsigned int window_left = 0;
-		unsigned int window_top = 0;
-		unsigned int window_right = std::min(hwidth_inv, img._width);
-		unsigned int window_bottom = std::min(hheight_inv, img._height);
-		for (unsigned int y = 0; y < window_bottom; ++y)
-		{
-			for (unsigned int x = 0; x < window_right; ++x)
-			{
-				++histogram[gray_image(x, y)];
-			}
-		}
-		auto const find_median = [&]()
-		{
-			auto const window_size = std::size_t(window_right - window_left) * (window_bottom - window_top);
-			auto const threshold = window_size / 2;
-			std::size_t count = 0;
-			for (std::size_t i = 0; i < histogram.size(); ++i)
-			{
-				count += histogram[i];
-				if (count >= threshold)
-				{
-					return (unsigned char)i;
-				}
-			}
-			return (unsigned char)255;
-		};
+		auto const medians = sliding_median(gray_image, _window_width, _window_height);
 		bool changed = false;
-		auto const color_pixel = [&](unsigned int x, unsigned int y)
-		{
-			changed = true;
-			img(x, y) = _replacer;
-			if (img._spectrum >= 3)
-			{
-				img(x, y, 0, 1) = _replacer;
-				img(x, y, 0, 2) = _replacer;
-			}
-		};
-		for (unsigned int x = 0; x < img._width; ++x)
+		for (unsigned int y = 0; y < img._height; ++y)
 		{
-			if (x & 1)
+			auto const gray_row = gray_image.data(0, y);
+			auto const median_row = medians.data(0, y);
+			for (unsigned int x = 0; x < img._width; ++x)
 			{
-				for (unsigned int y = img._height; y-- > 0;)
+				if (gray_row[x] > exlib::clamp<unsigned char>(_median_adjustment + median_row[x]))
 				{
-					auto const wt_new = saturated_subtract(y, hheight);
-					if (wt_new != window_top)
-					{
-						for (unsigned int x2 = window_left; x2 < window_right; ++x2)
-						{
-							++histogram[gray_image(x2, wt_new)];
-						}
-						window_top = wt_new;
-					}
-					auto const wb_new = std::min(img._height, y + hheight_inv);
-					if (wb_new != window_bottom)
-					{
-						for (unsigned int x2 = window_left; x2 < window_right; ++x2)
-						{
-							--histogram[gray_image(x2, wb_new)];
-						}
-						window_bottom = wb_new;
-					}
-					auto const median = exlib::clamp<unsigned char>(_median_adjustment + find_median());
-					if (gray_image(x, y) > median)
+					changed = true;
+					img(x, y) = _replacer;
+					if (img._spectrum >= 3)
 					{
-						color_pixel(x, y);
+						img(x, y, 0, 1) = _replacer;
+						img(x, y, 0, 2) = _replacer;
 					}
 				}
 			}
-			else
-			{
-				for (unsigned int y = 0; y < img._height; ++y)
-				{
-					auto const wt_new = saturated_subtract(y, hheight);
-					if (wt_new != window_top)
-					{
-						for (unsigned int x2 = window_left; x2 < window_right; ++x2)
-						{
-							--histogram[gray_image(x2, window_top)];
-						}
-						window_top = wt_new;
-					}
-					auto const wb_new = std::min(img._height, y + hheight_inv);
-					if (wb_new != window_bottom)
-					{
-						for (unsigned int x2 = window_left; x2 < window_right; ++x2)
-						{
-							++histogram[gray_image(x2, window_bottom)];
-						}
-						window_bottom = wb_new;
-					}
-					auto const median = exlib::clamp<unsigned char>(_median_adjustment + find_median());
-					if (gray_image(x, y) > median)
-					{
-						color_pixel(x, y);
-					}
-				}
-			}
-			{
-				auto const wl_new = saturated_subtract(x, hwidth);
-				if (wl_new != window_left)
-				{
-					for (unsigned int y = window_top; y < window_bottom; ++y)
-					{
-						--histogram[gray_image(window_left, y)];
-					}
-					window_left = wl_new;
-				}
-			}
-			auto const wr_new = std::min(img._width, x + hwidth_inv);
-			if (wr_new != window_right)
-			{
-				for (unsigned int y = window_top; y < window_bottom; ++y)
-				{
-					++histogram[gray_image(window_right, y)];
-				}
-				window_right = wr_new;
-			}
 		}
 		return changed;
 	}
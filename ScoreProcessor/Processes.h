@@ -30,32 +30,101 @@ namespace ScoreProcessor {
 		bool process(Img& img) const override;
 	};
 
-	class FilterGray:public ImageProcess<> {
+	/*
+		A process that works on each pixel on its own,
+		so the image can be split into horizontal strips that are processed at the same time.
+	*/
+	class TileableProcess:public ImageProcess<> {
+	protected:
+		//throws if the process can not be done on the image; called once before the strips are processed
+		virtual void check(Img const& img) const
+		{}
+	public:
+		//processes rows [top,bottom) of the image, returns true if they have been modified
+		virtual bool process_rows(Img& img,unsigned int top,unsigned int bottom) const=0;
+		bool process(Img& img) const override;
+	};
+
+	/*
+		One step of a per-pixel process, written as a lookup table or a brightness filter,
+		so that runs of these processes can be fused into a single pass.
+	*/
+	struct pixel_step {
+		enum step_type {
+			lut, //table applied to each value
+			brightness_filter //replaces colors whose brightness is in [lower,upper], color images only
+		};
+		step_type type;
+		bool all_layers; //lut applies to every layer instead of just the color layers
+		bool conditional; //only counts as editing the image if a value is changed
+		std::array<unsigned char,256> table;
+		unsigned char lower,upper;
+		std::array<unsigned char,3> replacer;
+	};
+
+	/*
+		A per-pixel process that can describe itself as pixel_steps.
+	*/
+	class FusableProcess:public TileableProcess {
+	public:
+		//adds the steps this process does to an image with the given spectrum
+		virtual void add_steps(unsigned int spectrum,std::vector<pixel_step>& steps) const=0;
+		virtual char const* name() const=0;
+	};
+
+	/*
+		Does consecutive FusableProcesses in a single pass over the image.
+	*/
+	class FusedProcess:public ImageProcess<> {
+		std::vector<std::unique_ptr<FusableProcess>> parts;
+	public:
+		inline FusedProcess(std::vector<std::unique_ptr<FusableProcess>> parts):parts(std::move(parts))
+		{}
+		bool process(Img& img) const override;
+		std::string description() const;
+	};
+
+	/*
+		Replaces each run of two or more FusableProcesses in the list with a FusedProcess.
+		Returns a description of each fusion.
+	*/
+	std::vector<std::string> fuse_pixel_processes(ProcessList<unsigned char>& pl);
+
+	class FilterGray:public FusableProcess {
 		unsigned char min;
 		unsigned char max;
 		unsigned char replacer;
 	public:
 		inline FilterGray(unsigned char min,unsigned char max,unsigned char replacer):min(min),max(max),replacer(replacer)
 		{}
-		bool process(Img& img) const override;
+		bool process_rows(Img& img,unsigned int top,unsigned int bottom) const override;
+		void add_steps(unsigned int spectrum,std::vector<pixel_step>& steps) const override;
+		inline char const* name() const override
+		{
+			return "Filter Gray";
+		}
 	};
 
-	class FilterHSV:public ImageProcess<> {
+	class FilterHSV:public TileableProcess {
 		ImageUtils::ColorHSV start,end;
 		ImageUtils::ColorRGB replacer;
 	public:
 		inline FilterHSV(ImageUtils::ColorHSV start,ImageUtils::ColorHSV end,ImageUtils::ColorRGB replacer):start(start),end(end),replacer(replacer)
 		{}
-		bool process(Img& img) const override;
+		bool process_rows(Img& img,unsigned int top,unsigned int bottom) const override;
+	protected:
+		void check(Img const& img) const override;
 	};
 
-	class FilterRGB:public ImageProcess<> {
+	class FilterRGB:public TileableProcess {
 		ImageUtils::ColorRGB start,end;
 		ImageUtils::ColorRGB replacer;
 	public:
 		inline FilterRGB(ImageUtils::ColorRGB start,ImageUtils::ColorRGB end,ImageUtils::ColorRGB replacer):start(start),end(end),replacer(replacer)
 		{}
-		bool process(Img& img) const override;
+		bool process_rows(Img& img,unsigned int top,unsigned int bottom) const override;
+	protected:
+		void check(Img const& img) const override;
 	};
 
 	class PadBase:public ImageProcess<> {
@@ -176,12 +245,17 @@ namespace ScoreProcessor {
 		bool process(Img& img) const override;
 	};
 
-	class RescaleGray:public ImageProcess<> {
+	class RescaleGray:public FusableProcess {
 		unsigned char min,mid,max;
 	public:
 		inline RescaleGray(unsigned char min,unsigned char mid,unsigned char max=255):min(min),mid(mid),max(max)
 		{}
-		bool process(Img& img) const override;
+		bool process_rows(Img& img,unsigned int top,unsigned int bottom) const override;
+		void add_steps(unsigned int spectrum,std::vector<pixel_step>& steps) const override;
+		inline char const* name() const override
+		{
+			return "Rescale Gray";
+		}
 	};
 
 	class FillRectangle:public ImageProcess<> {
@@ -219,14 +293,26 @@ namespace ScoreProcessor {
 		unsigned char boundary;
 		float gamma;
 		bool use_horiz;
-	public:
-		inline Straighten(double pixel_prec,double min_angle,double max_angle,double angle_prec,unsigned char boundary,float gamma,bool use_horiz)
+		unsigned int coarse_steps;
+		unsigned int downscale;
+		bool report;
+	public:
+		/*
+			coarse_prec of 0 searches every angle step directly.
+			downscale above 1 estimates the angle on a downscaled copy first and takes precedence over coarse_prec.
+			report logs the pixels evaluated and the time against a direct search, which it also runs,
+			when the image is processed with a log.
+		*/
+		inline Straighten(double pixel_prec,double min_angle,double max_angle,double angle_prec,unsigned char boundary,float gamma,bool use_horiz,double coarse_prec=0,unsigned int downscale=1,bool report=false)
 			:pixel_prec(pixel_prec),
 			min_angle(M_PI_2+min_angle*DEG_RAD),max_angle(M_PI_2+max_angle*DEG_RAD),
 			num_steps(std::ceil((max_angle-min_angle)/angle_prec)),
-			boundary(boundary),gamma(gamma),use_horiz(use_horiz)
+			boundary(boundary),gamma(gamma),use_horiz(use_horiz),
+			coarse_steps(coarse_prec>angle_prec?unsigned int(std::ceil((max_angle-min_angle)/coarse_prec)):0),
+			downscale(downscale),report(report)
 		{}
 		bool process(Img& img) const override;
+		bool process_logged(Img& img,Log* log,size_t id) const override;
 	};
 
 	class Rotate:public ImageProcess<> {
@@ -244,12 +330,17 @@ namespace ScoreProcessor {
 		bool process(Img& img) const override;
 	};
 
-	class Gamma:public ImageProcess<> {
+	class Gamma:public FusableProcess {
 		float gamma;
 	public:
 		inline Gamma(float g):gamma(g)
 		{}
-		bool process(Img& img) const override;
+		bool process_rows(Img& img,unsigned int top,unsigned int bottom) const override;
+		void add_steps(unsigned int spectrum,std::vector<pixel_step>& steps) const override;
+		inline char const* name() const override
+		{
+			return "Gamma";
+		}
 	};
 
 	class ThreadOverride:public ImageProcess<> {
@@ -382,8 +473,8 @@ namespace ScoreProcessor {
 			{
 				throw std::invalid_argument("At least 1 scale required");
 			}
-			scales.erase(std::unique(scales.begin(),scales.end()),scales.end());
 			std::sort(scales.begin(),scales.end(),std::greater<>{});
+			scales.erase(std::unique(scales.begin(),scales.end()),scales.end());
 			for(auto const scale:scales)
 			{
 				if(scale==0)
@@ -412,7 +503,7 @@ namespace ScoreProcessor {
 			scales(std::move(scale_factors)),num_images{n},threshold{threshold},replacer{std::move(replacer)}
 		{
 			verify_scales();
-			tmplts.reserve(n*scales.size());
+			tmplts.reserve(n*(scales.size()+1));
 			std::unique_ptr<char[]> string_buffer(new char[std::max_element(tmplt_names,tmplt_names+n,[](auto a,auto b)
 				{
 					return a.size()<b.size();
@@ -421,7 +512,7 @@ namespace ScoreProcessor {
 			{
 				auto const name=tmplt_names[i];
 				std::memcpy(string_buffer.get(),name.data(),name.size());
-				string_buffer[name.size()]=='\0';
+				string_buffer[name.size()]='\0';
 				cil::CImg<unsigned char> orig(string_buffer.get());
 				for(size_t j=0;j<scales.size();++j)
 				{
@@ -499,10 +590,15 @@ namespace ScoreProcessor {
 		bool process(Img&) const override;
 	};
 
-	class Invert:public ImageProcess<> {
+	class Invert:public FusableProcess {
 	public:
 		Invert() {}
-		bool process(Img&) const override;
+		bool process_rows(Img&,unsigned int top,unsigned int bottom) const override;
+		void add_steps(unsigned int spectrum,std::vector<pixel_step>& steps) const override;
+		inline char const* name() const override
+		{
+			return "Invert";
+		}
 	};
 
 	class WhiteToTransparent:public ImageProcess<> {
@@ -32,8 +32,10 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 #include "lib/exstring/exalg.h"
 #include <atomic>
 #include <mutex>
-#include "lib/threadpool/thread_pool.h"
 #include <numeric>
+#include <chrono>
+#include "PixelKernels.h"
+#include "TemplateMatch.h"
 using namespace std;
 using namespace ImageUtils;
 using namespace cimg_library;
@@ -48,21 +50,11 @@ namespace ScoreProcessor {
 		unsigned int empty_line_count=0;
 		auto const size=std::size_t{img._width}*img._height;
 		bool changed=false;
-		auto is_line_foreground=[&img,max_presence](unsigned int y)
+		//rows are only moved up after they have been read, so the dark pixels can be counted from the rows as they start
+		BitImage const dark(img,128);
+		auto is_line_foreground=[&dark,max_presence](unsigned int y)
 		{
-			auto const row=&img(0,y);
-			unsigned int background_count=0;
-			for(unsigned int x=0;x<img._width;++x)
-			{
-				if(/*detector(row+x)*/row[x]<128)
-				{
-					if(++background_count>max_presence)
-					{
-						return true;
-					}
-				}
-			}
-			return false;
+			return dark.count_row(y)>max_presence;
 		};
 		auto in_empty_region=!is_line_foreground(0);
 		unsigned int space;
@@ -163,14 +155,7 @@ namespace ScoreProcessor {
 		};
 		cil::CImg<char> safe_points;
 		{
-			auto const clusters=[&img,background_threshold]()
-			{
-				auto const rects=global_select<1>(img,[=](std::array<unsigned char,1> color)
-					{
-						return color[0]<background_threshold;
-					});
-				return Cluster::cluster_ranges_8way(rects);
-			}();
+			auto const clusters=select_clusters(BitImage(img,background_threshold),true);
 			if(clusters.size()==0)
 			{
 				return false;
@@ -656,10 +641,7 @@ namespace ScoreProcessor {
 				auto& pixel=(counts(x,y)=0);
 				for(unsigned int y1=0;y1<y_max;++y1)
 				{
-					for(unsigned int x1=0;x1<x_max;++x1)
-					{
-						pixel+=img(x+x1,y+y1)==tmplt(x1,y1);
-					}
+					pixel+=CountType(kernels::count_equal(&img(x,y+y1),&tmplt(0,y1),x_max));
 				}
 			}
 		}
@@ -713,19 +695,8 @@ namespace ScoreProcessor {
 			auto const ltx=bb.left;
 			auto const lty=bb.top;
 			//std::cout<<ltx<<' '<<lty<<'\n';
-			float match=0;
-			auto const y_max=std::min(img._height,lty+tmplt._height);
-			auto const x_max=std::min(img._width,ltx+tmplt._width);
-			auto const y_end=y_max-lty;
-			auto const x_end=x_max-ltx;
-			for(unsigned int y=0;y<y_end;++y)
-			{
-				for(unsigned int x=0;x<x_end;++x)
-				{
-					//std::cout<<int(img(ltx+x,lty+y))<<' '<<int(tmplt(x,y))<<'\n';
-					match+=ImageUtils::Grayscale::color_diff(&img(ltx+x,lty+y),&tmplt(x,y));
-				}
-			}
+			//the sum of Grayscale::color_diff over the template
+			float const match=template_abs_diff(img,tmplt,{ltx,lty})/255.0f;
 			//std::cout<<match<<'\n';
 			if(match<inverted_threshold)
 			{
@@ -755,142 +726,210 @@ namespace ScoreProcessor {
 		return count;
 	}
 
-	struct guarded_pool {
-		exlib::thread_pool pool;
-		std::mutex lock;
-		explicit guarded_pool(unsigned int nt):pool{std::max(1U,nt)}
-		{}
-	};
-
-	auto& init_exclusive_pool(unsigned int num_threads)
-	{
-		static guarded_pool pool{std::max(1U,num_threads)};
-		return pool;
-	}
-
-	ExclusiveThreadPool::ExclusiveThreadPool(unsigned int num_threads)
-	{
-		init_exclusive_pool(num_threads).lock.lock();
-	}
-
-	exlib::thread_pool& ExclusiveThreadPool::pool() const
-	{
-		return init_exclusive_pool(0).pool;
-	}
-
-	ExclusiveThreadPool::~ExclusiveThreadPool()
+	void binarize(CImg<unsigned char>& image,ColorRGB const middleColor,ColorRGB const lowColor,ColorRGB const highColor)
 	{
-		init_exclusive_pool(0).lock.unlock();
+		assert(image._spectrum==3);
+		size_t const size=size_t(image._width)*image._height;
+		auto const data=image._data;
+		kernels::threshold_rgb(data,data+size,data+2*size,size,middleColor.brightness(),
+			{lowColor.r,lowColor.g,lowColor.b},
+			{highColor.r,highColor.g,highColor.b});
 	}
-
-	void ExclusiveThreadPool::set_thread_count(unsigned int nt)
+	void binarize(CImg<unsigned char>& image,Grayscale const middleGray,Grayscale const lowGray,Grayscale const highGray)
 	{
-		assert(nt!=0);
-		init_exclusive_pool(0).pool.num_threads(nt);
+		assert(image._spectrum==1);
+		kernels::threshold(image._data,size_t(image._width)*image._height,middleGray,lowGray,highGray);
 	}
-
-	void binarize(CImg<unsigned char>& image,ColorRGB const middleColor,ColorRGB const lowColor,ColorRGB const highColor)
+	void binarize(CImg<unsigned char>& image,Grayscale const middleGray,float scale)
 	{
-		assert(image._spectrum==3);
-		unsigned char midBrightness=middleColor.brightness();
-		for(unsigned int x=0;x<image._width;++x)
+		assert(image._spectrum==1);
+		std::array<unsigned char,256> table;
+		for(unsigned int i=0;i<256;++i)
 		{
-			for(unsigned int y=0;y<image._height;++y)
+			unsigned char pixel=i;
+			if(pixel>middleGray)
 			{
-				if(brightness({image(x,y,0),image(x,y,1),image(x,y,2)})>midBrightness)
-				{
-					image(x,y,0)=highColor.r;
-					image(x,y,1)=highColor.g;
-					image(x,y,2)=highColor.b;
-				}
-				else
-				{
-					image(x,y,0)=lowColor.r;
-					image(x,y,1)=lowColor.g;
-					image(x,y,2)=lowColor.b;
-				}
+				pixel=255-(255-pixel)/scale;
 			}
+			else
+			{
+				pixel/=scale;
+			}
+			table[i]=pixel;
 		}
+		kernels::apply_lut(image._data,size_t(image._width)*image._height,table);
 	}
-	void binarize(CImg<unsigned char>& image,Grayscale const middleGray,Grayscale const lowGray,Grayscale const highGray)
+	CImg<unsigned char> sliding_median(CImg<unsigned char> const& image,unsigned int window_width,unsigned int window_height)
 	{
-		assert(image._spectrum==1);
-		for(unsigned int x=0;x<image._width;++x)
+		unsigned int const width=image._width;
+		unsigned int const height=image._height;
+		CImg<unsigned char> medians(width,height);
+		if(width==0||height==0)
 		{
-			for(unsigned int y=0;y<image._height;++y)
+			return medians;
+		}
+		unsigned int const hwidth=window_width/2;
+		unsigned int const hheight=window_height/2;
+		auto const window_top=[=](unsigned int y)
+		{
+			return y>hheight?y-hheight:0;
+		};
+		auto const window_bottom=[=](unsigned int y)
+		{
+			return unsigned int(std::min<size_t>(height,size_t{y}+window_height-hheight));
+		};
+		auto const window_left=[=](unsigned int x)
+		{
+			return x>hwidth?x-hwidth:0;
+		};
+		auto const window_right=[=](unsigned int x)
+		{
+			return unsigned int(std::min<size_t>(width,size_t{x}+window_width-hwidth));
+		};
+		//each band fills its column histograms from scratch, so bands are kept a few windows tall
+		size_t const band_count=std::max<size_t>(1,std::min<size_t>(global_pool().num_threads(),height/std::max(window_height,64U)));
+		parallel_for(band_count,[&](size_t band)
+		{
+			unsigned int const band_top=unsigned int(size_t{height}*band/band_count);
+			unsigned int const band_bottom=unsigned int(size_t{height}*(band+1)/band_count);
+			static unsigned int const zeros[256]={};
+			//per column, the fine histogram of the rows in the window and a coarse one of 16 bins of 16 values
+			std::vector<unsigned int> fine(size_t{width}*256,0);
+			std::vector<unsigned int> coarse(size_t{width}*16,0);
+			//a delta of ~0U takes the row back out
+			auto const add_row=[&](unsigned int y,unsigned int delta)
 			{
-				if(image(x,y)>middleGray)
-				{
-					image(x,y)=highGray;
-				}
-				else
+				auto const row=image.data(0,y);
+				for(unsigned int x=0;x<width;++x)
 				{
-					image(x,y)=lowGray;
+					fine[size_t{x}*256+row[x]]+=delta;
+					coarse[size_t{x}*16+(row[x]>>4)]+=delta;
 				}
+			};
+			unsigned int top=window_top(band_top);
+			unsigned int bottom=window_bottom(band_top);
+			for(unsigned int y=top;y<bottom;++y)
+			{
+				add_row(y,1);
 			}
-		}
-	}
-	void binarize(CImg<unsigned char>& image,Grayscale const middleGray,float scale)
-	{
-		assert(image._spectrum==1);
-		for(unsigned int x=0;x<image._width;++x)
-		{
-			for(unsigned int y=0;y<image._height;++y)
+			std::array<unsigned int,16> kernel_coarse;
+			std::array<unsigned int,256> kernel_fine;
+			//the columns [segment_left[k],segment_right[k]) the fine bins of coarse bin k hold
+			std::array<unsigned int,16> segment_left,segment_right;
+			for(unsigned int y=band_top;y<band_bottom;++y)
 			{
-				if(image(x,y)>middleGray)
+				for(unsigned int const new_top=window_top(y);top<new_top;++top)
 				{
-					image(x,y)=255-(255-image(x,y))/scale;
+					add_row(top,~0U);
 				}
-				else
+				for(unsigned int const new_bottom=window_bottom(y);bottom<new_bottom;++bottom)
+				{
+					add_row(bottom,1);
+				}
+				kernel_coarse.fill(0);
+				segment_left.fill(0);
+				segment_right.fill(0);
+				unsigned int left=0;
+				unsigned int right=0;
+				auto const out=medians.data(0,y);
+				for(unsigned int x=0;x<width;++x)
 				{
-					image(x,y)/=scale;
+					unsigned int const new_left=window_left(x);
+					unsigned int const new_right=window_right(x);
+					for(;right<new_right;++right)
+					{
+						kernels::add_count_difference(kernel_coarse.data(),&coarse[size_t{right}*16],zeros,16);
+					}
+					for(;left<new_left;++left)
+					{
+						kernels::add_count_difference(kernel_coarse.data(),zeros,&coarse[size_t{left}*16],16);
+					}
+					auto const rank=size_t{right-left}*(bottom-top)/2;
+					size_t below=0;
+					unsigned int k=0;
+					for(;k<16&&below+kernel_coarse[k]<rank;++k)
+					{
+						below+=kernel_coarse[k];
+					}
+					if(k==16)
+					{
+						out[x]=255;
+						continue;
+					}
+					auto const segment=kernel_fine.data()+k*16;
+					auto& seg_left=segment_left[k];
+					auto& seg_right=segment_right[k];
+					if(seg_right<=left)
+					{
+						std::fill(segment,segment+16,0);
+						seg_left=seg_right=left;
+					}
+					for(;seg_left<left&&seg_right<right;++seg_left,++seg_right)
+					{
+						kernels::add_count_difference(segment,&fine[size_t{seg_right}*256+k*16],&fine[size_t{seg_left}*256+k*16],16);
+					}
+					for(;seg_left<left;++seg_left)
+					{
+						kernels::add_count_difference(segment,zeros,&fine[size_t{seg_left}*256+k*16],16);
+					}
+					for(;seg_right<right;++seg_right)
+					{
+						kernels::add_count_difference(segment,&fine[size_t{seg_right}*256+k*16],zeros,16);
+					}
+					unsigned int i=0;
+					while(below+segment[i]<rank)
+					{
+						below+=segment[i];
+						++i;
+					}
+					out[x]=static_cast<unsigned char>(k*16+i);
 				}
 			}
-		}
+		});
+		return medians;
+	}
+	static bool replace_range(unsigned char* it,unsigned char* const limit,Grayscale const lower,Grayscale const upper,Grayscale const replacer)
+	{
+		return kernels::replace_range(it,limit-it,lower,upper,replacer);
 	}
+
 	bool replace_range(CImg<unsigned char>& image,Grayscale const lower,ImageUtils::Grayscale const upper,Grayscale const replacer)
 	{
+		return replace_range(image.begin(),image.end(),lower,upper,replacer);
+	}
+
+	bool replace_range(CImg<unsigned char>& image,Grayscale const lower,Grayscale const upper,Grayscale const replacer,unsigned int top,unsigned int bottom)
+	{
+		assert(top<=bottom&&bottom<=image._height);
 		bool edited=false;
-		unsigned char* const limit=image.end();
-		for(auto it=image.begin();it!=limit;++it)
+		size_t const size=size_t(image._width)*image._height;
+		for(unsigned int s=0;s<image._spectrum;++s)
 		{
-			if(*it>=lower&&*it<=upper)
-			{
-				if(*it!=replacer)
-				{
-					edited=true;
-					*it=replacer;
-				}
-			}
+			auto const layer=image._data+s*size;
+			edited|=replace_range(layer+size_t(top)*image._width,layer+size_t(bottom)*image._width,lower,upper,replacer);
 		}
 		return edited;
 	}
 
 	bool replace_by_brightness(CImg<unsigned char>& image,unsigned char lowerBrightness,unsigned char upperBrightness,ColorRGB replacer)
+	{
+		return replace_by_brightness(image,lowerBrightness,upperBrightness,replacer,0,image._height);
+	}
+
+	bool replace_by_brightness(CImg<unsigned char>& image,unsigned char lowerBrightness,unsigned char upperBrightness,ColorRGB replacer,unsigned int top,unsigned int bottom)
 	{
 		assert(image._spectrum>=3);
-		bool edited=false;
-		auto repl=std::array<unsigned char,3>({replacer.r,replacer.g,replacer.b});
-		map_if<3U>(image,[=](auto color)
-			{
-				return repl;;
-			},[=,&edited](auto color)
-			{
-				if(color==repl)
-				{
-					return false;
-				}
-				auto const brightness=(float(color[0])+color[1]+color[2])/3.0f;
-				if(brightness>=lowerBrightness&&brightness<=upperBrightness)
-				{
-					edited=true;
-					return true;
-				}
-				return false;
-			});
-		return edited;
+		assert(top<=bottom&&bottom<=image._height);
+		size_t const size=size_t(image._width)*image._height;
+		size_t const offset=size_t(top)*image._width;
+		auto const data=image._data+offset;
+		return kernels::replace_by_brightness(data,data+size,data+2*size,size_t(bottom)*image._width-offset,lowerBrightness,upperBrightness,{replacer.r,replacer.g,replacer.b});
 	}
 	bool replace_by_hsv(::cimg_library::CImg<unsigned char>& image,ImageUtils::ColorHSV start,ImageUtils::ColorHSV end,ImageUtils::ColorRGB replacer)
+	{
+		return replace_by_hsv(image,start,end,replacer,0,image._height);
+	}
+	bool replace_by_hsv(::cimg_library::CImg<unsigned char>& image,ImageUtils::ColorHSV start,ImageUtils::ColorHSV end,ImageUtils::ColorRGB replacer,unsigned int top,unsigned int bottom)
 	{
 		assert(image._spectrum>=3);
 		bool edited=false;
@@ -922,10 +961,14 @@ namespace ScoreProcessor {
 					}
 				}
 				return false;
-			});
+			},size_t(top)*image._width,size_t(bottom)*image._width);
 		return edited;
 	}
 	bool replace_by_rgb(::cil::CImg<unsigned char>& image,ImageUtils::ColorRGB start,ImageUtils::ColorRGB end,ImageUtils::ColorRGB replacer)
+	{
+		return replace_by_rgb(image,start,end,replacer,0,image._height);
+	}
+	bool replace_by_rgb(::cil::CImg<unsigned char>& image,ImageUtils::ColorRGB start,ImageUtils::ColorRGB end,ImageUtils::ColorRGB replacer,unsigned int top,unsigned int bottom)
 	{
 		assert(image._spectrum>=3);
 		bool edited=false;
@@ -947,7 +990,7 @@ namespace ScoreProcessor {
 					return true;
 				}
 				return false;
-			});
+			},size_t(top)*image._width,size_t(bottom)*image._width);
 		return edited;
 	}
 	bool auto_center_horiz(CImg<unsigned char>& image)
@@ -1290,87 +1333,106 @@ namespace ScoreProcessor {
 		}
 		return container;
 	}
+	/*
+		The profiles are built a row at a time, so each row is read contiguously instead of striding down every column,
+		and the scan stops as soon as every column has found its edge.
+	*/
 	std::vector<unsigned int> build_top_profile(CImg<unsigned char> const& image,ColorRGB const background)
 	{
 		assert(image._spectrum==3||image._spectrum==4);
-		std::vector<unsigned int> container(image._width);
-		unsigned int limit=image._height/2;
-		unsigned int color=static_cast<unsigned int>(background.r)+background.g+background.b;
-		for(unsigned int x=0;x<image._width;++x)
+		unsigned int const limit=image._height/2;
+		std::vector<unsigned int> container(image._width,limit);
+		std::vector<unsigned char> found(image._width,0);
+		unsigned int const color=static_cast<unsigned int>(background.r)+background.g+background.b;
+		unsigned int left=image._width;
+		for(unsigned int y=0;y<limit&&left;++y)
 		{
-			container[x]=limit;
-			for(unsigned int y=0;y<limit;++y)
-			{
-				ColorRGB pixel={image(x,y,0),image(x,y,1),image(x,y,2)};
-				if(static_cast<unsigned int>(pixel.r)+pixel.g+pixel.b<=color)
-				{
-					container[x]=y;
-					break;
-				}
-			}
+			left-=kernels::mark_first_sum_below(image.data(0,y,0),image.data(0,y,1),image.data(0,y,2),image._width,color+1,found.data(),container.data(),y);
 		}
 		return container;
 	}
 	std::vector<unsigned int> build_top_profile(CImg<unsigned char> const& image,Grayscale const background)
 	{
 		assert(image._spectrum==1);
-		std::vector<unsigned int> container(image._width);
-		unsigned int limit=image._height/2;
-		for(unsigned int x=0;x<image._width;++x)
+		unsigned int const limit=image._height/2;
+		std::vector<unsigned int> container(image._width,limit);
+		std::vector<unsigned char> found(image._width,0);
+		unsigned int left=image._width;
+		for(unsigned int y=0;y<limit&&left;++y)
 		{
-			container[x]=limit;
-			for(unsigned int y=0;y<limit;++y)
-			{
-				if(image(x,y)<=background)
-				{
-					container[x]=y;
-					break;
-				}
-			}
+			left-=kernels::mark_first_below(image.data(0,y),image._width,background+1U,found.data(),container.data(),y);
 		}
 		return container;
 	}
 	std::vector<unsigned int> build_bottom_profile(CImg<unsigned char> const& image,ColorRGB const background)
 	{
 		assert(image._spectrum==3||image._spectrum==4);
-		std::vector<unsigned int> container(image._width);
-		unsigned int color=static_cast<unsigned int>(background.r)+background.g+background.b;
-		unsigned int limit=image._height/2;
-		for(unsigned int x=0;x<image._width;++x)
+		unsigned int const limit=image._height/2;
+		std::vector<unsigned int> container(image._width,limit);
+		std::vector<unsigned char> found(image._width,0);
+		unsigned int const color=static_cast<unsigned int>(background.r)+background.g+background.b;
+		unsigned int left=image._width;
+		for(unsigned int y=image._height;y>limit&&left;)
 		{
-			container[x]=limit;
-			for(unsigned int y=image._height-1;y>=limit;--y)
-			{
-				ColorRGB pixel={image(x,y,0),image(x,y,1),image(x,y,2)};
-				if(static_cast<unsigned int>(pixel.r)+pixel.g+pixel.b<=color)
-				{
-					container[x]=y;
-					break;
-				}
-			}
+			--y;
+			left-=kernels::mark_first_sum_below(image.data(0,y,0),image.data(0,y,1),image.data(0,y,2),image._width,color+1,found.data(),container.data(),y);
 		}
 		return container;
 	}
 	std::vector<unsigned int> build_bottom_profile(CImg<unsigned char> const& image,Grayscale const background)
 	{
 		assert(image._spectrum==1);
-		std::vector<unsigned int> container(image._width);
-		unsigned int limit=image._height/2;
-		for(unsigned int x=0;x<image._width;++x)
+		unsigned int const limit=image._height/2;
+		std::vector<unsigned int> container(image._width,limit);
+		std::vector<unsigned char> found(image._width,0);
+		unsigned int left=image._width;
+		for(unsigned int y=image._height;y>limit+1&&left;)
 		{
-			container[x]=limit;
-			for(unsigned int y=image._height-1;y>limit;--y)
-			{
-				if(image(x,y)<background)
-				{
-					container[x]=y;
-					break;
-				}
-			}
+			--y;
+			left-=kernels::mark_first_below(image.data(0,y),image._width,background,found.data(),container.data(),y);
 		}
 		return container;
 	}
 
+	std::vector<unsigned int> build_left_profile(BitImage const& image)
+	{
+		unsigned int const limit=image.width()/2;
+		std::vector<unsigned int> container(image.height());
+		for(unsigned int y=0;y<image.height();++y)
+		{
+			container[y]=image.find_first(y,0,limit);
+		}
+		return container;
+	}
+	std::vector<unsigned int> build_right_profile(BitImage const& image)
+	{
+		unsigned int const limit=image.width()/2;
+		std::vector<unsigned int> container(image.height());
+		for(unsigned int y=0;y<image.height();++y)
+		{
+			auto const x=image.find_last(y,limit,image.width());
+			container[y]=x==image.width()?limit:x;
+		}
+		return container;
+	}
+
+	std::vector<Cluster> select_clusters(BitImage const& image,bool eight_way)
+	{
+		auto const strip_count=cluster_detail::strip_count(image.height());
+		std::vector<std::vector<ImageUtils::Rectangle<unsigned int>>> strips(strip_count);
+		parallel_for(strip_count,[&](size_t s)
+		{
+			image.append_runs(strips[s],
+				cluster_detail::strip_top(image.height(),s,strip_count),
+				cluster_detail::strip_top(image.height(),s+1,strip_count));
+		});
+		if(strip_count<2)
+		{
+			return Cluster::cluster_runs(strips[0],eight_way);
+		}
+		return Cluster::cluster_strips(strips,eight_way);
+	}
+
 	::cimg_library::CImg<float> create_vertical_energy(::cimg_library::CImg<unsigned char> const& refImage,float const vec,unsigned int min_vertical_space,unsigned char background);
 
 	::cimg_library::CImg<float> create_compress_energy(::cimg_library::CImg<unsigned char> const& refImage,unsigned int const min_padding)
@@ -1516,78 +1578,115 @@ namespace ScoreProcessor {
 		return resultContainer;
 	}
 
+	//rows are independent, so they are split into strips across the pool
 	void add_horizontal_energy(CImg<unsigned char> const& ref,CImg<float>& map,float const hec,unsigned char bg)
 	{
-		for(unsigned int y=0;y<map._height;++y)
+		auto const strip_count=cluster_detail::strip_count(map._height);
+		parallel_for(strip_count,[&](size_t strip)
 		{
-			unsigned int x=0;
-			unsigned int node_start;
-			bool node_found;
-			auto assign_node_found=[&,bg]()
+			auto const strip_bottom=cluster_detail::strip_top(map._height,strip+1,strip_count);
+			for(unsigned int y=cluster_detail::strip_top(map._height,strip,strip_count);y<strip_bottom;++y)
 			{
-				return node_found=ref(x,y)>bg;
-			};
-			auto place_values=[&]()
-			{
-				unsigned int mid=(node_start+x)/2;
-				float val_div=2.0f;
-				unsigned int node_x;
-				for(node_x=node_start;node_x<mid;++node_x)
-				{
-					++val_div;
-					map(node_x,y)+=hec/(val_div*val_div*val_div);
-				}
-				for(;node_x<x;++node_x)
+				unsigned int x=0;
+				unsigned int node_start;
+				bool node_found;
+				auto assign_node_found=[&,bg]()
 				{
-					--val_div;
-					map(node_x,y)+=hec/(val_div*val_div*val_div);
-				}
-			};
-			if(assign_node_found())
-			{
-				node_start=0;
-			}
-			for(x=1;x<ref._width;++x)
-			{
-				if(node_found)
+					return node_found=ref(x,y)>bg;
+				};
+				auto place_values=[&]()
 				{
-					if(!assign_node_found())
+					unsigned int mid=(node_start+x)/2;
+					float val_div=2.0f;
+					unsigned int node_x;
+					for(node_x=node_start;node_x<mid;++node_x)
 					{
-						place_values();
+						++val_div;
+						map(node_x,y)+=hec/(val_div*val_div*val_div);
+					}
+					for(;node_x<x;++node_x)
+					{
+						--val_div;
+						map(node_x,y)+=hec/(val_div*val_div*val_div);
 					}
+				};
+				if(assign_node_found())
+				{
+					node_start=0;
 				}
-				else
+				for(x=1;x<ref._width;++x)
 				{
-					if(assign_node_found())
+					if(node_found)
 					{
-						node_start=x;
+						if(!assign_node_found())
+						{
+							place_values();
+						}
+					}
+					else
+					{
+						if(assign_node_found())
+						{
+							node_start=x;
+						}
 					}
 				}
+				if(node_found&&node_start!=0)
+				{
+					place_values();
+				}
 			}
-			if(node_found&&node_start!=0)
+		});
+	}
+
+	/*
+		Same result as cimg_library::min_energy_to_right, which walks down every column of the row major map.
+		Here the map is taken a strip of columns at a time into a buffer that holds each column contiguously,
+		so that the columns can be accumulated with a vector kernel without a second map the size of the first.
+	*/
+	void min_energy_to_right(CImg<float>& map)
+	{
+		if(map._width<2)
+		{
+			return;
+		}
+		constexpr unsigned int strip=16;
+		unsigned int const height=map._height;
+		//the first column of the buffer is the last column of the strip before, which the strip adds onto
+		std::vector<float> columns(size_t(strip+1)*height);
+		for(unsigned int y=0;y<height;++y)
+		{
+			columns[y]=map(0,y);
+		}
+		for(unsigned int left=1;left<map._width;left+=strip)
+		{
+			unsigned int const count=std::min(strip,map._width-left);
+			for(unsigned int y=0;y<height;++y)
 			{
-				place_values();
+				float const* const row=map.data(left,y);
+				for(unsigned int i=0;i<count;++i)
+				{
+					columns[size_t(i+1)*height+y]=row[i];
+				}
+			}
+			for(unsigned int i=1;i<=count;++i)
+			{
+				kernels::add_min3(columns.data()+size_t(i)*height,columns.data()+size_t(i-1)*height,height);
+			}
+			for(unsigned int y=0;y<height;++y)
+			{
+				float* const row=map.data(left,y);
+				for(unsigned int i=0;i<count;++i)
+				{
+					row[i]=columns[size_t(i+1)*height+y];
+				}
 			}
+			std::copy_n(columns.data()+size_t(count)*height,height,columns.data());
 		}
 	}
-	unsigned int cut_page(CImg<unsigned char> const& image,char const* filename,cut_heuristics const& ch,int quality)
+
+	std::vector<std::vector<unsigned int>> find_cuts(CImg<unsigned char> const& image,cut_heuristics const& ch)
 	{
-		auto const support=validate_path(filename);
-		/*
-		bool isRGB;
-		switch(image._spectrum)
-		{
-			case 1:
-				isRGB=false;
-				break;
-			case 3:
-				isRGB=true;
-				//return 0;
-				break;
-			default:
-				return 0;
-		}
-		*/
 		std::vector<std::vector<unsigned int>> paths;
 		{
 			struct line {
@@ -1608,8 +1707,7 @@ namespace ScoreProcessor {
 			};
 			std::vector<line> boxes;
 			{
-				auto const selections=global_select<1U>(map,selector);
-				auto const clusters=Cluster::cluster_ranges(selections);
+				auto const clusters=select_clusters<1U>(map,selector);
 				auto heuristic_filter=
 					[=]
 				(auto box)
@@ -1638,121 +1736,79 @@ namespace ScoreProcessor {
 				paths.emplace_back(trace_seam(map,(current.bottom+next.top)/2,(current.right+next.right)/2-1));
 			}
 		}
-		if(paths.size()==0)
+		return paths;
+	}
+
+	CImg<unsigned char> cut_piece(CImg<unsigned char> const& image,std::vector<std::vector<unsigned int>> const& cuts,size_t index)
+	{
+		assert(index<=cuts.size());
+		if(cuts.empty())
 		{
-			cil::save_image(image,filename,support,quality);
-			return 1;
+			return image;
 		}
-		/*std::sort(paths.begin(),paths.end(),[](auto const& a,auto const& b)
-		{
-			assert(a.size()==b.size());
-			for(size_t i=a.size();i-->0;)
-			{
-				if(a[i]<b[i])
-				{
-					return true;
-				}
-				if(a[i]>b[i])
-				{
-					return false;
-				}
-			}
-			throw std::runtime_error("Duplicate paths found (a bug), aborting");
-		});*/
-		unsigned int num_images=0;
-		unsigned int bottom_of_old=0;
-		for(unsigned int path_num=0;path_num<paths.size();++path_num)
+		auto const* const above=index>0?&cuts[index-1]:nullptr;
+		auto const* const below=index<cuts.size()?&cuts[index]:nullptr;
+		unsigned int const offset=above?*std::min_element(above->begin(),above->end()):0;
+		unsigned int const height=(below?*std::max_element(below->begin(),below->end()):image._height)-offset;
+		assert(height<=image._height);
+		//the rows of the piece each column copies from the image, the rest is white
+		//a cut may dip above the lowest point of the one before, which wraps its end around to copy the whole column
+		std::vector<unsigned int> begin(image._width,0),end(image._width,height);
+		for(unsigned int x=0;x<image._width;++x)
 		{
-			auto const& path=paths[path_num];
-			unsigned int lowest_in_path=path[0],highest_in_path=path[0];
-			for(unsigned int x=1;x<path.size();++x)
+			if(above)
 			{
-				unsigned int node_y=path[x];
-				if(node_y>lowest_in_path)
-				{
-					lowest_in_path=node_y;
-				}
-				else if(node_y<highest_in_path)
-				{
-					highest_in_path=node_y;
-				}
+				begin[x]=(*above)[x]-offset;
 			}
-			unsigned int height;
-			height=lowest_in_path-bottom_of_old;
-			assert(height<image._height);
-			CImg<unsigned char> new_image(image._width,height,1,image._spectrum);
-			if(path_num==0)
+			if(below)
 			{
-				for (unsigned int z = 0; z < image._spectrum; ++z)
-				{
-					for (unsigned int x = 0; x < new_image._width; ++x)
-					{
-						unsigned int y = 0;
-						unsigned int y_stage2 = paths[path_num][x];
-						for (; y < y_stage2; ++y)
-						{
-							if (y < new_image._height)
-								new_image(x, y, 0, z) = image(x, y, 0, z);
-						}
-						for (; y < new_image._height; ++y)
-						{
-							if (y < new_image._height)
-								new_image(x, y, 0, z) = Grayscale::WHITE;
-						}
-					}
-				}
+				end[x]=(*below)[x]-offset;
 			}
-			else
-			{
-				for (unsigned int z = 0; z < image._spectrum; ++z)
-				{
-					for (unsigned int x = 0; x < new_image._width; ++x)
-					{
-						unsigned int y = 0;
-						unsigned int y_stage1 = paths[path_num - 1][x] - bottom_of_old;
-						unsigned int y_stage2 = paths[path_num][x] - bottom_of_old;
-						for (; y < y_stage1; ++y)
-						{
-							if (y < new_image._height)
-								new_image(x, y,0,z) = Grayscale::WHITE;
-						}
-						for (; y < y_stage2; ++y)
-						{
-							if (y < new_image._height)
-								new_image(x, y, 0, z) = image(x, y + bottom_of_old, 0, z);
-						}
-						for (; y < new_image._height; ++y)
-						{
-							if (y < new_image._height)
-								new_image(x, y, 0, z) = Grayscale::WHITE;
-						}
-					}
-				}
-			}
-			auto const save_name=cil::number_filename(filename,++num_images,3U);
-			cil::save_image(new_image,save_name.c_str(),support,quality);
-			bottom_of_old=highest_in_path;
 		}
-		CImg<unsigned char> new_image(image._width,image._height-bottom_of_old,1,image._spectrum);
-		unsigned int y_max=image._height-bottom_of_old;
-		for (unsigned int z = 0; z < image._spectrum; ++z)
+		CImg<unsigned char> piece(image._width,height,1,image._spectrum);
+		unsigned char const white=Grayscale::WHITE;
+		for(unsigned int c=0;c<image._spectrum;++c)
 		{
-			for (unsigned int x = 0; x < new_image._width; ++x)
+			for(unsigned int y=0;y<height;++y)
 			{
-				unsigned int y = 0;
-				unsigned int y_stage1 = paths.back()[x] - bottom_of_old;
-				for (; y < y_stage1; ++y)
-				{
-					new_image(x, y,0,z) = Grayscale::WHITE;
-				}
-				for (; y < new_image._height; ++y)
+				unsigned char const* const in=image.data(0,y+offset,c);
+				unsigned char* const out=piece.data(0,y,c);
+				for(unsigned int x=0;x<image._width;++x)
 				{
-					new_image(x, y,0,z) = image(x, y + bottom_of_old,0,z);
+					out[x]=y>=begin[x]&&y<end[x]?in[x]:white;
 				}
 			}
 		}
-		auto const save_name=cil::number_filename(filename,++num_images,3U);
-		cil::save_image(new_image,save_name.c_str(),support,quality);
+		return piece;
+	}
+
+	std::vector<CImg<unsigned char>> cut_page(CImg<unsigned char> const& image,cut_heuristics const& ch)
+	{
+		auto const cuts=find_cuts(image,ch);
+		std::vector<CImg<unsigned char>> pieces;
+		pieces.reserve(cuts.size()+1);
+		for(size_t i=0;i<=cuts.size();++i)
+		{
+			pieces.push_back(cut_piece(image,cuts,i));
+		}
+		return pieces;
+	}
+
+	unsigned int cut_page(CImg<unsigned char> const& image,char const* filename,cut_heuristics const& ch,int quality)
+	{
+		auto const support=validate_path(filename);
+		auto const cuts=find_cuts(image,ch);
+		if(cuts.size()==0)
+		{
+			cil::save_image(image,filename,support,quality);
+			return 1;
+		}
+		unsigned int num_images=0;
+		for(size_t i=0;i<=cuts.size();++i)
+		{
+			auto const save_name=cil::number_filename(filename,++num_images,3U);
+			cil::save_image(cut_piece(image,cuts,i),save_name.c_str(),support,quality);
+		}
 		return num_images;
 	}
 
@@ -1764,7 +1820,45 @@ namespace ScoreProcessor {
 		return RAD_DEG*auto_rotate_bare(image,pixel_prec,min_angle*DEG_RAD+M_PI_2,max_angle*DEG_RAD+M_PI_2,(max_angle-min_angle)/angle_prec+1,boundary);
 	}
 
-	float find_angle_bare(::cimg_library::CImg<unsigned char>& img,double pixel_prec,double min_angle,double max_angle,unsigned int angle_steps,unsigned char boundary,bool use_horiz)
+	struct angle_window {
+		unsigned int first,last;
+	};
+	//steps of an angle_steps grid over [min_angle,max_angle] within one coarse step of angle, so refining lands on the angles a direct search would try
+	static angle_window refine_window(double angle,double min_angle,double max_angle,unsigned int angle_steps,unsigned int coarse_steps)
+	{
+		double const fine_per_coarse=double(angle_steps)/coarse_steps;
+		double const center=(angle-min_angle)/(max_angle-min_angle)*angle_steps;
+		auto const first=static_cast<unsigned int>(std::max(0.0,std::floor(center-fine_per_coarse)));
+		auto const last=static_cast<unsigned int>(std::max(double(first),std::min(double(angle_steps),std::ceil(center+fine_per_coarse))));
+		return {first,last};
+	}
+
+	/*
+		Angle of the strongest line, voting across the global pool.
+		With coarse_steps, a pass with that many steps over the whole range picks the neighbourhood
+		that the fine pass then searches at the full angle precision.
+	*/
+	template<typename Selector>
+	static double hough_angle(Selector const& selector,unsigned int width,unsigned int height,double min_angle,double max_angle,unsigned int angle_steps,double pixel_prec,unsigned int coarse_steps)
+	{
+		auto const pool=&global_pool();
+		if(coarse_steps==0||coarse_steps>=angle_steps)
+		{
+			return HoughArray<unsigned short>(selector,width,height,min_angle,max_angle,angle_steps,pixel_prec,pool).angle();
+		}
+		double const coarse=HoughArray<unsigned short>(selector,width,height,min_angle,max_angle,coarse_steps,pixel_prec,pool).angle();
+		auto const window=refine_window(coarse,min_angle,max_angle,angle_steps,coarse_steps);
+		if(window.last==window.first)
+		{
+			return coarse;
+		}
+		double const range=max_angle-min_angle;
+		return HoughArray<unsigned short>(selector,width,height,
+			min_angle+range*window.first/angle_steps,min_angle+range*window.last/angle_steps,
+			window.last-window.first,pixel_prec,pool).angle();
+	}
+
+	float find_angle_bare(::cimg_library::CImg<unsigned char>& img,double pixel_prec,double min_angle,double max_angle,unsigned int angle_steps,unsigned char boundary,bool use_horiz,unsigned int coarse_steps)
 	{
 		assert(angle_steps>0);
 		assert(pixel_prec>0);
@@ -1785,8 +1879,7 @@ namespace ScoreProcessor {
 						//(top<=boundary&&bottom>boundary)||
 						(top>boundary&& bottom<=boundary);
 				};
-				HoughArray<unsigned short> ha(selector,img._width,img._height-1,min_angle,max_angle,angle_steps,pixel_prec);
-				return M_PI_2-ha.angle();
+				return M_PI_2-hough_angle(selector,img._width,img._height-1,min_angle,max_angle,angle_steps,pixel_prec,coarse_steps);
 			}
 			else
 			{
@@ -1798,8 +1891,7 @@ namespace ScoreProcessor {
 						//(left<=boundary&&right>boundary)||
 						(left>boundary&& right<=boundary);
 				};
-				HoughArray<unsigned short> ha(selector,img._width-1,img._height,M_PI_2+min_angle,M_PI_2+max_angle,angle_steps,pixel_prec);
-				return M_PI-ha.angle();
+				return M_PI-hough_angle(selector,img._width-1,img._height,M_PI_2+min_angle,M_PI_2+max_angle,angle_steps,pixel_prec,coarse_steps);
 			}
 		}
 		else
@@ -1816,8 +1908,7 @@ namespace ScoreProcessor {
 						//(top<=boundary&&bottom>boundary)||
 						(top>boundary&& bottom<=boundary);
 				};
-				HoughArray<unsigned short> ha(selector,img._width,img._height-1,min_angle,max_angle,angle_steps,pixel_prec);
-				return M_PI_2-ha.angle();
+				return M_PI_2-hough_angle(selector,img._width,img._height-1,min_angle,max_angle,angle_steps,pixel_prec,coarse_steps);
 			}
 			else
 			{
@@ -1831,10 +1922,97 @@ namespace ScoreProcessor {
 						//(top<=boundary&&bottom>boundary)||
 						(top>boundary&& bottom<=boundary);
 				};
-				HoughArray<unsigned short> ha(selector,img._width-1,img._height,M_PI_2+min_angle,M_PI_2+max_angle,angle_steps,pixel_prec);
-				return M_PI-ha.angle();
+				return M_PI-hough_angle(selector,img._width-1,img._height,M_PI_2+min_angle,M_PI_2+max_angle,angle_steps,pixel_prec,coarse_steps);
+			}
+		}
+	}
+
+	//the number of pixels that vote in find_angle_bare
+	static size_t count_voters(::cimg_library::CImg<unsigned char> const& img,unsigned char boundary,bool use_horiz)
+	{
+		if(img._height==0||img._width==0)
+		{
+			return 0;
+		}
+		size_t const size=size_t(img._width)*img._height;
+		bool const color=img._spectrum>=3;
+		unsigned int const limit=color?3U*boundary:boundary;
+		auto const value=[&img,size,color](unsigned int x,unsigned int y)
+		{
+			auto const p=&img(x,y);
+			return color?unsigned int(*p)+*(p+size)+*(p+2*size):unsigned int(*p);
+		};
+		unsigned int const dx=use_horiz?0:1;
+		unsigned int const dy=use_horiz?1:0;
+		size_t count=0;
+		for(unsigned int y=0;y+dy<img._height;++y)
+		{
+			for(unsigned int x=0;x+dx<img._width;++x)
+			{
+				count+=value(x,y)>limit&&value(x+dx,y+dy)<=limit;
 			}
 		}
+		return count;
+	}
+
+	float find_angle_downscaled(::cimg_library::CImg<unsigned char>& img,double pixel_prec,double min_angle,double max_angle,unsigned int angle_steps,unsigned int downscale,unsigned char boundary,bool use_horiz,deskew_report* report)
+	{
+		assert(angle_steps>0);
+		assert(min_angle<max_angle);
+		using clock=std::chrono::steady_clock;
+		auto const seconds_since=[](clock::time_point start)
+		{
+			return std::chrono::duration<double>(clock::now()-start).count();
+		};
+		auto const start=clock::now();
+		size_t coarse_voters=0;
+		unsigned int coarse_steps=0;
+		unsigned int fine_steps=angle_steps;
+		float angle;
+		if(downscale<2)
+		{
+			angle=find_angle_bare(img,pixel_prec,min_angle,max_angle,angle_steps,boundary,use_horiz);
+		}
+		else
+		{
+			auto small=integral_downscale(img,downscale);
+			coarse_steps=std::max(1U,angle_steps/downscale);
+			if(report)
+			{
+				coarse_voters=count_voters(small,boundary,use_horiz);
+			}
+			float const coarse=find_angle_bare(small,pixel_prec,min_angle,max_angle,coarse_steps,boundary,use_horiz);
+			//find_angle_bare returns M_PI_2 minus the angle in the searched range
+			auto const window=refine_window(M_PI_2-coarse,min_angle,max_angle,angle_steps,coarse_steps);
+			fine_steps=window.last-window.first;
+			if(fine_steps==0)
+			{
+				angle=coarse;
+			}
+			else
+			{
+				double const range=max_angle-min_angle;
+				angle=find_angle_bare(img,pixel_prec,
+					min_angle+range*window.first/angle_steps,min_angle+range*window.last/angle_steps,
+					fine_steps,boundary,use_horiz);
+			}
+		}
+		if(report)
+		{
+			report->seconds=seconds_since(start);
+			//each voter votes once per step and once more for the end of the range
+			size_t const voters=count_voters(img,boundary,use_horiz);
+			report->coarse_votes=coarse_steps?coarse_voters*(coarse_steps+1):0;
+			report->coarse_steps=coarse_steps;
+			report->fine_votes=fine_steps?voters*(fine_steps+1):0;
+			report->fine_steps=fine_steps;
+			report->direct_votes=voters*(angle_steps+1);
+			report->direct_steps=angle_steps;
+			auto const direct_start=clock::now();
+			report->direct_angle=find_angle_bare(img,pixel_prec,min_angle,max_angle,angle_steps,boundary,use_horiz);
+			report->direct_seconds=seconds_since(direct_start);
+		}
+		return angle;
 	}
 
 	float auto_rotate_bare(::cimg_library::CImg<unsigned char>& img,double pixel_prec,double min_angle,double max_angle,unsigned int angle_steps,unsigned char boundary)
@@ -1866,7 +2044,8 @@ namespace ScoreProcessor {
 		switch(image._spectrum)
 		{
 		case 1:
-			rightProfile=build_right_profile(image,Grayscale::WHITE);
+			//gray_diff is squared, so it is over 0.5 from white only below 75
+			rightProfile=build_right_profile(BitImage(image,75));
 			break;
 		case 3:
 			rightProfile=build_right_profile(image,ColorRGB::WHITE);
@@ -1959,37 +2138,80 @@ namespace ScoreProcessor {
 			});
 		return result_container;
 	}
-	bool auto_padding(CImg<unsigned char>& image,unsigned int const vertical_padding,unsigned int const horizontal_padding_max,unsigned int const horizontal_padding_min,signed int horiz_offset,float optimal_ratio,unsigned int tolerance,unsigned char background)
+	//index of the first count that brings the running total to tolerance, or the number of counts if none does
+	template<typename Iter>
+	static size_t first_content(Iter begin,Iter end,unsigned int tolerance,bool cumulative)
 	{
-		unsigned int left,right,top,bottom;
-		switch(image._spectrum)
-		{
-		case 1:
-		case 2:
+		unsigned int num=0;
+		size_t i=0;
+		for(;begin!=end;++begin,++i)
 		{
-			auto selector=[=](auto color)
+			num=cumulative?num+*begin:*begin;
+			if(num>=tolerance)
 			{
-				return color[0]<background;
-			};
-			left=find_left<3>(image,tolerance,selector);
-			right=find_right<3>(image,tolerance,selector)+1;
-			top=find_top<3>(image,tolerance,selector);
-			bottom=find_bottom<3>(image,tolerance,selector)+1;
-			break;
+				break;
+			}
 		}
-		default:
+		return i;
+	}
+	unsigned int content_profile::left(unsigned int tolerance,bool cumulative) const
+	{
+		auto const i=first_content(columns.begin(),columns.end(),tolerance,cumulative);
+		return unsigned int(i==columns.size()?columns.size()-1:i);
+	}
+	unsigned int content_profile::right(unsigned int tolerance,bool cumulative) const
+	{
+		auto const i=first_content(columns.rbegin(),columns.rend(),tolerance,cumulative);
+		return unsigned int(i==columns.size()?0:columns.size()-1-i);
+	}
+	unsigned int content_profile::top(unsigned int tolerance,bool cumulative) const
+	{
+		auto const i=first_content(rows.begin(),rows.end(),tolerance,cumulative);
+		return unsigned int(i==rows.size()?rows.size()-1:i);
+	}
+	unsigned int content_profile::bottom(unsigned int tolerance,bool cumulative) const
+	{
+		auto const i=first_content(rows.rbegin(),rows.rend(),tolerance,cumulative);
+		return unsigned int(i==rows.size()?0:rows.size()-1-i);
+	}
+	content_profile find_content_profile(CImg<unsigned char> const& img,unsigned char background,bool inclusive)
+	{
+		content_profile profile;
+		unsigned int const width=img._width;
+		unsigned int const height=img._height;
+		size_t const size=size_t(width)*height;
+		profile.columns.assign(width,0);
+		profile.rows.resize(height);
+		bool const rgb=img._spectrum>=3;
+		unsigned int const limit=(rgb?3U*background:background)+inclusive;
+		//the kernels count into 16 bits, so flush into the totals before they can overflow
+		std::vector<unsigned short> partial(width,0);
+		unsigned int pending=0;
+		for(unsigned int y=0;y<height;++y)
 		{
-			auto selector=[bg=3*float(background)](auto color)
+			auto const row=img._data+size_t(y)*width;
+			profile.rows[y]=rgb?
+				kernels::count_sum_below(row,row+size,row+2*size,width,limit,partial.data()):
+				kernels::count_below(row,width,limit,partial.data());
+			if(++pending==std::numeric_limits<unsigned short>::max()||y+1==height)
 			{
-				return float(color[0])+color[1]+color[2]<bg;
-			};
-			left=find_left<3>(image,tolerance,selector);
-			right=find_right<3>(image,tolerance,selector)+1;
-			top=find_top<3>(image,tolerance,selector);
-			bottom=find_bottom<3>(image,tolerance,selector)+1;
-			break;
-		}
+				for(unsigned int x=0;x<width;++x)
+				{
+					profile.columns[x]+=partial[x];
+					partial[x]=0;
+				}
+				pending=0;
+			}
 		}
+		return profile;
+	}
+	bool auto_padding(CImg<unsigned char>& image,unsigned int const vertical_padding,unsigned int const horizontal_padding_max,unsigned int const horizontal_padding_min,signed int horiz_offset,float optimal_ratio,unsigned int tolerance,unsigned char background)
+	{
+		auto const profile=find_content_profile(image,background,false);
+		unsigned int const left=profile.left(tolerance);
+		unsigned int const right=profile.right(tolerance)+1;
+		unsigned int const top=profile.top(tolerance);
+		unsigned int const bottom=profile.bottom(tolerance)+1;
 		if(left>right) return false;
 		if(top>bottom) return false;
 
@@ -2034,31 +2256,13 @@ namespace ScoreProcessor {
 	}
 	bool horiz_padding(CImg<unsigned char>& image,unsigned int const left_pad,unsigned int const right_pad,unsigned int tolerance,unsigned char background,bool cumulative)
 	{
-		signed int x1,x2;
-		switch(image._spectrum)
-		{
-		case 1:
-		case 2:
-		{
-			auto selector=[=](auto color)
-			{
-				return color[0]<=background;
-			};
-			x1=left_pad==-1?0:find_left<1>(image,tolerance,selector,cumulative)-left_pad;
-			x2=right_pad==-1?image.width()-1:find_right<1>(image,tolerance,selector,cumulative)+right_pad;
-			break;
-		}
-		default:
+		if(left_pad==-1&&right_pad==-1)
 		{
-			auto selector=[bg=3U*unsigned int(background)](auto color)
-			{
-				return unsigned int(color[0])+color[1]+color[2]<=bg;
-			};
-			x1=left_pad==-1?0:find_left<3>(image,tolerance,selector,cumulative)-left_pad;
-			x2=right_pad==-1?image.width()-1:find_right<3>(image,tolerance,selector,cumulative)+right_pad;
-			break;
-		}
+			return false;
 		}
+		auto const profile=find_content_profile(image,background,true);
+		signed int x1=left_pad==-1?0:profile.left(tolerance,cumulative)-left_pad;
+		signed int x2=right_pad==-1?image.width()-1:profile.right(tolerance,cumulative)+right_pad;
 		if(x1>x2)
 		{
 			std::swap(x1,x2);
@@ -2076,31 +2280,13 @@ namespace ScoreProcessor {
 	}
 	bool vert_padding(CImg<unsigned char>& image,unsigned int const tp,unsigned int const bp,unsigned int tolerance,unsigned char background,bool cumulative)
 	{
-		signed int y1,y2;
-		switch(image._spectrum)
-		{
-		case 1:
-		case 2:
+		if(tp==-1&&bp==-1)
 		{
-			auto selector=[=](auto color)
-			{
-				return color[0]<=background;
-			};
-			y1=tp==-1?0:find_top<1>(image,tolerance,selector,cumulative)-tp;
-			y2=bp==-1?image.height()-1:find_bottom<1>(image,tolerance,selector,cumulative)+bp;
-			break;
-		}
-		default:
-		{
-			auto selector=[bg=3U*unsigned int(background)](auto color)
-			{
-				return unsigned int(color[0])+color[1]+color[2]<=bg;
-			};
-			y1=tp==-1?0:find_top<3>(image,tolerance,selector,cumulative)-tp;
-			y2=bp==-1?image.height()-1:find_bottom<3>(image,tolerance,selector,cumulative)+bp;
-			break;
-		}
+			return false;
 		}
+		auto const profile=find_content_profile(image,background,true);
+		signed int y1=tp==-1?0:profile.top(tolerance,cumulative)-tp;
+		signed int y2=bp==-1?image.height()-1:profile.bottom(tolerance,cumulative)+bp;
 		if(y1>y2)
 		{
 			std::swap(y1,y2);
@@ -2121,32 +2307,33 @@ namespace ScoreProcessor {
 		unsigned int const bp,
 		unsigned char bt)
 	{
-		auto selections=img._spectrum>2?
-			global_select<3>(img,[threshold=3U*unsigned short(bt)](auto color)
+		auto const labeled=img._spectrum>2?
+			label_clusters<3>(img,[threshold=3U*unsigned short(bt)](auto color)
 		{
 			return unsigned short(color[0])+color[1]+color[2]<=threshold;
 		}):
-			global_select<1>(img,[bt](auto color)
+			label_clusters<1>(img,[bt](auto color)
 				{
 					return color[0]<=bt;
 				});
-		auto clusters=Cluster::cluster_ranges(selections);
-		if(clusters.size()==0)
+		if(labeled.clusters.size()==0)
 		{
 			return false;
 		}
 		unsigned int top_size=0;
-		Cluster const* top_cluster;
-		for(auto const& cluster:clusters)
+		size_t top_label=0;
+		for(size_t i=0;i<labeled.clusters.size();++i)
 		{
-			auto const size=cluster.bounding_box().area();
+			auto const size=labeled.clusters[i].bounding_box.area();
 			if(size>top_size)
 			{
 				top_size=size;
-				top_cluster=&cluster;
+				top_label=i;
 			}
 		}
-		auto com=top_cluster->bounding_box().center<double>();
+		//only the corners of the biggest cluster are needed
+		auto const top_cluster=labeled.cluster(top_label);
+		auto com=labeled.clusters[top_label].bounding_box.center<double>();
 		ImageUtils::PointUINT tl,tr,bl,br;
 		double tld=0,trd=0,bld=0,brd=0;
 		auto switch_if_bigger=[com](double& dist,PointUINT& contender,PointUINT cand)
@@ -2158,7 +2345,7 @@ namespace ScoreProcessor {
 				contender=cand;
 			}
 		};
-		for(auto const rect:top_cluster->get_ranges())
+		for(auto const rect:top_cluster.get_ranges())
 		{
 			PointUINT cand;
 			cand={rect.left,rect.top};
@@ -2223,24 +2410,28 @@ namespace ScoreProcessor {
 		}
 		*/
 	}
+	/*
+		Columns are independent, so the image is split into blocks of columns across the pool.
+		Each block is walked a row at a time, keeping where the current gap of every column started,
+		so the reference image is read along its rows.
+	*/
 	CImg<float> create_vertical_energy(CImg<unsigned char> const& ref,float const vec,unsigned int min_vert_space,unsigned char background)
 	{
+		constexpr unsigned int block_width=64;
 		CImg<float> map(ref._width,ref._height);
-		map.fill(INFINITY);
-		for(unsigned int x=0;x<map._width;++x)
+		auto const block_count=(ref._width+block_width-1)/block_width;
+		parallel_for(block_count,[&](size_t block)
 		{
-			unsigned int y=0;
-			unsigned int node_start;
-			bool node_found;
-			auto assign_node_found=[&,background]()
-			{
-				return node_found=ref(x,y)>background;
-			};
-			auto place_values=[&,vec,min_vert_space](unsigned int begin,unsigned int end)
+			unsigned int const left=unsigned int(block)*block_width;
+			unsigned int const right=std::min(left+block_width,ref._width);
+			unsigned int const width=right-left;
+			std::array<unsigned int,block_width> node_start;
+			std::array<bool,block_width> node_found;
+			auto place_values=[&,vec,min_vert_space](unsigned int x,unsigned int begin,unsigned int end)
 			{
 				if(end-begin>min_vert_space)
 				{
-					unsigned int mid=(node_start+y)/2;
+					unsigned int mid=(begin+end)/2;
 					float val_div=2.0f;
 					unsigned int y;
 					for(y=begin;y<mid;++y)
@@ -2255,42 +2446,57 @@ namespace ScoreProcessor {
 					}
 				}
 			};
-			if(assign_node_found())
+			for(unsigned int y=0;y<ref._height;++y)
 			{
-				node_start=0;
+				std::fill_n(map.data(left,y),width,INFINITY);
 			}
-			for(y=1;y<ref._height;++y)
+			if(ref._height==0)
 			{
-				if(node_found)
-				{
-					if(!assign_node_found())
-					{
-						place_values(node_start,y);
-					}
-				}
-				else
+				return;
+			}
+			for(unsigned int i=0;i<width;++i)
+			{
+				node_found[i]=ref(left+i,0)>background;
+				node_start[i]=0;
+			}
+			for(unsigned int y=1;y<ref._height;++y)
+			{
+				unsigned char const* const row=ref.data(left,y);
+				for(unsigned int i=0;i<width;++i)
 				{
-					if(assign_node_found())
+					bool const found=row[i]>background;
+					if(found!=node_found[i])
 					{
-						node_start=y;
+						if(found)
+						{
+							node_start[i]=y;
+						}
+						else
+						{
+							place_values(left+i,node_start[i],y);
+						}
+						node_found[i]=found;
 					}
 				}
 			}
-			if(node_found)
+			for(unsigned int i=0;i<width;++i)
 			{
-				if(node_start>0)
+				if(node_found[i])
 				{
-					place_values(node_start,y);
-				}
-				else
-				{
-					for(int y=0;y<ref._height;++y)
+					if(node_start[i]>0)
 					{
-						map(x,y)=0;
+						place_values(left+i,node_start[i],ref._height);
+					}
+					else
+					{
+						for(unsigned int y=0;y<ref._height;++y)
+						{
+							map(left+i,y)=0;
+						}
 					}
 				}
 			}
-		}
+		});
 		return map;
 	}
 	float const COMPRESS_HORIZONTAL_ENERGY_CONSTANT=1.0f;
@@ -2391,9 +2597,10 @@ namespace ScoreProcessor {
 	{
 		double const scale_up=scast<double>(255-mid)/scast<double>(max-mid);
 		double const scale_down=scast<double>(mid)/scast<double>(mid-min);
-		for(;it!=limit;++it)
+		std::array<unsigned char,256> table;
+		for(unsigned int i=0;i<256;++i)
 		{
-			unsigned char& pixel=*it;
+			unsigned char pixel=i;
 			if(pixel<=min)
 			{
 				pixel=0;
@@ -2415,7 +2622,9 @@ namespace ScoreProcessor {
 					assert(pixel<=mid);
 				}
 			}
+			table[i]=pixel;
 		}
+		kernels::apply_lut(it,limit-it,table);
 	}
 
 	void rescale_colors(CImg<unsigned char>& img,unsigned char min,unsigned char mid,unsigned char max)
@@ -2426,6 +2635,14 @@ namespace ScoreProcessor {
 		rescale_colors(img.begin(),limit, min, mid, max);
 	}
 
+	void rescale_colors(CImg<unsigned char>& img,unsigned char min,unsigned char mid,unsigned char max,unsigned int top,unsigned int bottom)
+	{
+		assert(min<mid);
+		assert(mid<max);
+		assert(top<=bottom&&bottom<=img._height);
+		rescale_colors(img.begin()+size_t{img._width}*top,img.begin()+size_t{img._width}*bottom,min,mid,max);
+	}
+
 	void hathi_correct(::cimg_library::CImg<unsigned char>& img, unsigned char min, unsigned char mid, unsigned char max, unsigned char boundary) {
 		enum class State {
 			UNKNOWN,
@@ -21,11 +21,12 @@ along with this program. If not, see <https://www.gnu.org/licenses/>.
 #include <vector>
 #include <memory>
 #include "Cluster.h"
+#include "BitImage.h"
 #include <assert.h>
 #include <functional>
 #include <array>
 #include <mutex>
-#include "lib/threadpool/thread_pool.h"
+#include "WorkerPool.h"
 #include "../NeuralNetwork/neural_net.h"
 #include <optional>
 #ifdef _WIN64
@@ -363,13 +364,33 @@ namespace ScoreProcessor {
 	template<typename T>
 	vertical_iterator(cil::CImg<T>&,unsigned int,unsigned int)->vertical_iterator<T>;
 
-	class ExclusiveThreadPool {
-	public:
-		exlib::thread_pool& pool() const;
-		void set_thread_count(unsigned int nt);
-		ExclusiveThreadPool(unsigned int num_threads=std::thread::hardware_concurrency());
-		~ExclusiveThreadPool();
-	};
+	/*
+		Calls strip_func(top,bottom) on horizontal strips that together cover rows [0,height).
+		Strips are sized to stay in cache and are spread across the global pool.
+		strip_func must only touch rows [top,bottom) and must not throw.
+		Returns whether any call returned true.
+	*/
+	template<typename StripFunc>
+	bool process_strips(unsigned int height,size_t row_bytes,StripFunc strip_func)
+	{
+		constexpr size_t strip_bytes=size_t(1)<<18;
+		size_t const rows=std::max<size_t>(1,strip_bytes/std::max<size_t>(1,row_bytes));
+		if(rows>=height)
+		{
+			return strip_func(0U,height);
+		}
+		std::atomic<bool> edited(false);
+		parallel_for((height+rows-1)/rows,[&strip_func,&edited,rows,height](size_t strip)
+		{
+			unsigned int const top=static_cast<unsigned int>(strip*rows);
+			unsigned int const bottom=static_cast<unsigned int>(std::min<size_t>(height,top+rows));
+			if(strip_func(top,bottom))
+			{
+				edited=true;
+			}
+		});
+		return edited;
+	}
 
 	/*
 		Fast approximate anti-aliasing
@@ -700,17 +721,38 @@ namespace ScoreProcessor {
 		return did_something;
 	}
 
+	/*
+		Per-column and per-row counts of the pixels that are not background.
+		Built in one row-major pass; all four content bounds can then be read off it without touching the image again.
+	*/
+	struct content_profile {
+		std::vector<unsigned int> columns;
+		std::vector<unsigned int> rows;
+		//these give the same results as find_left, find_right, find_top and find_bottom
+		unsigned int left(unsigned int tolerance,bool cumulative=true) const;
+		unsigned int right(unsigned int tolerance,bool cumulative=true) const;
+		unsigned int top(unsigned int tolerance,bool cumulative=true) const;
+		unsigned int bottom(unsigned int tolerance,bool cumulative=true) const;
+	};
+
 	//BackgroundFinder:: returns true if a pixel is NOT part of the background
 	template<unsigned int NumLayers,typename T,typename BackgroundFinder>
-	unsigned int find_left(cil::CImg<T> const& img,unsigned int tolerance,BackgroundFinder bf,bool cumulative=true)
+	content_profile find_content_profile(cil::CImg<T> const& img,BackgroundFinder bf)
 	{
-		unsigned int num=0;
-		auto const size=img._width*img._height;
-		for(unsigned int x=0;x<img._width;++x)
+		content_profile profile;
+		auto const width=img._width;
+		auto const height=img._height;
+		size_t const size=size_t(width)*height;
+		profile.columns.assign(width,0);
+		profile.rows.assign(height,0);
+		auto const data=img._data;
+		for(unsigned int y=0;y<height;++y)
 		{
-			for(unsigned int y=0;y<img._height;++y)
+			auto const row=data+size_t(y)*width;
+			unsigned int num=0;
+			for(unsigned int x=0;x<width;++x)
 			{
-				auto pix=&img(x,y);
+				auto pix=row+x;
 				std::array<T,NumLayers> pixel;
 				for(unsigned int s=0;s<NumLayers;++s)
 				{
@@ -718,50 +760,32 @@ namespace ScoreProcessor {
 				}
 				if(bf(pixel))
 				{
+					++profile.columns[x];
 					++num;
 				}
 			}
-			if(num>=tolerance)
-			{
-				return x;
-			}
-			if(!cumulative)
-			{
-				num=0;
-			}
+			profile.rows[y]=num;
 		}
-		return img._width-1;
+		return profile;
+	}
+
+	/*
+		Content profile where pixels darker than background are content.
+		Grayscale images use the first layer, other images compare the sum of the first three layers against 3*background.
+		@param inclusive, whether pixels equal to the background also count as content
+	*/
+	content_profile find_content_profile(cil::CImg<unsigned char> const& img,unsigned char background,bool inclusive);
+
+	//BackgroundFinder:: returns true if a pixel is NOT part of the background
+	template<unsigned int NumLayers,typename T,typename BackgroundFinder>
+	unsigned int find_left(cil::CImg<T> const& img,unsigned int tolerance,BackgroundFinder bf,bool cumulative=true)
+	{
+		return find_content_profile<NumLayers>(img,bf).left(tolerance,cumulative);
 	}
 	template<unsigned int NumLayers,typename T,typename BackgroundFinder>
 	unsigned int find_right(cil::CImg<T> const& img,unsigned int tolerance,BackgroundFinder bf,bool cumulative=true)
 	{
-		unsigned int num=0;
-		auto const size=img._width*img._height;
-		for(unsigned int x=img._width-1;x<img._width;--x)
-		{
-			for(unsigned int y=0;y<img._height;++y)
-			{
-				auto pix=&img(x,y);
-				std::array<T,NumLayers> pixel;
-				for(unsigned int s=0;s<NumLayers;++s)
-				{
-					pixel[s]=*(pix+s*size);
-				}
-				if(bf(pixel))
-				{
-					++num;
-				}
-			}
-			if(num>=tolerance)
-			{
-				return x;
-			}
-			if(!cumulative)
-			{
-				num=0;
-			}
-		}
-		return 0;
+		return find_content_profile<NumLayers>(img,bf).right(tolerance,cumulative);
 	}
 
 	template<unsigned int NumLayers,typename T,typename BackgroundFinder>
@@ -928,11 +952,24 @@ namespace ScoreProcessor {
 		@param middleGray, pixels darker than this gray will be become more black by a factor of scale, higher whited by a factor of scale
 	*/
 	void binarize(::cimg_library::CImg<unsigned char>& image,ImageUtils::Grayscale const middleGray,float const scale=2.0f);
+	/*
+		Median of the window_width by window_height window around each pixel of the first channel, clipped to the image.
+		The window at (x,y) covers x-window_width/2 up to x-window_width/2+window_width and the same for y.
+		The median of a window of n pixels is the smallest value with at least n/2 of them at or below it.
+		Each row keeps a histogram per column and merges them into a kernel histogram one column at a time,
+		with a coarse histogram of 16 bins to find the median in and fine bins brought up to date only where it lands,
+		so the time per pixel does not grow with the window. Bands of rows run in parallel.
+	*/
+	::cil::CImg<unsigned char> sliding_median(::cil::CImg<unsigned char> const& image,unsigned int window_width,unsigned int window_height);
 	/*
 		Replaces grays in a range with another gray
 		@param image, must be 1 channel grayscale image
 	*/
 	bool replace_range(::cimg_library::CImg<unsigned char>& image,ImageUtils::Grayscale const lower,ImageUtils::Grayscale const upper=255,ImageUtils::Grayscale const replacer=ImageUtils::Grayscale::WHITE);
+	/*
+		Same as replace_range, but only on rows [top,bottom)
+	*/
+	bool replace_range(::cimg_library::CImg<unsigned char>& image,ImageUtils::Grayscale const lower,ImageUtils::Grayscale const upper,ImageUtils::Grayscale const replacer,unsigned int top,unsigned int bottom);
 	/*
 		Replaces certainly bright pixels with a color
 		@param image, must be 3 channel RGB
@@ -941,6 +978,7 @@ namespace ScoreProcessor {
 		@param replacer
 	*/
 	bool replace_by_brightness(::cimg_library::CImg<unsigned char>& image,unsigned char lowerBrightness,unsigned char upperBrightness=255,ImageUtils::ColorRGB replacer=ImageUtils::ColorRGB::WHITE);
+	bool replace_by_brightness(::cimg_library::CImg<unsigned char>& image,unsigned char lowerBrightness,unsigned char upperBrightness,ImageUtils::ColorRGB replacer,unsigned int top,unsigned int bottom);
 	/*
 		Replaces particularly chromatic pixels with a color
 		@param image, must be 3 channel RGB
@@ -950,6 +988,11 @@ namespace ScoreProcessor {
 	*/
 	bool replace_by_hsv(::cimg_library::CImg<unsigned char>& image,ImageUtils::ColorHSV startbound,ImageUtils::ColorHSV end,ImageUtils::ColorRGB replacer=ImageUtils::ColorRGB::WHITE);
 	bool replace_by_rgb(::cil::CImg<unsigned char>& image,ImageUtils::ColorRGB start,ImageUtils::ColorRGB end,ImageUtils::ColorRGB replacer);
+	/*
+		Row range [top,bottom) versions of the above
+	*/
+	bool replace_by_hsv(::cimg_library::CImg<unsigned char>& image,ImageUtils::ColorHSV startbound,ImageUtils::ColorHSV end,ImageUtils::ColorRGB replacer,unsigned int top,unsigned int bottom);
+	bool replace_by_rgb(::cil::CImg<unsigned char>& image,ImageUtils::ColorRGB start,ImageUtils::ColorRGB end,ImageUtils::ColorRGB replacer,unsigned int top,unsigned int bottom);
 
 	/*
 		Shifts selection over while leaving rest unchanged
@@ -1108,6 +1151,13 @@ namespace ScoreProcessor {
 		@return container, where the profile will be stored, as a vector of y coordinates of the bottom
 	*/
 	::std::vector<unsigned int> build_bottom_profile(::cimg_library::CImg<unsigned char> const& image,ImageUtils::Grayscale const background);
+	/*
+		Profiles of the foreground of a bit image, as above: the first foreground x of each row in the left half
+		and the last in the right half, or width/2 where a row has none. Rows are read a word at a time.
+		The Grayscale versions against white match these for BitImage(image,75), as gray_diff is squared.
+	*/
+	::std::vector<unsigned int> build_left_profile(BitImage const& image);
+	::std::vector<unsigned int> build_right_profile(BitImage const& image);
 	/*
 		Selects the outside (non-systems) of a score image
 		@param image, must be 1 channel grayscale
@@ -1132,6 +1182,24 @@ namespace ScoreProcessor {
 	*/
 	unsigned int cut_page(::cimg_library::CImg<unsigned char> const& image,char const* filename,cut_heuristics const& ch,int quality=100);
 
+	/*
+		Finds where cut_page cuts the image.
+		@return the seams between the pieces from top to bottom, each giving the row it passes through in every column
+	*/
+	::std::vector<::std::vector<unsigned int>> find_cuts(::cimg_library::CImg<unsigned char> const& image,cut_heuristics const& ch);
+
+	/*
+		One of the cuts.size()+1 pieces of the image between its seams, as cut_page saves it:
+		the rows from the highest point of the seam above to the lowest point of the seam below,
+		with what lies beyond either seam whitened.
+	*/
+	::cimg_library::CImg<unsigned char> cut_piece(::cimg_library::CImg<unsigned char> const& image,::std::vector<::std::vector<unsigned int>> const& cuts,size_t index);
+
+	/*
+		Cuts the image like cut_page, but returns the pieces instead of saving them.
+	*/
+	::std::vector<::cimg_library::CImg<unsigned char>> cut_page(::cimg_library::CImg<unsigned char> const& image,cut_heuristics const& ch);
+
 	/*
 		Finds the line that is the top of the score image
 		@param image
@@ -1167,7 +1235,30 @@ namespace ScoreProcessor {
 	*/
 	float auto_rotate(::cimg_library::CImg<unsigned char>& image,double pixel_prec,double min_angle,double max_angle,double angle_prec,unsigned char boundary=128);
 
-	float find_angle_bare(::cimg_library::CImg<unsigned char>& img,double pixel_prec,double min_angle,double max_angle,unsigned int angle_steps,unsigned char boundary=128,bool use_horizontal_transitions=true);
+	/*
+		Finds the angle of the image by a Hough transform on light to dark transitions.
+		@param coarse_steps if nonzero and less than angle_steps, a coarse pass with this many steps narrows the range before the fine pass
+		@return angle in radians
+	*/
+	float find_angle_bare(::cimg_library::CImg<unsigned char>& img,double pixel_prec,double min_angle,double max_angle,unsigned int angle_steps,unsigned char boundary=128,bool use_horizontal_transitions=true,unsigned int coarse_steps=0);
+	struct deskew_report {
+		//votes are the transitions found times the angles each one votes for, which is the work the coarse pass saves
+		size_t coarse_votes; //votes cast on the downscaled copy
+		unsigned int coarse_steps;
+		size_t fine_votes; //votes cast at full resolution around the coarse estimate
+		unsigned int fine_steps;
+		size_t direct_votes; //votes a direct search casts
+		unsigned int direct_steps;
+		double seconds;
+		double direct_seconds; //time taken by a direct search, run only to fill in the report
+		float direct_angle;
+	};
+	/*
+		Same as find_angle_bare, but first estimates the angle on a copy downscaled by downscale with angle_steps/downscale steps,
+		then searches only within one coarse step of that estimate at full resolution.
+		If report is given, it is filled in and a direct search is also run to time it against.
+	*/
+	float find_angle_downscaled(::cimg_library::CImg<unsigned char>& img,double pixel_prec,double min_angle,double max_angle,unsigned int angle_steps,unsigned int downscale,unsigned char boundary=128,bool use_horizontal_transitions=true,deskew_report* report=nullptr);
 	/*
 		Automatically levels the image.
 		@param image
@@ -1415,6 +1506,8 @@ namespace ScoreProcessor {
 
 	*/
 	void rescale_colors(::cimg_library::CImg<unsigned char>&,unsigned char min,unsigned char mid,unsigned char max=255);
+	//rescales rows [top,bottom) of the first layer
+	void rescale_colors(::cimg_library::CImg<unsigned char>&,unsigned char min,unsigned char mid,unsigned char max,unsigned int top,unsigned int bottom);
 	void hathi_correct(::cimg_library::CImg<unsigned char>&,unsigned char min,unsigned char mid,unsigned char max, unsigned char boundary);
 }
 template<typename T>
@@ -1752,67 +1845,108 @@ namespace ScoreProcessor {
 		throw std::invalid_argument("Unsupported spectrum conversion");
 	}
 
-	template<unsigned int num_layers,typename T,typename Selector>
-	std::vector<ImageUtils::Rectangle<unsigned int>> global_select(
+	/*
+		Scans rows [top,bottom) for runs of pixels kept by the selector,
+		calling on_kept(color) for each kept pixel and then on_run(rect) at the end of its run.
+		Runs come in order of row then left.
+	*/
+	template<unsigned int num_layers,typename T,typename Selector,typename OnKept,typename OnRun>
+	void scan_runs(
 		::cil::CImg<T> const& image,
-		Selector keep,bool compress=true)
+		Selector& keep,unsigned int top,unsigned int bottom,
+		OnKept&& on_kept,OnRun&& on_run)
 	{
 		static_assert(num_layers>0,"Positive number of layers required");
 		assert(image._spectrum>=num_layers);
+		assert(top<=bottom&&bottom<=image._height);
 		std::array<T,num_layers> color;
-		unsigned int range_found=0,range_start=0,range_end=0;
-		auto const height=image._height;
 		auto const width=image._width;
-		size_t const size=height*width;
+		size_t const size=size_t(image._height)*width;
 		auto const data=image._data;
-		std::vector<ImageUtils::Rectangle<unsigned int>> container;
-		for(unsigned int y=0;y<height;++y)
+		auto const read=[&color,size](T const* pix)
 		{
-			auto const row=data+y*width;
+			for(unsigned int i=0;i<num_layers;++i)
+			{
+				color[i]=*(pix+i*size);
+			}
+			return color;
+		};
+		for(unsigned int y=top;y<bottom;++y)
+		{
+			auto const row=data+size_t(y)*width;
 			for(unsigned int x=0;x<width;++x)
 			{
-				auto const pix=row+x;
-				for(unsigned int i=0;i<num_layers;++i)
-				{
-					color[i]=*(pix+i*size);
-				}
-				switch(range_found)
-				{
-				case 0:
+				if(!keep(read(row+x)))
 				{
-					if(keep(color))
-					{
-						range_found=1;
-						range_start=x;
-					}
-					break;
-				}
-				case 1:
-				{
-					if(!keep(color))
-					{
-						range_found=2;
-						range_end=x;
-					}
-					else
-					{
-						break;
-					}
+					continue;
 				}
-				case 2:
+				unsigned int const start=x;
+				do
 				{
-					container.push_back(ImageUtils::Rectangle<unsigned int>{range_start,range_end,y,y+1});
-					range_found=0;
-					break;
-				}
-				}
+					on_kept(color);
+				} while(++x<width&&keep(read(row+x)));
+				on_run(ImageUtils::Rectangle<unsigned int>{start,x,y,y+1});
 			}
-			if(1==range_found)
+		}
+	}
+
+	/*
+		Single row runs of the pixels kept by the selector in rows [top,bottom), sorted by row then left.
+	*/
+	template<unsigned int num_layers,typename T,typename Selector>
+	std::vector<ImageUtils::Rectangle<unsigned int>> select_rows(
+		::cil::CImg<T> const& image,
+		Selector keep,unsigned int top,unsigned int bottom)
+	{
+		std::vector<ImageUtils::Rectangle<unsigned int>> container;
+		scan_runs<num_layers>(image,keep,top,bottom,
+			[](auto const&)
+		{},
+			[&container](ImageUtils::Rectangle<unsigned int> run)
+		{
+			container.push_back(run);
+		});
+		return container;
+	}
+
+	/*
+		Same as select_rows, also measuring each run as it is selected.
+		A pixel's intensity is the sum of its first num_layers channels,
+		and pixels with intensity in [required_min,required_max] are counted as required.
+	*/
+	template<unsigned int num_layers,typename T,typename Selector>
+	void measure_rows(
+		::cil::CImg<T> const& image,
+		Selector keep,unsigned int required_min,unsigned int required_max,unsigned int top,unsigned int bottom,
+		std::vector<ImageUtils::Rectangle<unsigned int>>& runs,std::vector<run_measure>& measures)
+	{
+		run_measure current{~0U,0,0};
+		scan_runs<num_layers>(image,keep,top,bottom,
+			[&current,required_min,required_max](std::array<T,num_layers> const& color)
+		{
+			unsigned int intensity=0;
+			for(auto c:color)
 			{
-				container.push_back(ImageUtils::Rectangle<unsigned int>{range_start,image._width,y,y+1});
-				range_found=0;
+				intensity+=c;
 			}
-		}
+			current.min_intensity=std::min(current.min_intensity,intensity);
+			current.max_intensity=std::max(current.max_intensity,intensity);
+			current.required+=intensity>=required_min&&intensity<=required_max;
+		},
+			[&](ImageUtils::Rectangle<unsigned int> run)
+		{
+			runs.push_back(run);
+			measures.push_back(current);
+			current={~0U,0,0};
+		});
+	}
+
+	template<unsigned int num_layers,typename T,typename Selector>
+	std::vector<ImageUtils::Rectangle<unsigned int>> global_select(
+		::cil::CImg<T> const& image,
+		Selector keep,bool compress=true)
+	{
+		auto container=select_rows<num_layers>(image,keep,0,image._height);
 		if(compress)
 		{
 			ImageUtils::compress_rectangles(container);
@@ -1820,6 +1954,105 @@ namespace ScoreProcessor {
 		return container;
 	}
 
+	/*
+		Clusters of the pixels kept by the selector, found from their row runs with Cluster::cluster_runs.
+		Large images are selected and labeled in horizontal strips across the global pool and merged at the seams,
+		which gives the same clusters in the same order.
+	*/
+	namespace cluster_detail {
+		/*
+			Number of horizontal strips an image of this height is labeled in, at least 64 rows each.
+		*/
+		inline unsigned int strip_count(unsigned int height)
+		{
+			constexpr unsigned int min_strip_height=64;
+			return static_cast<unsigned int>(std::max<size_t>(1,std::min<size_t>(global_pool().num_threads()*4,height/min_strip_height)));
+		}
+		inline unsigned int strip_top(unsigned int height,size_t strip,unsigned int strip_count)
+		{
+			return static_cast<unsigned int>(size_t(height)*strip/strip_count);
+		}
+	}
+
+	template<unsigned int num_layers,typename T,typename Selector>
+	std::vector<Cluster> select_clusters(::cil::CImg<T> const& image,Selector keep,bool eight_way=false)
+	{
+		auto const strip_count=cluster_detail::strip_count(image._height);
+		if(strip_count<2)
+		{
+			return Cluster::cluster_runs(select_rows<num_layers>(image,keep,0,image._height),eight_way);
+		}
+		std::vector<std::vector<ImageUtils::Rectangle<unsigned int>>> strips(strip_count);
+		parallel_for(strip_count,[&](size_t s)
+		{
+			strips[s]=select_rows<num_layers>(image,keep,
+				cluster_detail::strip_top(image._height,s,strip_count),
+				cluster_detail::strip_top(image._height,s+1,strip_count));
+		});
+		return Cluster::cluster_strips(strips,eight_way);
+	}
+
+	/*
+		Clusters of the foreground of a bit image, the same as select_clusters gives for the pixels it marks,
+		with the runs of each row found a word at a time.
+	*/
+	std::vector<Cluster> select_clusters(BitImage const& image,bool eight_way=false);
+
+	/*
+		Labels the pixels kept by the selector like select_clusters, but keeps only a cluster_stats for each cluster,
+		measured as the pixels are selected (see measure_rows), along with the cluster each run belongs to.
+	*/
+	template<unsigned int num_layers,typename T,typename Selector>
+	labeled_runs label_clusters(
+		::cil::CImg<T> const& image,Selector keep,
+		unsigned int required_min=1,unsigned int required_max=0,
+		bool eight_way=false)
+	{
+		auto const strip_count=cluster_detail::strip_count(image._height);
+		std::vector<std::vector<ImageUtils::Rectangle<unsigned int>>> strips(strip_count);
+		std::vector<std::vector<run_measure>> measures(strip_count);
+		parallel_for(strip_count,[&](size_t s)
+		{
+			measure_rows<num_layers>(image,keep,required_min,required_max,
+				cluster_detail::strip_top(image._height,s,strip_count),
+				cluster_detail::strip_top(image._height,s+1,strip_count),
+				strips[s],measures[s]);
+		});
+		return labeled_runs::label_strips(strips,measures,eight_way);
+	}
+
+	/*
+		Fills the runs of every labeled cluster whose stats clear returns true for with replacer.
+		Returns whether anything was filled.
+	*/
+	template<typename T,size_t NL,typename StatsToTrueIfClear>
+	bool clear_labeled(
+		::cil::CImg<T>& img,
+		labeled_runs const& labeled,
+		std::array<T,NL> replacer,
+		StatsToTrueIfClear clear)
+	{
+		assert(img._spectrum>=NL);
+		std::vector<char> cleared(labeled.clusters.size());
+		bool edited=false;
+		for(size_t i=0;i<cleared.size();++i)
+		{
+			cleared[i]=clear(labeled.clusters[i]);
+			edited|=cleared[i]!=0;
+		}
+		if(edited)
+		{
+			for(size_t i=0;i<labeled.runs.size();++i)
+			{
+				if(cleared[labeled.labels[i]])
+				{
+					ScoreProcessor::fill_selection(img,labeled.runs[i],replacer);
+				}
+			}
+		}
+		return edited;
+	}
+
 	template<typename T,size_t NL,typename PixelSelectorArrayNLToBool,typename ClusterToTrueIfClear>
 	bool clear_clusters(
 		::cil::CImg<T>& img,
@@ -1828,8 +2061,7 @@ namespace ScoreProcessor {
 		ClusterToTrueIfClear cl)
 	{
 		assert(img._spectrum>=NL);
-		auto rects=global_select<NL>(img,ps);
-		auto clusters=ScoreProcessor::Cluster::cluster_ranges(rects);
+		auto clusters=select_clusters<NL>(img,ps);
 		bool edited=false;
 		for(auto it=clusters.cbegin();it!=clusters.cend();++it)
 		{
@@ -1853,8 +2085,7 @@ namespace ScoreProcessor {
 		ClusterToTrueIfClear cl)
 	{
 		assert(img._spectrum>=NL);
-		auto rects=global_select<NL>(img,ps);
-		auto clusters=ScoreProcessor::Cluster::cluster_ranges_8way(rects);
+		auto clusters=select_clusters<NL>(img,ps,true);
 		bool edited=false;
 		for(auto it=clusters.cbegin();it!=clusters.cend();++it)
 		{
@@ -8,7 +8,10 @@
 #include <assert.h>
 #include <unordered_set>
 #include "Splice.h"
+#include "WorkerPool.h"
 #include "lib/exstring/exiterator.h"
+#include <memory>
+#include <mutex>
 #ifdef MAKE_README
 #include <fstream>
 #endif
@@ -473,7 +476,39 @@ InputIter find_file_list(InputIter begin, InputIter end)
 //applies the single image processes
 void do_single(CommandMaker::delivery const& del, std::vector<std::string> const& files)
 {
-	del.pl.process(files, &del.sr, del.num_threads, del.starting_index, del.do_move, del.quality, del.make_folders);
+	if(!del.pipelined)
+	{
+		del.pl.process(files, &del.sr, del.num_threads, del.starting_index, del.do_move, del.quality, del.make_folders);
+		return;
+	}
+	using pipeline_options = ProcessList<unsigned char>::pipeline_options;
+	pipeline_options const options{del.pipeline_args.readers, del.num_threads, del.pipeline_args.writers, del.pipeline_args.queue_depth};
+	try
+	{
+		auto const stats = del.pl.process_pipelined(files, &del.sr, options, del.starting_index, del.do_move, del.quality, del.make_folders);
+		if(del.pl.get_verbosity() > ProcessList<>::verbosity::errors_only)
+		{
+			auto stage_report = [wall = stats.wall_seconds](char const* name, auto const& stage)
+			{
+				std::cout << name << stage.count << " images on " << stage.num_threads << (stage.num_threads == 1 ? " thread, " : " threads, ")
+					<< stage.busy_seconds << "s busy, " << stage.wait_seconds << "s waiting";
+				if(wall > 0)
+				{
+					std::cout << ", " << stage.count / wall << " images/s";
+				}
+				std::cout << '\n';
+			};
+			std::cout << "\nPipeline finished in " << stats.wall_seconds << "s\n";
+			stage_report("  Decode:  ", stats.read);
+			stage_report("  Process: ", stats.work);
+			stage_report("  Encode:  ", stats.write);
+			std::cout << "  Peak images in memory: " << stats.peak_in_flight << " (bound " << stats.max_in_flight << ")\n";
+		}
+	}
+	catch(std::exception const& ex)
+	{
+		std::cout << "Error(s):\n" << ex.what() << '\n';
+	}
 }
 
 //applies the cut process to the images
@@ -539,7 +574,24 @@ void do_cut(CommandMaker::delivery const& del, std::vector<std::string> const& f
 				cut_args.min_height = (ca->min_height)(bases);
 				cut_args.min_width = ca->min_width(bases);
 				cut_args.minimum_vertical_space = ca->min_vert_space(bases);
-				auto num_pages = ScoreProcessor::cut_page(in, out.c_str(), cut_args, ca->quality);
+				unsigned int num_pages;
+				if(del->pl.empty())
+				{
+					num_pages = ScoreProcessor::cut_page(in, out.c_str(), cut_args, ca->quality);
+				}
+				else
+				{
+					auto pieces = ScoreProcessor::cut_page(in, cut_args);
+					in.assign();
+					num_pages = static_cast<unsigned int>(pieces.size());
+					for(unsigned int p = 0; p < num_pages; ++p)
+					{
+						del->pl.process_logged(pieces[p], index);
+						auto const save_name = num_pages == 1 ? out : cil::number_filename(out, p + 1, 3U);
+						cil::save_image(pieces[p], save_name.c_str(), s, ca->quality);
+						pieces[p].assign();
+					}
+				}
 				if(ca->verbosity > ProcessList<>::verbosity::errors_only)
 				{
 					std::string coutput("Finished ");
@@ -572,13 +624,106 @@ void do_cut(CommandMaker::delivery const& del, std::vector<std::string> const& f
 	del.pl.get_log(),
 	del.quality
 	};
-	exlib::thread_pool_a<cut_args const*> tp(del.num_threads, &ca);
+	parallel_for(files.size(), [&files, &del, &ca](size_t i) {
+		CutProcess{&files[i],static_cast<unsigned int>(i + del.starting_index),del}.execute(&ca);
+	}, del.num_threads);
+}
+
+//the heuristics the cut args give for the image
+cut_heuristics make_cut_heuristics(CommandMaker::delivery const& del, cil::CImg<unsigned char> const& img)
+{
+	cut_heuristics ch;
+	ch.background = del.cut_args.background;
+	ch.horizontal_energy_weight = del.cut_args.horiz_weight;
+	std::array<unsigned int, 2> bases{img._width,img._height};
+	ch.min_height = del.cut_args.min_height(bases);
+	ch.min_width = del.cut_args.min_width(bases);
+	ch.minimum_vertical_space = del.cut_args.min_vert_space(bases);
+	return ch;
+}
+
+//makes the pages splice works on from the files: their cut pieces if cut_first, each with the single processes applied
+//pages gets the file each page comes from
+Splice::page_source make_page_source(CommandMaker::delivery const& del, std::vector<std::string> const& files, std::vector<std::string>& pages)
+{
+	if(!del.cut_first)
+	{
+		pages = files;
+		return [&del, &files](size_t page)
+		{
+			cil::CImg<unsigned char> img(files[page].c_str());
+			del.pl.process_logged(img, page + del.starting_index);
+			return img;
+		};
+	}
+	//the seams are found up front, since how many pieces a file gives decides which pages come from it,
+	//and each file is decoded again while its pieces are in use
+	struct source_file {
+		std::vector<std::vector<unsigned int>> cuts;
+		std::mutex mtx;
+		std::shared_ptr<cil::CImg<unsigned char> const> img;
+		size_t pieces_left;
+	};
+	struct source_state {
+		std::unique_ptr<source_file[]> sources;
+		std::vector<std::pair<size_t, size_t>> piece_of; //file and piece index of each page
+	};
+	auto state = std::make_shared<source_state>();
+	state->sources = std::make_unique<source_file[]>(files.size());
+	std::mutex error_lock;
+	std::string error_log;
+	parallel_for(files.size(), [&](size_t i)
+	{
+		try
+		{
+			cil::CImg<unsigned char> const img(files[i].c_str());
+			state->sources[i].cuts = find_cuts(img, make_cut_heuristics(del, img));
+		}
+		catch(std::exception const& ex)
+		{
+			std::lock_guard<std::mutex> lock(error_lock);
+			error_log.append("Error cutting ").append(files[i]).append(": ").append(ex.what()).append(1, '\n');
+		}
+	}, del.num_threads);
+	if(!error_log.empty())
+	{
+		throw std::runtime_error(error_log);
+	}
+	pages.clear();
 	for(size_t i = 0; i < files.size(); ++i)
 	{
-		tp.push_back([process = CutProcess{&files[i],static_cast<unsigned int>(i + del.starting_index),del}](cut_args const* ca) noexcept {
-			process.execute(ca);
-		});
+		auto& source = state->sources[i];
+		source.pieces_left = source.cuts.size() + 1;
+		for(size_t k = 0; k < source.pieces_left; ++k)
+		{
+			state->piece_of.emplace_back(i, k);
+			pages.push_back(files[i]);
+		}
 	}
+	return [state, &del, &files](size_t page)
+	{
+		auto const [file, index] = state->piece_of[page];
+		auto& source = state->sources[file];
+		std::shared_ptr<cil::CImg<unsigned char> const> img;
+		{
+			std::lock_guard<std::mutex> lock(source.mtx);
+			if(!source.img)
+			{
+				source.img = std::make_shared<cil::CImg<unsigned char> const>(files[file].c_str());
+			}
+			img = source.img;
+			//the count starts over once every piece has been taken, in case the pages are asked for again
+			if(--source.pieces_left == 0)
+			{
+				source.pieces_left = source.cuts.size() + 1;
+				source.img.reset();
+			}
+		}
+		auto piece = cut_piece(*img, source.cuts, index);
+		img.reset();
+		del.pl.process_logged(piece, page + del.starting_index);
+		return piece;
+	};
 }
 
 //applies the splice process
@@ -590,10 +735,16 @@ void do_splice(CommandMaker::delivery const& del, std::vector<std::string> const
 		// auto ext = exlib::find_extension(save.begin(), save.end());
 		// validate_extension(ext);
 		Splice::standard_heuristics sh;
-		Splice::options const options{ del.starting_index, del.num_threads, del.quality, del.make_folders };
+		Splice::options options{ del.starting_index, del.quality, del.make_folders, size_t(del.splice_cache_mb) << 20, del.splice_lookahead };
+		std::vector<std::string> pieces;
+		if(del.cut_first || !del.pl.empty())
+		{
+			options.source = make_page_source(del, files, pieces);
+		}
+		auto const& pages = options.source ? pieces : files;
 		auto num = del.splice_divider.data() ?
-			splice_pages_parallel(files, del.sr, options, del.splice_args, del.splice_divider) :
-			splice_pages_parallel(files, del.sr, options, del.splice_args);
+			splice_pages_parallel(pages, del.sr, options, del.splice_args, del.splice_divider) :
+			splice_pages_parallel(pages, del.sr, options, del.splice_args);
 		std::cout << "Created " << num << (num == 1 ? " page\n" : " pages\n");
 	}
 	catch(std::exception const& ex)
@@ -757,6 +908,7 @@ int main(int argc, InputIter argv)
 		list_files(files);
 	}
 	del.fix_values(files.size());
+	set_core_budget(del.core_budget);
 	if(has_collisions(files.begin(), files.end(), del.sr, del.starting_index))
 	{
 		std::cout << "Collision in output names\n";
@@ -792,6 +944,17 @@ int main(int argc, InputIter argv)
 		del.pl.set_log(&cl);
 		del.pl.set_verbosity(del.pl.loud);
 	}
+	if(!del.pl.empty())
+	{
+		auto const fusions = fuse_pixel_processes(del.pl);
+		if(del.lt == del.full_message)
+		{
+			for(auto const& fusion : fusions)
+			{
+				del.pl.get_log()->log(fusion + '\n', 0);
+			}
+		}
+	}
 	switch(del.flag)
 	{
 	case del.do_absolutely_nothing:
@@ -1,15 +1,183 @@
 #include "stdafx.h"
 #include "Splice.h"
 #include "ScoreProcesses.h"
+#include "PixelKernels.h"
 #ifdef HSPROC
 #include "Processes.h"
 #endif
 namespace ScoreProcessor {
 
-	template<typename TreatPixel>//function (tog_pixel_pointer,tog_size,current_img,x,y)
-	cil::CImg<unsigned char>& splice_images_h(Splice::page const* imgs,size_t num,unsigned int padding,cil::CImg<unsigned char>& tog,TreatPixel tp)
+	namespace Splice {
+		page_cache::page_cache(std::vector<std::string> const& filenames,size_t byte_budget,unsigned int uses_per_page,page_source source):
+			_pages(filenames.size()),
+			_source(std::move(source)),
+			_budget(byte_budget),
+			_largest(0),
+			_low(0),
+			_next_prefetch(0)
+		{
+			for(size_t i=0;i<filenames.size();++i)
+			{
+				auto& page=_pages[i];
+				page.filename=filenames[i].c_str();
+				page.uses_left=uses_per_page;
+				page.status=state::unloaded;
+			}
+		}
+
+		bool page_cache::in_window(size_t page) const
+		{
+			size_t const window=_largest?std::max<size_t>(2,_budget/_largest):2;
+			return page<_low+window;
+		}
+
+		cil::CImg<unsigned char> const& page_cache::acquire(size_t page)
+		{
+			assert(page<_pages.size());
+			std::unique_lock<std::mutex> lock(_mtx);
+			auto& entry=_pages[page];
+			if(entry.status==state::unloaded)
+			{
+				lock.unlock();
+				load(page);
+				lock.lock();
+			}
+			_loaded.wait(lock,[&entry]()
+			{
+				return entry.status!=state::loading;
+			});
+			if(entry.status==state::failed)
+			{
+				std::rethrow_exception(entry.error);
+			}
+			lock.unlock();
+			prefetch();
+			return entry.img;
+		}
+
+		void page_cache::release(size_t page)
+		{
+			{
+				std::lock_guard<std::mutex> lock(_mtx);
+				auto& entry=_pages[page];
+				assert(entry.uses_left!=0);
+				if(--entry.uses_left!=0)
+				{
+					return;
+				}
+				entry.img.assign();
+				while(_low<_pages.size()&&_pages[_low].uses_left==0)
+				{
+					++_low;
+				}
+			}
+			prefetch();
+		}
+
+		//decodes the page unless someone else already is or has
+		void page_cache::load(size_t page)
+		{
+			auto& entry=_pages[page];
+			{
+				std::lock_guard<std::mutex> lock(_mtx);
+				if(entry.status!=state::unloaded||entry.uses_left==0)
+				{
+					return;
+				}
+				entry.status=state::loading;
+			}
+			cil::CImg<unsigned char> img;
+			std::exception_ptr error;
+			try
+			{
+				if(_source)
+				{
+					img=_source(page);
+				}
+				else
+				{
+					img.load(entry.filename);
+				}
+				if(img._spectrum==2)
+				{
+					cil::CImg<unsigned char> temp(img._width,img._height,1,4);
+					size_t const size=size_t{temp._width}*temp._height;
+					std::memcpy(temp.data(),img.data(),size);
+					std::memcpy(temp.data()+size,img.data(),size);
+					std::memcpy(temp.data()+2*size,img.data(),size);
+					std::memset(temp.data()+3*size,255,size);
+					img=std::move(temp);
+				}
+			}
+			catch(...)
+			{
+				error=std::current_exception();
+			}
+			{
+				std::lock_guard<std::mutex> lock(_mtx);
+				if(error)
+				{
+					entry.error=error;
+					entry.status=state::failed;
+				}
+				else
+				{
+					_largest=std::max<size_t>(_largest,img.size());
+					entry.img=std::move(img);
+					entry.status=state::ready;
+				}
+			}
+			_loaded.notify_all();
+		}
+
+		//queues decodes of the pages that have come into the window, in page order
+		void page_cache::prefetch()
+		{
+			size_t first,last;
+			{
+				std::lock_guard<std::mutex> lock(_mtx);
+				first=std::max(_next_prefetch,_low);
+				last=first;
+				while(last<_pages.size()&&in_window(last))
+				{
+					++last;
+				}
+				_next_prefetch=last;
+			}
+			for(size_t page=first;page<last;++page)
+			{
+				_prefetches.run([this,page]() noexcept
+				{
+					load(page);
+				});
+			}
+		}
+	}
+
+	//fills rows [from,to) of every channel with white
+	void fill_rows(cil::CImg<unsigned char>& tog,unsigned int from,unsigned int to)
+	{
+		if(from<to)
+		{
+			for(unsigned int c=0;c<tog._spectrum;++c)
+			{
+				std::memset(tog.data(0,from,c),255,size_t{tog._width}*(to-from));
+			}
+		}
+	}
+
+	/*
+		Writes the pages into tog a row at a time, aligned to the right edge.
+		A row that no earlier page reached is still uninitialized and is written by copy(dst,size,current,y),
+		a row that one did is composited by blend(dst,size,current,y),
+		where dst is where the row of the page starts in tog and size is the channel stride of tog.
+		Everything that no page covers is filled with white, so tog does not have to be cleared first.
+	*/
+	template<typename Copy,typename Blend>
+	cil::CImg<unsigned char>& splice_images_h(Splice::page const* imgs,size_t num,unsigned int padding,cil::CImg<unsigned char>& tog,Copy copy,Blend blend)
 	{
 		unsigned int ypos=padding;
+		unsigned int filled=0;
 		auto const size=size_t{tog._width}*tog._height;
 		for(size_t i=0;i<num;++i)
 		{
@@ -31,16 +199,32 @@ namespace ScoreProcessor {
 			{
 				end=current.img._height;
 			}
-			for(unsigned int y=begin;y<end;++y)
+			if(begin<end)
 			{
-				auto yabs=ypos+y-current.top;
-				for(unsigned int x=1;x<=current.img._width;++x)
+				unsigned int const first=ypos+begin-current.top;
+				unsigned int const margin=tog._width-current.img._width;
+				fill_rows(tog,filled,first);
+				for(unsigned int y=begin;y<end;++y)
 				{
-					tp(&tog(tog._width-x,yabs),size,current.img,current.img._width-x,y);
+					auto const yabs=first+(y-begin);
+					if(yabs<filled)
+					{
+						blend(tog.data(margin,yabs),size,current.img,y);
+					}
+					else
+					{
+						for(unsigned int c=0;c<tog._spectrum;++c)
+						{
+							std::memset(tog.data(0,yabs,c),255,margin);
+						}
+						copy(tog.data(margin,yabs),size,current.img,y);
+					}
 				}
+				filled=std::max(filled,first+(end-begin));
 			}
 			ypos+=padding+current.true_height();
 		}
+		fill_rows(tog,filled,tog._height);
 		return tog;
 	}
 
@@ -62,120 +246,75 @@ namespace ScoreProcessor {
 			}
 		}
 		height+=padding*(num+1);
+		//left uninitialized, splice_images_h writes every pixel exactly once before it is blended with
 		cil::CImg<unsigned char> tog(width,height,1,spectrum);
-		tog.fill(255);
 		switch(spectrum)
 		{
 		case 1:
 		case 2:
-			return splice_images_h(imgs,num,padding,tog,[](unsigned char* pixel,size_t const size,cil::CImg<unsigned char> const& current,unsigned int x,unsigned int y)
-				{
-					*pixel=std::min(*pixel,current(x,y));
-				});
-			/*return splice_images_h(imgs,num,padding,tog,[](unsigned char* pixel,size_t const size,cil::CImg<unsigned char> const& current,unsigned int x,unsigned int y)
-			{
-				double dark=(255U-*pixel)*(pixel[size]/255.0);
-				double cdark;
-				auto const cpixel=&current(x,y);
-				size_t csize;
-				switch(current._spectrum)
+			//the darker gray wins, an alpha channel stays opaque
+			return splice_images_h(imgs,num,padding,tog,[spectrum](unsigned char* pixel,size_t const size,cil::CImg<unsigned char> const& current,unsigned int y)
 				{
-					case 1:
-						cdark=255U-*cpixel;
-						break;
-					case 2:
-						cdark=(255U-*cpixel)*(cpixel[csize=current._width*current._height]/255.0);
-				}
-				if(cdark>dark)
-				{
-					switch(current._spectrum)
+					std::memcpy(pixel,current.data(0,y),current._width);
+					if(spectrum==2)
 					{
-						case 1:
-							*pixel=*cpixel;
-							pixel[size]=255;
-							break;
-						case 2:
-							*pixel=*cpixel;
-							pixel[size]=cpixel[csize];
+						std::memset(pixel+size,255,current._width);
 					}
-				}
-			});*/
+				},[](unsigned char* pixel,size_t const size,cil::CImg<unsigned char> const& current,unsigned int y)
+				{
+					kernels::min_into(pixel,current.data(0,y),current._width);
+				});
 		case 3:
-			using pinfo=uint_fast32_t;
-			return splice_images_h(imgs,num,padding,tog,[](unsigned char* pixel,size_t const size,cil::CImg<unsigned char> const& current,unsigned int x,unsigned int y)
+			//the pixel with the darker channel sum wins whole, gray pages count as three equal channels
+			return splice_images_h(imgs,num,padding,tog,[](unsigned char* pixel,size_t const size,cil::CImg<unsigned char> const& current,unsigned int y)
 				{
-					pinfo const br=(pinfo{pixel[0]}+pixel[size]+pixel[2*size]);
-					size_t csize;
-					pinfo cbr;
-					auto const cpixel=&current(x,y);
-					switch(current._spectrum)
-					{
-					case 1:
-						cbr=*cpixel*3U;
-						break;
-					case 3:
-						csize=size_t{current._height}*current._width;
-						cbr=pinfo{cpixel[0]}+cpixel[csize]+cpixel[2*csize];
-					}
-					if(cbr<br)
+					for(unsigned int c=0;c<3;++c)
 					{
-						switch(current._spectrum)
-						{
-						case 1:
-							pixel[0]=pixel[size]=pixel[2*size]=cpixel[0];
-							break;
-						case 3:
-							pixel[0]=cpixel[0];
-							pixel[size]=cpixel[csize];
-							pixel[2*size]=cpixel[2*csize];
-						}
+						std::memcpy(pixel+c*size,current.data(0,y,current._spectrum<3?0:c),current._width);
 					}
+				},[](unsigned char* pixel,size_t const size,cil::CImg<unsigned char> const& current,unsigned int y)
+				{
+					bool const gray=current._spectrum<3;
+					kernels::darker_into(pixel,pixel+size,pixel+2*size,
+						current.data(0,y,0),current.data(0,y,gray?0:1),current.data(0,y,gray?0:2),current._width);
 				});
 		case 4:
-			return splice_images_h(imgs,num,padding,tog,[](unsigned char* pixel,size_t const size,cil::CImg<unsigned char> const& current,unsigned int x,unsigned int y)
+		{
+			//darkness weighted by alpha decides, which needs more than 16 bits, so this stays scalar
+			auto blend=[](unsigned char* pixel,size_t const size,cil::CImg<unsigned char> const& current,unsigned int y)
+			{
+				using pinfo=uint_fast32_t;
+				constexpr pinfo max=3U*255U;
+				bool const gray=current._spectrum<3;
+				unsigned char const* const r=current.data(0,y,0);
+				unsigned char const* const g=current.data(0,y,gray?0:1);
+				unsigned char const* const b=current.data(0,y,gray?0:2);
+				unsigned char const* const a=current._spectrum==4?current.data(0,y,3):nullptr;
+				for(unsigned int x=0;x<current._width;++x)
 				{
-					constexpr pinfo max=3U*255U;
-					pinfo drk=(max-(pinfo{pixel[0]}+pixel[size]+pixel[2*size]))*pixel[3*size];
-					size_t csize;
-					pinfo cdrk;
-					auto const cpixel=&current(x,y);
-					switch(current._spectrum)
+					pinfo const drk=(max-(pinfo{pixel[x]}+pixel[x+size]+pixel[x+2*size]))*pixel[x+3*size];
+					unsigned char const alpha=a?a[x]:255;
+					pinfo const cdrk=(max-(pinfo{r[x]}+g[x]+b[x]))*alpha;
+					if(cdrk>drk)
 					{
-					case 1:
-						cdrk=(max-(*cpixel*3U))*255U;
-						break;
-					case 3:
-						csize=size_t{current._height}*current._width;
-						cdrk=(max-(pinfo{cpixel[0]}+cpixel[csize]+cpixel[2*csize]))*255U;
-						break;
-					case 4:
-						csize=size_t{current._height}*current._width;
-						cdrk=(max-(pinfo{cpixel[0]}+cpixel[csize]+cpixel[2*csize]))*cpixel[3*csize];
-						break;
+						pixel[x]=r[x];
+						pixel[x+size]=g[x];
+						pixel[x+2*size]=b[x];
+						pixel[x+3*size]=alpha;
 					}
-					if(cdrk>drk)
+				}
+			};
+			return splice_images_h(imgs,num,padding,tog,[blend](unsigned char* pixel,size_t const size,cil::CImg<unsigned char> const& current,unsigned int y)
+				{
+					for(unsigned int c=0;c<4;++c)
 					{
-						switch(current._spectrum)
-						{
-						case 1:
-							pixel[0]=pixel[size]=pixel[2*size]=cpixel[0];
-							pixel[3*size]=255;
-							break;
-						case 3:
-							pixel[0]=cpixel[0];
-							pixel[size]=cpixel[csize];
-							pixel[2*size]=cpixel[2*csize];
-							pixel[3*size]=255;
-							break;
-						case 4:
-							pixel[0]=cpixel[0];
-							pixel[size]=cpixel[csize];
-							pixel[2*size]=cpixel[2*csize];
-							pixel[3*size]=cpixel[3*csize];
-						}
+						std::memset(pixel+c*size,255,current._width);
 					}
-				});
+					blend(pixel,size,current,y);
+				},blend);
+		}
 		}
+		return tog;
 	}
 
 	struct spacing {
@@ -203,74 +342,38 @@ namespace ScoreProcessor {
 		return ret;
 	}
 
+	//both scan whole rows, so the first row with any dark pixel ends the search
 	unsigned int splice_find_top(cil::CImg<unsigned char> const& img,unsigned char bg)
 	{
-		unsigned int min=img._height/2;
-		if(img._spectrum<3)
-		{
-			for(unsigned int x=0;x<img._width;++x)
-			{
-				for(unsigned int y=0;y<min;++y)
-				{
-					if(img(x,y)<=bg)
-					{
-						min=y;
-						break;
-					}
-				}
-			}
-		}
-		else
+		unsigned int const limit=img._height/2;
+		for(unsigned int y=0;y<limit;++y)
 		{
-			unsigned int limit=3U*bg;
-			for(unsigned int x=0;x<img._width;++x)
+			size_t const found=img._spectrum<3?
+				kernels::find_below(img.data(0,y),img._width,bg+1U):
+				kernels::find_sum_below(img.data(0,y,0),img.data(0,y,1),img.data(0,y,2),img._width,3U*bg+1);
+			if(found<img._width)
 			{
-				for(unsigned int y=0;y<min;++y)
-				{
-					if(static_cast<unsigned int>(img(x,y))+img(x,y,1)+img(x,y,2)<=limit)
-					{
-						min=y;
-						break;
-					}
-				}
+				return y;
 			}
 		}
-		return min;
+		return limit;
 	}
 
 	unsigned int splice_find_bottom(cil::CImg<unsigned char> const& img,unsigned char bg)
 	{
-		unsigned int max=img._height/2;
-		if(img._spectrum<3)
-		{
-			for(unsigned int x=0;x<img._width;++x)
-			{
-				for(unsigned int y=img._height-1;y>max;--y)
-				{
-					if(img(x,y)<=bg)
-					{
-						max=y;
-						break;
-					}
-				}
-			}
-		}
-		else
+		unsigned int const limit=img._height/2;
+		for(unsigned int y=img._height;y>limit+1;)
 		{
-			unsigned int limit=3U*bg;
-			for(unsigned int x=0;x<img._width;++x)
+			--y;
+			size_t const found=img._spectrum<3?
+				kernels::find_below(img.data(0,y),img._width,bg+1U):
+				kernels::find_sum_below(img.data(0,y,0),img.data(0,y,1),img.data(0,y,2),img._width,3U*bg+1);
+			if(found<img._width)
 			{
-				for(unsigned int y=img._height-1;y>max;--y)
-				{
-					if(static_cast<unsigned int>(img(x,y))+img(x,y,1)+img(x,y,2)<=limit)
-					{
-						max=y;
-						break;
-					}
-				}
+				return y;
 			}
 		}
-		return max;
+		return limit;
 	}
 
 	void get_optimal_values(Splice::standard_heuristics const& sh,cil::CImg<unsigned char> const& ref,
@@ -301,6 +404,13 @@ namespace ScoreProcessor {
 		return height_cost+padding_cost;
 	};
 
+	//past the optimal height padding is at its minimum, so more pages only add to the height cost
+	//costs are only never negative with non-negative weights
+	bool layout_overfull(Splice::page_layout p,Splice::standard_heuristics const& sh,unsigned int opt_height)
+	{
+		return sh.excess_weight>=0&&sh.padding_weight>=0&&p.height>opt_height;
+	}
+
 	unsigned int splice_pages_parallel(
 		std::vector<std::string> const& filenames,
 		SaveRules const& output_rule,
@@ -311,14 +421,10 @@ namespace ScoreProcessor {
 		{
 			throw std::invalid_argument("Need multiple pages to splice");
 		}
-		std::vector<Splice::manager> managers(filenames.size());
-		for(size_t i=0;i<filenames.size();++i)
-		{
-			managers[i].fname(filenames[i].c_str());
-		}
-		managers[0].load();
+		//two uses to evaluate each page and one to output it
+		Splice::page_cache pages(filenames,options.cache_bytes,3,options.source);
 		unsigned int horiz_padding,min_pad,opt_pad,opt_height;
-		get_optimal_values(sh,managers[0].img(),horiz_padding,min_pad,opt_pad,opt_height);
+		get_optimal_values(sh,pages.acquire(0),horiz_padding,min_pad,opt_pad,opt_height);
 		using Img=cil::CImg<unsigned char>;
 		auto find_top=[bg=sh.background_color](Img const& img){
 			if(img._spectrum<3)
@@ -399,6 +505,10 @@ namespace ScoreProcessor {
 		{
 			return layout_cost(p,sh,horiz_padding,opt_pad,opt_height);
 		};
+		auto overfull=[=](Splice::page_layout const p)
+		{
+			return layout_overfull(p,sh,opt_height);
+		};
 		auto saver = [quality = options.quality, width = sh.optimal_height, make_folders = options.make_folders](auto const& image, char const* name)
 		{
 			auto support = supported_path(name);
@@ -428,7 +538,11 @@ namespace ScoreProcessor {
 			}
 			return cil::save_image(save, name, support, quality);
 		};
-		return splice_pages_parallel(managers,output_rule,options.starting_index,options.num_threads,pe,create_layout,cost,&splice_images, saver);
+		if(options.lookahead)
+		{
+			return splice_pages_streaming(pages,output_rule,options.starting_index,options.lookahead,pe,create_layout,cost,overfull,&splice_images,saver);
+		}
+		return splice_pages_parallel(pages,output_rule,options.starting_index,pe,create_layout,cost,overfull,&splice_images, saver);
 	}
 
 	unsigned int splice_pages_parallel(
@@ -447,30 +561,33 @@ namespace ScoreProcessor {
 		// validate_extension(extension);
 		Splice::page divider_desc{{divider,true}};
 		std::vector<Splice::page> descriptions(filenames.size());
-		exlib::thread_pool pool{options.num_threads};
+		//one use to measure each page and one to output it
+		Splice::page_cache pages(filenames,options.cache_bytes,2,options.source);
 		std::mutex error_lock;
 		std::string error_log;
+		task_group group;
 		unsigned int horiz_padding,min_pad,opt_pad,opt_height;
 		auto get_dims=[bg=sh.background_color](Splice::page& page){
 			page.top=splice_find_top(page.img,bg);
 			page.bottom=splice_find_bottom(page.img,bg);
 		};
-		pool.push_back([get_dims,&divider_desc]() noexcept
+		group.run([get_dims,&divider_desc]() noexcept
 		{
 			get_dims(divider_desc);
 		});
-		pool.push_back([&,&desc=descriptions[0],&name=filenames[0],bg=get_dims](decltype(pool)::parent_ref parent) noexcept
+		group.run([&,&desc=descriptions[0],&name=filenames[0],bg=get_dims]() noexcept
 		{
+			Splice::page_use use(pages,0);
 			try
 			{
-				desc.img.load(name.c_str());
+				desc.img.assign(use.img(),true);
 				get_dims(desc);
 				get_optimal_values(sh,desc.img,horiz_padding,min_pad,opt_pad,opt_height);
-				desc.img=cil::CImg<unsigned char>{};
+				desc.img.assign();
 			}
 			catch(std::exception const& err)
 			{
-				parent.stop();
+				group.cancel();
 				std::lock_guard guard{error_lock};
 				error_log.append(name).append(": ").append(err.what()).append("\n");
 			}
@@ -478,23 +595,24 @@ namespace ScoreProcessor {
 		);
 		for(std::size_t i=1;i<descriptions.size();++i)
 		{
-			pool.push_back([&,&desc=descriptions[i],&name=filenames[i],get_dims](decltype(pool)::parent_ref parent) noexcept
+			group.run([&,&desc=descriptions[i],&name=filenames[i],i,get_dims]() noexcept
 			{
+				Splice::page_use use(pages,i);
 				try
 				{
-					desc.img.load(name.c_str());
+					desc.img.assign(use.img(),true);
 					get_dims(desc);
-					desc.img=cil::CImg<unsigned char>{};
+					desc.img.assign();
 				}
 				catch(std::exception const& err)
 				{
-					parent.stop();
+					group.cancel();
 					std::lock_guard guard{error_lock};
 					error_log.append(name).append(": ").append(err.what()).append("\n");
 				}
 			});
 		}
-		pool.wait();
+		group.wait();
 		if(!error_log.empty())
 		{
 			throw std::runtime_error(error_log);
@@ -523,6 +641,10 @@ namespace ScoreProcessor {
 			[=](Splice::page_layout const p)
 			{
 				return layout_cost(p,sh,horiz_padding,opt_pad,opt_height);
+			},
+			[=](Splice::page_layout const p)
+			{
+				return layout_overfull(p,sh,opt_height);
 			});
 		unsigned int num_digs=exlib::num_digits(breaks.size()+options.starting_index);
 		num_digs=num_digs<3?3:num_digs;
@@ -533,19 +655,25 @@ namespace ScoreProcessor {
 			++num_imgs;
 			auto const end=breaks[i].index;
 			auto const s=end-start;
-			pool.push_back(
+			group.run(
 				[&,
 				filename_index=start+options.starting_index,
+				first=size_t(start),
 				fbegin=filenames.data()+start,
 				ibegin=descriptions.data()+start,
 				num_pages=s,
 				padding=breaks[i].padding,
 				quality=options.quality,
-				make_folders=options.make_folders](decltype(pool)::parent_ref parent) noexcept{
+				make_folders=options.make_folders]() noexcept{
+				std::deque<Splice::page_use> uses;
+				for(size_t i=0;i<num_pages;++i)
+				{
+					uses.emplace_back(pages,first+i);
+				}
 				try
 				{
 					std::vector<Splice::page> imgs(num_pages*2-1);
-					imgs[0].img.load(fbegin->c_str());
+					imgs[0].img.assign(uses[0].img(),true);
 					imgs[0].top=ibegin->top;
 					imgs[0].bottom=ibegin->bottom;
 					for(size_t i=1;i<num_pages;++i)
@@ -553,7 +681,7 @@ namespace ScoreProcessor {
 						imgs[2*i-1].img=cil::CImg{divider,true};
 						imgs[2*i-1].top=divider_desc.top;
 						imgs[2*i-1].bottom=divider_desc.bottom;
-						imgs[2*i].img.load(fbegin[i].c_str());
+						imgs[2*i].img.assign(uses[i].img(),true);
 						imgs[2*i].top=ibegin[i].top;
 						imgs[2*i].bottom=ibegin[i].bottom;
 					}
@@ -581,7 +709,7 @@ namespace ScoreProcessor {
 				{
 					std::string names{fbegin[0]};
 					names.append(" to ").append(fbegin[num_pages-1]);
-					parent.stop();
+					group.cancel();
 					std::lock_guard guard(error_lock);
 					error_log.append(names);
 				}
@@ -593,7 +721,7 @@ namespace ScoreProcessor {
 			--i;
 			start=end;
 		}
-		pool.join();
+		group.wait();
 		if(!error_log.empty())
 		{
 			throw std::runtime_error(error_log);
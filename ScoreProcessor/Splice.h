@@ -2,67 +2,96 @@
 #define SPLICE_H
 #include "CImg.h"
 #include <mutex>
+#include <condition_variable>
+#include <exception>
 #include <vector>
 #include <string>
 #include "ImageUtils.h"
-#include "lib/threadpool/thread_pool.h"
+#include "WorkerPool.h"
 #include "lib/exstring/exmath.h"
 #include <array>
+#include <deque>
+#include <memory>
+#include <functional>
 #include "ImageProcess.h"
 namespace ScoreProcessor {
 
 	//Anything in namespace Splice, except standard_heurstics, you should not access directly
 	namespace Splice {
 
-		//class used to manage when files are open and closed by splice
-		class manager {
-		private:
-			cil::CImg<unsigned char> _img;
-			char const* filename;
-			unsigned int times_used=0;
-			std::mutex guard;
+		//makes page i in place of decoding the ith file, for pages that are not files of their own, like the pieces of cut pages
+		using page_source=std::function<cil::CImg<unsigned char>(size_t page)>;
+
+		//shares decoded pages between the splice tasks that use them, so no file is decoded twice
+		//pages are decoded ahead on the global pool in page order, as far as the byte budget allows past the earliest page still in use;
+		//beyond that, pages are only decoded by the tasks that need them
+		class page_cache {
 		public:
+			//each page is freed after uses_per_page calls to release
+			//if source is set, pages are made by it and the filenames only name them
+			page_cache(std::vector<std::string> const& filenames,size_t byte_budget,unsigned int uses_per_page=2,page_source source=nullptr);
+			page_cache(page_cache const&)=delete;
+			page_cache& operator=(page_cache const&)=delete;
 			[[nodiscard]]
-			inline cil::CImg<unsigned char> const& img() const
+			size_t size() const
 			{
-				return _img;
+				return _pages.size();
 			}
 			[[nodiscard]]
-			inline char const* fname() const
+			char const* fname(size_t page) const
 			{
-				return filename;
+				return _pages[page].filename;
 			}
-			inline void fname(char const* fn)
+			//returns the decoded page, decoding it on this thread if no one has started to yet
+			//rethrows the decode error if the page failed to load
+			cil::CImg<unsigned char> const& acquire(size_t page);
+			//ends one use of the page, which is freed after its last
+			void release(size_t page);
+		private:
+			enum class state {
+				unloaded,
+				loading,
+				ready,
+				failed
+			};
+			struct entry {
+				cil::CImg<unsigned char> img;
+				char const* filename;
+				unsigned int uses_left;
+				state status;
+				std::exception_ptr error;
+			};
+			bool in_window(size_t page) const;
+			void load(size_t page);
+			void prefetch();
+
+			std::vector<entry> _pages;
+			page_source _source;
+			size_t const _budget;
+			size_t _largest; //largest decoded page, for how many pages the budget fits
+			size_t _low; //first page with uses left
+			size_t _next_prefetch;
+			mutable std::mutex _mtx;
+			std::condition_variable _loaded;
+			task_group _prefetches; //last so it is waited on before the pages go
+		};
+
+		//one use of a page, released when it goes out of scope
+		class page_use {
+			page_cache& _cache;
+			size_t _page;
+		public:
+			page_use(page_cache& cache,size_t page) noexcept:_cache(cache),_page(page)
+			{}
+			page_use(page_use const&)=delete;
+			page_use& operator=(page_use const&)=delete;
+			~page_use()
 			{
-				filename=fn;
+				_cache.release(_page);
 			}
-			inline void load()
+			cil::CImg<unsigned char> const& img() const
 			{
-				std::lock_guard<std::mutex> locker(guard);
-				if(_img._data==0)
-				{
-					_img.load(filename);
-					if(_img._spectrum==2)
-					{
-						cil::CImg<unsigned char> temp(_img._width,_img._height,1,4);
-						size_t const size=size_t{temp._width}*temp._height;
-						std::memcpy(temp.data(),_img.data(),size);
-						std::memcpy(temp.data()+size,_img.data(),size);
-						std::memcpy(temp.data()+2*size,_img.data(),size);
-						std::memset(temp.data()+3*size,255,size);
-						_img=std::move(temp);
-					}
-				}
-			}
-			inline void finish()
-			{
-				std::lock_guard<std::mutex> locker(guard);
-				++times_used;
-				if(times_used==2)
-				{
-					delete[] _img._data;
-					_img._data=0;
-				}
+				return _cache.acquire(_page);
 			}
 		};
 
@@ -128,26 +157,21 @@ namespace ScoreProcessor {
 	//splices together the pages pointed to by imgs, padded apart by padding
 	cil::CImg<unsigned char> splice_images(Splice::page const* imgs,size_t num,unsigned int padding);
 
-	//returns breaks in backwards order
-	//determines where page breaks should go using Knuth word-wrap algorithm, based on given cost function, and
-	//way of layout out pages
-	template<typename PageDescIter,typename CreateLayout,typename Cost>
-	std::vector<Splice::page_break> nongreedy_break(PageDescIter begin,PageDescIter end,CreateLayout cl,Cost cost)
-	{
-		struct node {
+	namespace Splice {
+		struct break_node {
 #ifdef _WIN64
 			double
 #else 
 			float
 #endif
 				cost;
-			Splice::page_layout layout;
+			page_layout layout;
 			size_t previous;
 		};
-		size_t const c=end-begin;
-		std::vector<node> nodes(c+1);
-		nodes[0].cost=0;
-		for(size_t i=1;i<=c;++i)
+
+		//finds the best break before page i from the breaks at [first,i), which must already be found
+		template<typename PageDescIter,typename CreateLayout,typename Cost,typename Overfull>
+		void find_break(break_node* nodes,PageDescIter begin,size_t i,size_t first,CreateLayout& cl,Cost& cost,Overfull& overfull)
 		{
 			nodes[i].cost=INFINITY;
 			for(size_t j=i-1;;)
@@ -161,13 +185,209 @@ namespace ScoreProcessor {
 					nodes[i].previous=j;
 					nodes[i].layout=layout;
 				}
-				if(j==0)
+				//earlier starts only make this cost more, and costs are never negative
+				else if(local_cost>nodes[i].cost&&overfull(layout))
+				{
+					break;
+				}
+				if(j==first)
 				{
 					break;
 				}
 				--j;
 			}
 		}
+
+		//evaluates boundary k of the pages in files, the top of the first page for 0, the bottom of the last page for files.size(),
+		//and otherwise the bottom of page k-1 and the top of page k, using one use of each page
+		template<typename EvalPage,typename SendError>
+		void evaluate_boundary(page_cache& files,size_t k,page_desc* output,EvalPage const& ep,SendError const& send_error)
+		{
+			auto const c=files.size();
+			if(k==0)
+			{
+				page_use use(files,0);
+				try
+				{
+					output[0].top=ep.eval_top(use.img());
+				}
+				catch(std::exception const& ex)
+				{
+					send_error(ex,files.fname(0));
+				}
+				return;
+			}
+			if(k==c)
+			{
+				page_use use(files,c-1);
+				try
+				{
+					output[c-1].bottom=ep.eval_bottom(use.img());
+				}
+				catch(std::exception const& ex)
+				{
+					send_error(ex,files.fname(c-1));
+				}
+				return;
+			}
+			page_use top_use(files,k-1);
+			page_use bottom_use(files,k);
+			cil::CImg<unsigned char> const* top;
+			cil::CImg<unsigned char> const* bottom;
+			try
+			{
+				top=&top_use.img();
+			}
+			catch(std::exception const& err)
+			{
+				send_error(err,files.fname(k-1));
+				return;
+			}
+			try
+			{
+				bottom=&bottom_use.img();
+			}
+			catch(std::exception const& err)
+			{
+				send_error(err,files.fname(k));
+				return;
+			}
+			try
+			{
+				page_desc res=ep.eval_middle(*top,*bottom);
+				output[k-1].bottom=res.bottom;
+				output[k].top=res.top;
+			}
+			catch(std::exception const& err)
+			{
+				std::string names=files.fname(k-1);
+				names+=" and ";
+				names+=files.fname(k);
+				send_error(err,names.c_str());
+			}
+		}
+
+		//finds the breaks of pages whose descriptors come in one at a time, as splice_pages_streaming does,
+		//handing each output page to save(first,end,padding) in order once no later page can change it
+		template<typename CreateLayout,typename Cost,typename Overfull>
+		class break_stream {
+			std::vector<break_node> _nodes;
+			std::vector<size_t> _chain;
+			size_t const _lookahead;
+			size_t _committed;
+			CreateLayout _cl;
+			Cost _cost;
+			Overfull _overfull;
+			template<typename Save>
+			void commit(size_t end,Save& save)
+			{
+				_chain.clear();
+				for(size_t index=end;index!=_committed;index=_nodes[index].previous)
+				{
+					_chain.push_back(index);
+				}
+				for(auto it=_chain.rbegin();it!=_chain.rend();++it)
+				{
+					save(_committed,*it,_nodes[*it].layout.padding);
+					_committed=*it;
+				}
+			}
+		public:
+			break_stream(size_t num_pages,size_t lookahead,CreateLayout cl,Cost cost,Overfull overfull):
+				_nodes(num_pages+1),_lookahead(lookahead),_committed(0),_cl(cl),_cost(cost),_overfull(overfull)
+			{
+				assert(lookahead!=0);
+				_nodes[0].cost=0;
+			}
+			//first page whose output page has not been saved yet
+			size_t committed() const
+			{
+				return _committed;
+			}
+			//finds the break before page i, once descs has the descriptors of pages [0,i)
+			//and the breaks before all earlier pages have been found
+			template<typename PageDescIter,typename Save>
+			void push(PageDescIter descs,size_t i,Save save)
+			{
+				size_t const c=_nodes.size()-1;
+				size_t const first=std::max(_committed,i>_lookahead?i-_lookahead:size_t(0));
+				find_break(_nodes.data(),descs,i,first,_cl,_cost,_overfull);
+				size_t const live=std::max(_committed,i+1>_lookahead?i+1-_lookahead:size_t(0));
+				if(i==c)
+				{
+					commit(c,save);
+				}
+				else if(i-_committed<2*_lookahead)
+				{
+					//later breaks can only come after the last lookahead breaks, so whatever those share is final
+					size_t common=i;
+					for(size_t j=live;j<i;++j)
+					{
+						if(_nodes[j].cost==INFINITY)
+						{
+							continue;
+						}
+						size_t other=j;
+						while(other!=common)
+						{
+							if(other>common)
+							{
+								other=_nodes[other].previous;
+							}
+							else
+							{
+								common=_nodes[common].previous;
+							}
+						}
+					}
+					if(common>_committed)
+					{
+						commit(common,save);
+					}
+				}
+				else
+				{
+					//the breakings have not agreed for too long, so the best one ending here is taken as far as lookahead pages back
+					//and breaks that do not go through it are dropped
+					size_t taken=i;
+					while(taken>i-_lookahead)
+					{
+						taken=_nodes[taken].previous;
+					}
+					commit(taken,save);
+					for(size_t j=taken+1;j<=i;++j)
+					{
+						size_t ancestor=j;
+						while(ancestor>taken)
+						{
+							ancestor=_nodes[ancestor].previous;
+						}
+						if(ancestor!=taken)
+						{
+							_nodes[j].cost=INFINITY;
+						}
+					}
+				}
+			}
+		};
+	}
+
+	//returns breaks in backwards order
+	//determines where page breaks should go using Knuth word-wrap algorithm, based on given cost function, and
+	//way of layout out pages
+	//overfull(layout) tells when a layout is tall enough that adding more pages to it can only raise its cost,
+	//then the search for a break stops at the first such layout that costs more on its own than the best found so far,
+	//so each break only looks back over as many pages as can fit on one output page
+	template<typename PageDescIter,typename CreateLayout,typename Cost,typename Overfull>
+	std::vector<Splice::page_break> nongreedy_break(PageDescIter begin,PageDescIter end,CreateLayout cl,Cost cost,Overfull overfull)
+	{
+		size_t const c=end-begin;
+		std::vector<Splice::break_node> nodes(c+1);
+		nodes[0].cost=0;
+		for(size_t i=1;i<=c;++i)
+		{
+			Splice::find_break(nodes.data(),begin,i,0,cl,cost,overfull);
+		}
 		std::vector<Splice::page_break> breaks;
 		breaks.reserve(c);
 		size_t index=c;
@@ -179,17 +399,28 @@ namespace ScoreProcessor {
 		return breaks;
 	}
 
+	//nongreedy_break trying every start for every break
+	template<typename PageDescIter,typename CreateLayout,typename Cost>
+	std::vector<Splice::page_break> nongreedy_break(PageDescIter begin,PageDescIter end,CreateLayout cl,Cost cost)
+	{
+		return nongreedy_break(begin,end,cl,cost,[](Splice::page_layout const&)
+		{
+			return false;
+		});
+	}
+
 	//splices together the non-greedily and multi-threadedly, based on the given page descriptors and evaluators
+	//files must give each page three uses, two for evaluation and one for output
 	//returns the number of pages spliced together
-	template<typename EvalPage,typename CreateLayout,typename Cost,typename Splicer,typename Saver>
+	template<typename EvalPage,typename CreateLayout,typename Cost,typename Overfull,typename Splicer,typename Saver>
 	unsigned int splice_pages_parallel(
-		std::vector<Splice::manager>& files,
+		Splice::page_cache& files,
 		SaveRules const& output_rule,
 		unsigned int starting_index,
-		unsigned int num_threads,
 		EvalPage ep,
 		CreateLayout cl,
 		Cost cost,
+		Overfull overfull,
 		Splicer splicer,
 		Saver saver)
 	{
@@ -203,89 +434,29 @@ namespace ScoreProcessor {
 		std::string error_log;
 		std::mutex error_mutex;
 		std::vector<Splice::page_desc> page_descs(c);
-		exlib::thread_pool pool(num_threads);
-		using parent_ref=typename decltype(pool)::parent_ref;
-		auto send_error=[&error_mutex,&error_log](auto const& err,auto parent,auto filename)
+		task_group group;
+		auto send_error=[&error_mutex,&error_log,&group](auto const& err,auto filename)
 		{
 			{
 				std::lock_guard lock{error_mutex};
 				error_log.append(filename).append(": ").append(err.what()).append("\n");
 			}
-			parent.stop();
+			group.cancel();
 		};
-		pool.push_back([work=files.data(),output=page_descs.data(),ep,send_error](parent_ref parent) noexcept{
-			try
-			{
-				work->load();
-				Splice::edge res=ep.eval_top(work->img());
-				output->top=res;
-				work->finish();
-			}
-			catch(std::exception const& ex)
-			{
-				send_error(ex,parent,work->fname());
-			}
-		});
-		for(size_t i=1;i<c;++i)
+		for(size_t k=0;k<=c;++k)
 		{
-			pool.push_back([work=files.data()+i,output=page_descs.data()+i,ep,send_error](parent_ref parent) noexcept
+			group.run([&files,k,output=page_descs.data(),ep,send_error]() noexcept
 			{
-				
-				try
-				{
-					(work-1)->load();
-				}
-				catch(std::exception const& err)
-				{
-					send_error(err,parent,(work-1)->fname());
-					return;
-				}
-				try
-				{
-					work->load();
-				}
-				catch(std::exception const& err)
-				{
-					send_error(err,parent,work->fname());
-					return;
-				}
-				try
-				{
-					Splice::page_desc res=ep.eval_middle((work-1)->img(),work->img());
-					(output-1)->bottom=res.bottom;
-					(output)->top=res.top;
-					(work-1)->finish();
-					work->finish();
-				}
-				catch(std::exception const& err)
-				{
-					std::string names=(work-1)->fname();
-					names+=" and ";
-					names+=work->fname();
-					send_error(err,parent,names.c_str());
-				}
+				Splice::evaluate_boundary(files,k,output,ep,send_error);
 			});
 		}
-		pool.push_back([work=files.data()+c-1,output=page_descs.data()+c-1,ep,send_error](parent_ref parent)noexcept{
-			try
-			{
-				work->load();
-				Splice::edge res=ep.eval_bottom(work->img());
-				output->bottom=res;
-				work->finish();
-			}
-			catch(std::exception const& ex)
-			{
-				send_error(ex,parent,work->fname());
-			}
-		});
-		pool.wait();
+		group.wait();
 		if(!error_log.empty())
 		{
 			throw std::logic_error(error_log);
 		}
 
-		std::vector<Splice::page_break> breaks=nongreedy_break(page_descs.begin(),page_descs.end(),cl,cost);
+		std::vector<Splice::page_break> breaks=nongreedy_break(page_descs.begin(),page_descs.end(),cl,cost,overfull);
 		unsigned int num_digs=exlib::num_digits(breaks.size()+starting_index);
 		num_digs=num_digs<3?3:num_digs;
 		unsigned int num_imgs=0;
@@ -295,36 +466,42 @@ namespace ScoreProcessor {
 			++num_imgs;
 			auto const end=breaks[i].index;
 			auto const s=end-start;
-			pool.push_back(
+			group.run(
 				[&output_rule,
+				&files,
 				filename_index=start+starting_index,
-				fbegin=files.data()+start,
+				first=start,
 				ibegin=page_descs.data()+start,
 				num_pages=s,
 				padding=breaks[i].padding,
 				send_error,
 				splicer,
-				saver](parent_ref parent) noexcept {
+				saver]() noexcept {
+				std::deque<Splice::page_use> uses;
+				for(size_t i=0;i<num_pages;++i)
+				{
+					uses.emplace_back(files,first+i);
+				}
 				try
 				{
 					std::vector<Splice::page> imgs(num_pages);
 					for(size_t i=0;i<num_pages;++i)
 					{
-						imgs[i].img.load(fbegin[i].fname());
+						imgs[i].img.assign(uses[i].img(),true);
 						imgs[i].top=ibegin[i].top.kerned;
 						imgs[i].bottom=ibegin[i].bottom.kerned;
 					}
 					imgs[0].top=ibegin[0].top.raw;
 					auto const last=num_pages-1;
 					imgs[last].bottom=ibegin[last].bottom.raw;
-					auto const filename=output_rule.make_filename(fbegin[0].fname(),filename_index);
+					auto const filename=output_rule.make_filename(files.fname(first),filename_index);
 					saver(splicer(imgs.data(),num_pages,padding),filename.c_str());
 				}
 				catch(std::exception const& ex)
 				{
-					std::string names{fbegin[0].fname()};
-					names.append(" to ").append(fbegin[num_pages-1].fname());
-					send_error(ex,parent,names.data());
+					std::string names{files.fname(first)};
+					names.append(" to ").append(files.fname(first+num_pages-1));
+					send_error(ex,names.data());
 				}
 			});
 			if(i==0)
@@ -334,7 +511,129 @@ namespace ScoreProcessor {
 			--i;
 			start=end;
 		}
-		pool.join();
+		group.wait();
+		if(!error_log.empty())
+		{
+			throw std::logic_error(error_log);
+		}
+		return num_imgs;
+	}
+
+	//splices together the pages like splice_pages_parallel, but as they are evaluated instead of after all of them are:
+	//a page break is committed once the best breakings of every page in the lookahead after it all go through it,
+	//or, if they have not agreed within 2*lookahead pages, along the best breaking of the newest page,
+	//then that output page is saved and its pages freed right away, so only about 2*lookahead pages are held at once
+	//no output page holds more than lookahead pages, and unless breaks are forced the breaks are the same as splice_pages_parallel's
+	//files must give each page three uses, two for evaluation and one for output
+	//returns the number of pages spliced together
+	template<typename EvalPage,typename CreateLayout,typename Cost,typename Overfull,typename Splicer,typename Saver>
+	unsigned int splice_pages_streaming(
+		Splice::page_cache& files,
+		SaveRules const& output_rule,
+		unsigned int starting_index,
+		size_t lookahead,
+		EvalPage ep,
+		CreateLayout cl,
+		Cost cost,
+		Overfull overfull,
+		Splicer splicer,
+		Saver saver)
+	{
+		auto const c=files.size();
+		if(c<2)
+		{
+			throw std::invalid_argument("Need multiple pages to splice");
+		}
+		assert(lookahead!=0);
+		std::string error_log;
+		std::mutex error_mutex;
+		std::vector<Splice::page_desc> page_descs(c);
+		std::unique_ptr<std::atomic<bool>[]> evaluated(new std::atomic<bool>[c+1]);
+		for(size_t k=0;k<=c;++k)
+		{
+			evaluated[k]=false;
+		}
+		Splice::break_stream<CreateLayout,Cost,Overfull> breaks(c,lookahead,cl,cost,overfull);
+		task_group group;
+		auto send_error=[&error_mutex,&error_log,&group](auto const& err,auto filename)
+		{
+			{
+				std::lock_guard lock{error_mutex};
+				error_log.append(filename).append(": ").append(err.what()).append("\n");
+			}
+			group.cancel();
+		};
+		//boundaries are evaluated only a little ahead of the break being found, so that pages are not decoded far ahead of being saved
+		size_t const ahead=global_pool().num_threads()+1;
+		size_t next_boundary=0;
+		auto evaluate_until=[&](size_t k)
+		{
+			for(;next_boundary<=std::min(k,c);++next_boundary)
+			{
+				group.run([&files,&evaluated,k=next_boundary,output=page_descs.data(),ep,send_error]() noexcept
+				{
+					Splice::evaluate_boundary(files,k,output,ep,send_error);
+					evaluated[k]=true;
+				});
+			}
+		};
+		unsigned int num_imgs=0;
+		auto save=[&](size_t first,size_t end,unsigned int padding)
+		{
+			++num_imgs;
+			group.run(
+				[&output_rule,
+				&files,
+				filename_index=first+starting_index,
+				first,
+				ibegin=page_descs.data()+first,
+				num_pages=end-first,
+				padding,
+				send_error,
+				splicer,
+				saver]() noexcept {
+				std::deque<Splice::page_use> uses;
+				for(size_t i=0;i<num_pages;++i)
+				{
+					uses.emplace_back(files,first+i);
+				}
+				try
+				{
+					std::vector<Splice::page> imgs(num_pages);
+					for(size_t i=0;i<num_pages;++i)
+					{
+						imgs[i].img.assign(uses[i].img(),true);
+						imgs[i].top=ibegin[i].top.kerned;
+						imgs[i].bottom=ibegin[i].bottom.kerned;
+					}
+					imgs[0].top=ibegin[0].top.raw;
+					auto const last=num_pages-1;
+					imgs[last].bottom=ibegin[last].bottom.raw;
+					auto const filename=output_rule.make_filename(files.fname(first),filename_index);
+					saver(splicer(imgs.data(),num_pages,padding),filename.c_str());
+				}
+				catch(std::exception const& ex)
+				{
+					std::string names{files.fname(first)};
+					names.append(" to ").append(files.fname(first+num_pages-1));
+					send_error(ex,names.data());
+				}
+			});
+		};
+		for(size_t i=1;i<=c&&!group.cancelled();++i)
+		{
+			evaluate_until(i+ahead);
+			group.help_until([&]()
+			{
+				return evaluated[i]||group.cancelled();
+			});
+			if(group.cancelled())
+			{
+				break;
+			}
+			breaks.push(page_descs.data(),i,save);
+		}
+		group.wait();
 		if(!error_log.empty())
 		{
 			throw std::logic_error(error_log);
@@ -347,18 +646,13 @@ namespace ScoreProcessor {
 		std::vector<std::string> const& filenames,
 		char const* output,
 		unsigned int starting_index,
-		unsigned int num_threads,
 		EvalPage ep,
 		CreateLayout cl,
 		Cost c,
 		int quality)
 	{
-		std::vector<Splice::manager> managers(filenames.size());
-		for(size_t i=0;i<filenames.size();++i)
-		{
-			managers[i].fname(filenames[i].c_str());
-		}
-		return splice_pages_parallel(managers,output,starting_index,num_threads,ep,cl,c,quality);
+		Splice::page_cache pages(filenames,size_t(512)<<20,3);
+		return splice_pages_parallel(pages,output,starting_index,ep,cl,c,quality);
 	}
 
 	template<typename EvalPage,typename CreateLayout,typename Cost>
@@ -393,9 +687,11 @@ namespace ScoreProcessor {
 		};
 		struct options {
 			unsigned int starting_index;
-			unsigned int num_threads;
 			int quality;
 			bool make_folders;
+			size_t cache_bytes; //budget for decoded pages held at once
+			unsigned int lookahead; //if not 0, splice_pages_streaming with this lookahead
+			page_source source; //if set, makes the pages, and the filenames only name them for the output
 		};
 	}
 
@@ -0,0 +1,562 @@
+/*
+Copyright(C) 2017-2019 Edward Xie
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#include "stdafx.h"
+#include "TemplateMatch.h"
+#include "PixelKernels.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <memory>
+#include <vector>
+namespace ScoreProcessor {
+	namespace {
+		typedef unsigned char uchar;
+		typedef std::complex<double> complex;
+		typedef unsigned long long sum_t;
+
+		//templates up to this area are correlated directly
+		//past it the direct path costs more per offset than a share of the tile ffts
+		constexpr size_t direct_max_area=512;
+		//so are larger templates over this few offsets, where a tile transform would be mostly padding
+		constexpr size_t direct_max_offsets=128;
+		//output rows each direct task scores
+		constexpr unsigned int direct_strip_rows=32;
+		constexpr unsigned int max_fft_size=1024;
+		//least output rows each band of template_ssd_minima scores for every template
+		constexpr unsigned int minima_band_rows=64;
+
+		inline unsigned int square(uchar v)
+		{
+			return unsigned int(v)*v;
+		}
+
+		inline float ssd_score(sum_t ssd)
+		{
+			return static_cast<float>(ssd/(255.0*255.0));
+		}
+
+		sum_t template_energy(cil::CImg<uchar> const& tmplt)
+		{
+			sum_t energy=0;
+			uchar const* const data=tmplt._data;
+			size_t const area=size_t{tmplt._width}*tmplt._height;
+			for(size_t i=0;i<area;++i)
+			{
+				energy+=square(data[i]);
+			}
+			return energy;
+		}
+
+		//out[y*cols+x] becomes the sum of the squares of img under the tw x th window at (left+x,top+y), for x<cols and y<rows
+		void window_energy(cil::CImg<uchar> const& img,unsigned int tw,unsigned int th,unsigned int left,unsigned int top,unsigned int cols,unsigned int rows,sum_t* out)
+		{
+			unsigned int const span=cols+tw-1;
+			std::vector<unsigned int> column(span,0);
+			for(unsigned int ty=0;ty<th;++ty)
+			{
+				uchar const* const row=img.data(left,top+ty);
+				for(unsigned int x=0;x<span;++x)
+				{
+					column[x]+=square(row[x]);
+				}
+			}
+			for(unsigned int y=0;;)
+			{
+				sum_t sum=0;
+				for(unsigned int x=0;x<tw;++x)
+				{
+					sum+=column[x];
+				}
+				sum_t* const out_row=out+size_t{y}*cols;
+				out_row[0]=sum;
+				for(unsigned int x=1;x<cols;++x)
+				{
+					sum+=column[x+tw-1];
+					sum-=column[x-1];
+					out_row[x]=sum;
+				}
+				if(++y==rows)
+				{
+					break;
+				}
+				uchar const* const leaving=img.data(left,top+y-1);
+				uchar const* const entering=img.data(left,top+y+th-1);
+				for(unsigned int x=0;x<span;++x)
+				{
+					column[x]+=square(entering[x]);
+					column[x]-=square(leaving[x]);
+				}
+			}
+		}
+
+		//scores rows rows of offsets starting at (left,top) into out, one row every stride floats
+		//energy holds the window energies of those offsets, cols to a row
+		void direct_rows(float* out,size_t stride,cil::CImg<uchar> const& img,cil::CImg<uchar> const& tmplt,sum_t tmplt_energy,sum_t const* energy,unsigned int left,unsigned int top,unsigned int cols,unsigned int rows)
+		{
+			unsigned int const tw=tmplt._width;
+			unsigned int const th=tmplt._height;
+			std::vector<unsigned int> correlation(cols);
+			for(unsigned int y=0;y<rows;++y)
+			{
+				std::fill(correlation.begin(),correlation.end(),0);
+				for(unsigned int ty=0;ty<th;++ty)
+				{
+					kernels::add_correlation_row(correlation.data(),img.data(left,top+y+ty),tmplt.data(0,ty),cols,tw);
+				}
+				float* const out_row=out+y*stride;
+				sum_t const* const window=energy+size_t{y}*cols;
+				for(unsigned int x=0;x<cols;++x)
+				{
+					out_row[x]=ssd_score(tmplt_energy+window[x]-2*sum_t{correlation[x]});
+				}
+			}
+		}
+
+		//pixel (x,y) of scores is the offset (left+x,top+y)
+		void direct_ssd(cil::CImg<float>& scores,cil::CImg<uchar> const& img,cil::CImg<uchar> const& tmplt,sum_t tmplt_energy,unsigned int left,unsigned int top)
+		{
+			unsigned int const cols=scores._width;
+			size_t const strips=(scores._height+direct_strip_rows-1)/direct_strip_rows;
+			parallel_for(strips,[&](size_t strip)
+			{
+				unsigned int const strip_top=unsigned int(strip*direct_strip_rows);
+				unsigned int const rows=std::min(direct_strip_rows,scores._height-strip_top);
+				std::vector<sum_t> energy(size_t{cols}*rows);
+				window_energy(img,tmplt._width,tmplt._height,left,top+strip_top,cols,rows,energy.data());
+				direct_rows(scores.data(0,strip_top),cols,img,tmplt,tmplt_energy,energy.data(),left,top+strip_top,cols,rows);
+			});
+		}
+
+		inline complex mul(complex a,complex b)
+		{
+			return {a.real()*b.real()-a.imag()*b.imag(),a.real()*b.imag()+a.imag()*b.real()};
+		}
+
+		//radix-2 transform of one power of two length
+		struct fft_plan {
+			unsigned int n;
+			std::vector<complex> twiddles; //e^(-2 pi i k/n) for k<n/2
+			std::vector<unsigned int> reversed; //bit reversal permutation
+			fft_plan(unsigned int n):n(n),twiddles(n/2),reversed(n)
+			{
+				double const step=-2*3.14159265358979323846/n;
+				for(unsigned int k=0;k<n/2;++k)
+				{
+					twiddles[k]=std::polar(1.0,step*k);
+				}
+				unsigned int bits=0;
+				while((1U<<bits)<n)
+				{
+					++bits;
+				}
+				for(unsigned int i=0;i<n;++i)
+				{
+					unsigned int r=0;
+					for(unsigned int b=0;b<bits;++b)
+					{
+						r|=((i>>b)&1)<<(bits-1-b);
+					}
+					reversed[i]=r;
+				}
+			}
+			complex twiddle(unsigned int k,bool inverse) const
+			{
+				return inverse?std::conj(twiddles[k]):twiddles[k];
+			}
+		};
+
+		void fft_row(complex* data,fft_plan const& plan,bool inverse)
+		{
+			unsigned int const n=plan.n;
+			for(unsigned int i=0;i<n;++i)
+			{
+				unsigned int const j=plan.reversed[i];
+				if(i<j)
+				{
+					std::swap(data[i],data[j]);
+				}
+			}
+			for(unsigned int len=2;len<=n;len<<=1)
+			{
+				unsigned int const half=len/2;
+				unsigned int const step=n/len;
+				for(unsigned int i=0;i<n;i+=len)
+				{
+					for(unsigned int k=0;k<half;++k)
+					{
+						complex const u=data[i+k];
+						complex const v=mul(data[i+k+half],plan.twiddle(k*step,inverse));
+						data[i+k]=u+v;
+						data[i+k+half]=u-v;
+					}
+				}
+			}
+		}
+
+		//transforms the rows, then the columns, whole rows at a time so the column butterflies run along memory
+		void fft_2d(complex* data,fft_plan const& x_plan,fft_plan const& y_plan,bool inverse)
+		{
+			unsigned int const nx=x_plan.n;
+			unsigned int const ny=y_plan.n;
+			for(unsigned int y=0;y<ny;++y)
+			{
+				fft_row(data+size_t{y}*nx,x_plan,inverse);
+			}
+			for(unsigned int y=0;y<ny;++y)
+			{
+				unsigned int const j=y_plan.reversed[y];
+				if(y<j)
+				{
+					std::swap_ranges(data+size_t{y}*nx,data+size_t{y+1}*nx,data+size_t{j}*nx);
+				}
+			}
+			for(unsigned int len=2;len<=ny;len<<=1)
+			{
+				unsigned int const half=len/2;
+				unsigned int const step=ny/len;
+				for(unsigned int i=0;i<ny;i+=len)
+				{
+					for(unsigned int k=0;k<half;++k)
+					{
+						complex const w=y_plan.twiddle(k*step,inverse);
+						complex* const u=data+size_t{i+k}*nx;
+						complex* const v=data+size_t{i+k+half}*nx;
+						for(unsigned int x=0;x<nx;++x)
+						{
+							complex const t=mul(v[x],w);
+							v[x]=u[x]-t;
+							u[x]=u[x]+t;
+						}
+					}
+				}
+			}
+		}
+
+		//power of two transform length for a template dimension, weighing the cost of the transform against the offsets each tile scores
+		unsigned int fft_size(unsigned int tmplt_dim,unsigned int offsets)
+		{
+			unsigned int n=1;
+			unsigned int log=0;
+			while(n<tmplt_dim)
+			{
+				n<<=1;
+				++log;
+			}
+			unsigned int best=n;
+			double best_cost=HUGE_VAL;
+			for(;n<=std::max(max_fft_size,best);n<<=1,++log)
+			{
+				double const cost=double(log+1)*n/std::min(n-tmplt_dim+1,offsets);
+				if(cost<best_cost)
+				{
+					best_cost=cost;
+					best=n;
+				}
+				if(n-tmplt_dim+1>=offsets)
+				{
+					break;
+				}
+			}
+			return best;
+		}
+
+		//overlap-save: each tile transforms an nx x ny block of the image and keeps the offsets whose windows lie inside it
+		//the circular correlation of a block with the zero padded template is exact there
+		//two tiles go through each transform, one as the real part and one as the imaginary part, since the template is real
+		void fft_ssd(cil::CImg<float>& scores,cil::CImg<uchar> const& img,cil::CImg<uchar> const& tmplt,sum_t tmplt_energy,unsigned int left,unsigned int top)
+		{
+			unsigned int const tw=tmplt._width;
+			unsigned int const th=tmplt._height;
+			fft_plan const x_plan(fft_size(tw,scores._width));
+			fft_plan const y_plan(fft_size(th,scores._height));
+			unsigned int const nx=x_plan.n;
+			unsigned int const ny=y_plan.n;
+			unsigned int const tile_w=nx-tw+1;
+			unsigned int const tile_h=ny-th+1;
+			unsigned int const tiles_x=(scores._width+tile_w-1)/tile_w;
+			unsigned int const tiles_y=(scores._height+tile_h-1)/tile_h;
+			size_t const tiles=size_t{tiles_x}*tiles_y;
+			size_t const area=size_t{nx}*ny;
+			std::unique_ptr<complex[]> spectrum(new complex[area]());
+			for(unsigned int y=0;y<th;++y)
+			{
+				uchar const* const row=tmplt.data(0,y);
+				for(unsigned int x=0;x<tw;++x)
+				{
+					spectrum[size_t{y}*nx+x]=row[x];
+				}
+			}
+			fft_2d(spectrum.get(),x_plan,y_plan,false);
+			for(size_t i=0;i<area;++i)
+			{
+				spectrum[i]=std::conj(spectrum[i]);
+			}
+			double const normalize=1.0/area;
+			parallel_for((tiles+1)/2,[&](size_t pair)
+			{
+				std::unique_ptr<complex[]> block(new complex[area]);
+				struct tile {
+					unsigned int left,top,cols,rows;
+				};
+				tile parts[2];
+				size_t const first=2*pair;
+				size_t const count=std::min<size_t>(2,tiles-first);
+				for(size_t p=0;p<count;++p)
+				{
+					auto& t=parts[p];
+					t.left=unsigned int((first+p)%tiles_x)*tile_w;
+					t.top=unsigned int((first+p)/tiles_x)*tile_h;
+					t.cols=std::min(tile_w,scores._width-t.left);
+					t.rows=std::min(tile_h,scores._height-t.top);
+				}
+				for(unsigned int y=0;y<ny;++y)
+				{
+					complex* const row=block.get()+size_t{y}*nx;
+					std::fill(row,row+nx,complex());
+					for(size_t p=0;p<count;++p)
+					{
+						auto const& t=parts[p];
+						if(top+t.top+y>=img._height)
+						{
+							continue;
+						}
+						uchar const* const in=img.data(left+t.left,top+t.top+y);
+						unsigned int const width=std::min(nx,img._width-left-t.left);
+						for(unsigned int x=0;x<width;++x)
+						{
+							if(p==0)
+							{
+								row[x].real(in[x]);
+							}
+							else
+							{
+								row[x].imag(in[x]);
+							}
+						}
+					}
+				}
+				fft_2d(block.get(),x_plan,y_plan,false);
+				for(size_t i=0;i<area;++i)
+				{
+					block[i]=mul(block[i],spectrum[i]);
+				}
+				fft_2d(block.get(),x_plan,y_plan,true);
+				std::vector<sum_t> energy;
+				for(size_t p=0;p<count;++p)
+				{
+					auto const& t=parts[p];
+					energy.resize(size_t{t.cols}*t.rows);
+					window_energy(img,tw,th,left+t.left,top+t.top,t.cols,t.rows,energy.data());
+					for(unsigned int y=0;y<t.rows;++y)
+					{
+						complex const* const row=block.get()+size_t{y}*nx;
+						sum_t const* const window=energy.data()+size_t{y}*t.cols;
+						float* const out=scores.data(t.left,t.top+y);
+						for(unsigned int x=0;x<t.cols;++x)
+						{
+							double const value=(p==0?row[x].real():row[x].imag())*normalize;
+							auto const correlation=sum_t(std::llround(value));
+							out[x]=ssd_score(tmplt_energy+window[x]-2*correlation);
+						}
+					}
+				}
+			});
+		}
+	}
+
+	cil::CImg<float> sliding_template_ssd(cil::CImg<unsigned char> const& img,cil::CImg<unsigned char> const& tmplt,correlation_method method)
+	{
+		return sliding_template_ssd(img,tmplt,{0,img._width,0,img._height},method);
+	}
+
+	cil::CImg<float> sliding_template_ssd(cil::CImg<unsigned char> const& img,cil::CImg<unsigned char> const& tmplt,ImageUtils::RectangleUINT region,correlation_method method)
+	{
+		if(img._width<tmplt._width||img._height<tmplt._height||tmplt.is_empty())
+		{
+			return {};
+		}
+		region.right=std::min(region.right,img._width-tmplt._width+1);
+		region.bottom=std::min(region.bottom,img._height-tmplt._height+1);
+		if(region.left>=region.right||region.top>=region.bottom)
+		{
+			return {};
+		}
+		cil::CImg<float> scores(region.right-region.left,region.bottom-region.top);
+		auto const tmplt_energy=template_energy(tmplt);
+		size_t const area=size_t{tmplt._width}*tmplt._height;
+		//the direct correlation sums in 32 bits
+		bool const direct_fits=area<=0xFFFFFFFFU/(255U*255U);
+		if(method==correlation_method::automatic)
+		{
+			bool const direct=area<=direct_max_area||size_t{scores._width}*scores._height<=direct_max_offsets;
+			method=direct?correlation_method::direct:correlation_method::fft;
+		}
+		if(method==correlation_method::direct&&direct_fits)
+		{
+			direct_ssd(scores,img,tmplt,tmplt_energy,region.left,region.top);
+		}
+		else
+		{
+			fft_ssd(scores,img,tmplt,tmplt_energy,region.left,region.top);
+		}
+		return scores;
+	}
+
+	size_t template_abs_diff(cil::CImg<unsigned char> const& img,cil::CImg<unsigned char> const& tmplt,ImageUtils::PointUINT point)
+	{
+		if(point.x>=img._width||point.y>=img._height)
+		{
+			return 0;
+		}
+		unsigned int const width=std::min(img._width-point.x,tmplt._width);
+		unsigned int const height=std::min(img._height-point.y,tmplt._height);
+		size_t diff=0;
+		for(unsigned int y=0;y<height;++y)
+		{
+			diff+=kernels::sum_abs_diff(img.data(point.x,point.y+y),tmplt.data(0,y),width);
+		}
+		return diff;
+	}
+
+	std::vector<std::vector<ImageUtils::PointUINT>> template_ssd_minima(cil::CImg<unsigned char> const& img,std::vector<cil::CImg<unsigned char>> const& tmplts,std::vector<float> const& thresholds)
+	{
+		assert(tmplts.size()==thresholds.size());
+		size_t const n=tmplts.size();
+		std::vector<std::vector<ImageUtils::PointUINT>> found(n);
+		//templates of the same size run one after another, so they share the window energies of a band
+		std::vector<size_t> order;
+		order.reserve(n);
+		std::vector<sum_t> energies(n);
+		unsigned int max_rows=0;
+		for(size_t i=0;i<n;++i)
+		{
+			auto const& tmplt=tmplts[i];
+			if(tmplt.is_empty()||img._width<tmplt._width||img._height<tmplt._height)
+			{
+				continue;
+			}
+			order.push_back(i);
+			energies[i]=template_energy(tmplt);
+			max_rows=std::max(max_rows,img._height-tmplt._height+1);
+		}
+		std::sort(order.begin(),order.end(),[&tmplts](size_t a,size_t b)
+		{
+			auto const& ta=tmplts[a];
+			auto const& tb=tmplts[b];
+			return ta._width<tb._width||(ta._width==tb._width&&(ta._height<tb._height||(ta._height==tb._height&&a<b)));
+		});
+		//bands are as tall as the shortest fft tile allows, so each template scored through the fft takes one row of transforms a band
+		unsigned int band_rows=0;
+		for(auto const i:order)
+		{
+			auto const& tmplt=tmplts[i];
+			if(size_t{tmplt._width}*tmplt._height>direct_max_area)
+			{
+				unsigned int const tile_rows=fft_size(tmplt._height,img._height-tmplt._height+1)-tmplt._height+1;
+				unsigned int const fits=tile_rows>2?tile_rows-2:1;
+				band_rows=band_rows?std::min(band_rows,fits):fits;
+			}
+		}
+		band_rows=std::max(band_rows,minima_band_rows);
+		size_t const bands=(max_rows+band_rows-1)/band_rows;
+		std::vector<std::vector<std::vector<ImageUtils::PointUINT>>> band_found(bands);
+		parallel_for(bands,[&](size_t band)
+		{
+			auto& points=band_found[band];
+			points.resize(n);
+			unsigned int const top=unsigned int(band*band_rows);
+			cil::CImg<float> scores;
+			std::vector<sum_t> energy;
+			unsigned int energy_width=0,energy_height=0;
+			for(auto const i:order)
+			{
+				auto const& tmplt=tmplts[i];
+				unsigned int const cols=img._width-tmplt._width+1;
+				unsigned int const plane_rows=img._height-tmplt._height+1;
+				if(top>=plane_rows)
+				{
+					continue;
+				}
+				//one row past the band on each side, so minima on its edges see all their neighbors
+				unsigned int const bottom=std::min(top+band_rows,plane_rows);
+				unsigned int const first=top?top-1:0;
+				unsigned int const last=std::min(bottom+1,plane_rows);
+				unsigned int const rows=last-first;
+				scores.assign(cols,rows);
+				if(size_t{tmplt._width}*tmplt._height<=direct_max_area)
+				{
+					if(energy_width!=tmplt._width||energy_height!=tmplt._height)
+					{
+						energy.resize(size_t{cols}*rows);
+						window_energy(img,tmplt._width,tmplt._height,0,first,cols,rows,energy.data());
+						energy_width=tmplt._width;
+						energy_height=tmplt._height;
+					}
+					direct_rows(scores._data,cols,img,tmplt,energies[i],energy.data(),0,first,cols,rows);
+				}
+				else
+				{
+					fft_ssd(scores,img,tmplt,energies[i],0,first);
+				}
+				float const thresh=thresholds[i];
+				for(unsigned int y=top;y<bottom;++y)
+				{
+					float const* const row=scores.data(0,y-first);
+					unsigned int const y0=y>first?y-1:y;
+					unsigned int const y1=y+1<last?y+1:y;
+					for(unsigned int x=0;x<cols;++x)
+					{
+						float const score=row[x];
+						if(score>thresh)
+						{
+							continue;
+						}
+						unsigned int const x0=x?x-1:x;
+						unsigned int const x1=x+1<cols?x+1:x;
+						bool lowest=true;
+						for(unsigned int ny=y0;ny<=y1&&lowest;++ny)
+						{
+							float const* const neighbors=scores.data(0,ny-first);
+							for(unsigned int nx=x0;nx<=x1;++nx)
+							{
+								if(neighbors[nx]<score)
+								{
+									lowest=false;
+									break;
+								}
+							}
+						}
+						if(lowest)
+						{
+							points[i].push_back({x,y});
+						}
+					}
+				}
+			}
+		});
+		for(auto& points:band_found)
+		{
+			for(size_t i=0;i<n;++i)
+			{
+				found[i].insert(found[i].end(),points[i].begin(),points[i].end());
+			}
+		}
+		return found;
+	}
+}
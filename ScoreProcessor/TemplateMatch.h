@@ -0,0 +1,60 @@
+/*
+Copyright(C) 2017-2019 Edward Xie
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef TEMPLATE_MATCH_H
+#define TEMPLATE_MATCH_H
+#include "CImg.h"
+#include "ImageUtils.h"
+#include <cstddef>
+#include <vector>
+namespace ScoreProcessor {
+	enum class correlation_method {
+		automatic, //direct for small templates, fft for large ones
+		direct, //vector kernels over every offset and template row
+		fft //tiled fft correlation
+	};
+
+	/*
+		Sum of squared differences between the first channel of the template and of the image at every offset where the template fits,
+		in units of 255*255, which is what sliding_template_match<1,float> adds up with ImageUtils::gray_diff.
+		Only the correlation term depends on the method; the template and window energies come from running sums of squares.
+		The sums are exact either way, so every method gives the same image.
+		Returns an empty image if the template does not fit.
+	*/
+	cil::CImg<float> sliding_template_ssd(cil::CImg<unsigned char> const& img,cil::CImg<unsigned char> const& tmplt,correlation_method method=correlation_method::automatic);
+
+	/*
+		sliding_template_ssd for only the offsets in region, clipped to where the template fits.
+		Pixel (x,y) of the result scores offset (region.left+x,region.top+y).
+	*/
+	cil::CImg<float> sliding_template_ssd(cil::CImg<unsigned char> const& img,cil::CImg<unsigned char> const& tmplt,ImageUtils::RectangleUINT region,correlation_method method=correlation_method::automatic);
+
+	/*
+		Local minima of sliding_template_ssd(img,tmplts[i]) at or below thresholds[i], for every template in one pass over the image.
+		The image is scored in bands of rows across the worker pool, each band for every template while its rows are in cache,
+		with templates of the same size sharing their window energies, so only a band of scores per template is held at a time.
+		A point is a local minimum if none of its up to eight neighbors scores lower.
+		Returns the points of each template in row major order; templates that do not fit find none.
+	*/
+	std::vector<std::vector<ImageUtils::PointUINT>> template_ssd_minima(cil::CImg<unsigned char> const& img,std::vector<cil::CImg<unsigned char>> const& tmplts,std::vector<float> const& thresholds);
+
+	/*
+		Sum of the absolute differences between the first channel of the template placed at point and of the image,
+		over the part of the template that lies in the image.
+	*/
+	size_t template_abs_diff(cil::CImg<unsigned char> const& img,cil::CImg<unsigned char> const& tmplt,ImageUtils::PointUINT point);
+}
+#endif // !TEMPLATE_MATCH_H
@@ -0,0 +1,172 @@
+/*
+Copyright(C) 2017-2019 Edward Xie
+
+This program is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+This program is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+#include "lib/threadpool/work_stealing_pool.h"
+#include <algorithm>
+#include <assert.h>
+#include <atomic>
+namespace ScoreProcessor {
+	using worker_pool=exlib::work_stealing_pool;
+
+	namespace worker_pool_detail {
+		inline std::atomic<unsigned int>& requested_budget() noexcept
+		{
+			static std::atomic<unsigned int> budget(0);
+			return budget;
+		}
+	}
+
+	/*
+		Number of threads the global pool runs with.
+	*/
+	inline unsigned int core_budget() noexcept
+	{
+		auto const budget=worker_pool_detail::requested_budget().load();
+		return budget?budget:exlib::hardware_concurrency_or(2);
+	}
+
+	/*
+		The one pool that batch processing, splicing, cutting and scaling all submit to,
+		so work started inside a task shares the same threads instead of starting more.
+		Started on first use with core_budget() threads.
+	*/
+	inline worker_pool& global_pool()
+	{
+		static worker_pool pool(core_budget());
+		return pool;
+	}
+
+	/*
+		Sets the number of threads in the global pool. Must be called before any work is given to it.
+	*/
+	inline void set_core_budget(unsigned int num_threads)
+	{
+		assert(num_threads!=0);
+		worker_pool_detail::requested_budget()=num_threads;
+		auto& pool=global_pool();
+		assert(pool.empty());
+		pool.num_threads(num_threads);
+	}
+
+	/*
+		Calls func(i) for every i in [0,count), handing indices out in order to at most max_parallel runners on the global pool
+		(0 for as many as the pool has threads).
+		The calling thread is one of the runners and only runs this call's runners while it waits, so this may be called from inside a task.
+		func must not throw.
+	*/
+	template<typename Func>
+	void parallel_for(size_t count,Func&& func,unsigned int max_parallel=0)
+	{
+		auto& pool=global_pool();
+		size_t runners=std::min<size_t>(count,pool.num_threads());
+		if(max_parallel)
+		{
+			runners=std::min<size_t>(runners,max_parallel);
+		}
+		if(runners<2)
+		{
+			for(size_t i=0;i<count;++i)
+			{
+				func(i);
+			}
+			return;
+		}
+		std::atomic<size_t> next(0);
+		std::atomic<size_t> left(runners);
+		auto run=[&func,&next,count]() noexcept
+		{
+			for(size_t i;(i=next++)<count;)
+			{
+				func(i);
+			}
+		};
+		for(size_t r=1;r<runners;++r)
+		{
+			pool.push_front_in(&left,[&run,&left]() noexcept
+			{
+				run();
+				--left;
+			});
+		}
+		run();
+		--left;
+		pool.help_until([&left]()
+		{
+			return left==0;
+		},&left);
+	}
+
+	/*
+		Tasks on the global pool that are waited on together.
+		After cancel(), tasks of the group that have not started yet are skipped.
+		Tasks must not throw.
+	*/
+	class task_group {
+		std::atomic<size_t> _left;
+		std::atomic<bool> _cancelled;
+	public:
+		task_group() noexcept:_left(0),_cancelled(false)
+		{}
+		task_group(task_group const&)=delete;
+		task_group& operator=(task_group const&)=delete;
+		~task_group()
+		{
+			wait();
+		}
+		template<typename Task>
+		void run(Task task)
+		{
+			++_left;
+			global_pool().push_back_in(this,[this,task=std::move(task)]() mutable noexcept
+			{
+				if(!_cancelled)
+				{
+					task();
+				}
+				--_left;
+			});
+		}
+		void cancel() noexcept
+		{
+			_cancelled=true;
+		}
+		bool cancelled() const noexcept
+		{
+			return _cancelled;
+		}
+		/*
+			Runs the group's queued tasks on this thread until done() returns true.
+		*/
+		template<typename Done>
+		void help_until(Done&& done)
+		{
+			global_pool().help_until(std::forward<Done>(done),this);
+		}
+		/*
+			Waits for every task run so far, running the group's queued tasks on this thread meanwhile.
+		*/
+		void wait()
+		{
+			help_until([this]()
+			{
+				return _left==0;
+			});
+		}
+	};
+}
+#endif // !WORKER_POOL_H
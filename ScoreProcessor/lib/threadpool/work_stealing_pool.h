@@ -0,0 +1,809 @@
+/*
+Copyright 2018-2019 Edward Xie
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and associated documentation files (the "Software"),
+to deal in the Software without restriction, including without limitation the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and/or sell copies of the Software, and to permit persons to whom the Software is furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+#ifndef EXLIB_WORK_STEALING_POOL_H
+#define EXLIB_WORK_STEALING_POOL_H
+#include "thread_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <vector>
+namespace exlib {
+
+	namespace thread_pool_detail {
+		/*
+			Which pool, if any, the current thread works for, and its index there.
+		*/
+		struct worker_identity {
+			void const* pool;
+			size_t index;
+		};
+
+		inline worker_identity& current_worker() noexcept
+		{
+			static thread_local worker_identity id{nullptr,0};
+			return id;
+		}
+	}
+
+	namespace thread_pool_impl {
+		/*
+			Thread pool with the same task interface as thread_pool_a, where each worker has its own deque of tasks.
+			Workers take from the front of their own deque and steal from the back of the others' when it runs dry,
+			so there is no single queue for all threads to fight over.
+			Tasks pushed from a worker go to that worker's deque, tasks pushed from elsewhere are spread round robin.
+			Tasks waiting on subtasks they spawned should use help_until rather than block,
+			pushing them in a group so that the wait only runs those subtasks.
+			There should only be one controlling thread.
+			No tasks added should throw.
+		*/
+		template<typename... Args>
+		class work_stealing_pool_a {
+		public:
+			static_assert(thread_pool_detail::no_rvalue_references<Args...>::value,"rvalue references not allowed as arguments");
+			static_assert(thread_pool_detail::all_nothrow_copyable<Args...>::value,"Arguments must be no-throw copyable (work_stealing_pool_a has no exception handling mechanism).");
+
+			/*
+				A reference to the parent that child tasks can accept. Should be passed by value.
+				Contains the methods safe to call by child threads.
+			*/
+			class parent_ref {
+				friend class work_stealing_pool_a;
+				work_stealing_pool_a& parent;
+				parent_ref(work_stealing_pool_a& p):parent(p)
+				{}
+			public:
+				/*
+					Signals threads to stop looking for tasks and will signal a waiting master thread.
+				*/
+				void stop()
+				{
+					parent.signal_stop();
+				}
+				/*
+					See work_stealing_pool_a::push_back
+				*/
+				template<typename... Tasks>
+				void push_back(Tasks&& ... tasks)
+				{
+					parent.push_back(std::forward<Tasks>(tasks)...);
+				}
+				/*
+					See work_stealing_pool_a::push_front
+				*/
+				template<typename... Tasks>
+				void push_front(Tasks&& ... tasks)
+				{
+					parent.push_front(std::forward<Tasks>(tasks)...);
+				}
+				/*
+					See work_stealing_pool_a::push_back_in
+				*/
+				template<typename... Tasks>
+				void push_back_in(void const* group,Tasks&& ... tasks)
+				{
+					parent.push_back_in(group,std::forward<Tasks>(tasks)...);
+				}
+				/*
+					See work_stealing_pool_a::push_front_in
+				*/
+				template<typename... Tasks>
+				void push_front_in(void const* group,Tasks&& ... tasks)
+				{
+					parent.push_front_in(group,std::forward<Tasks>(tasks)...);
+				}
+				/*
+					See work_stealing_pool_a::append
+				*/
+				template<typename Iter>
+				size_t append(Iter begin,Iter end)
+				{
+					return parent.append(begin,end);
+				}
+				/*
+					See work_stealing_pool_a::help_until
+				*/
+				template<typename Done>
+				void help_until(Done&& done)
+				{
+					parent.help_until(std::forward<Done>(done));
+				}
+				/*
+					See work_stealing_pool_a::help_until
+				*/
+				template<typename Done>
+				void help_until(Done&& done,void const* group)
+				{
+					parent.help_until(std::forward<Done>(done),group);
+				}
+				/*
+					Signals the threads to end. Does not join them.
+				*/
+				void terminate()
+				{
+					parent.signal_terminate();
+				}
+				_EXLIB_THREAD_POOL_NODISCARD bool empty() const
+				{
+					return parent.empty();
+				}
+				_EXLIB_THREAD_POOL_NODISCARD size_t num_jobs() const
+				{
+					return parent.num_jobs();
+				}
+				_EXLIB_THREAD_POOL_NODISCARD size_t num_threads() const
+				{
+					return parent.num_threads();
+				}
+			};
+
+			using const_parent_ref=parent_ref const;
+
+			/*
+				Starts the threadpool with a certain number of threads and arguments initialized to the given arguments.
+			*/
+			template<typename... T>
+			explicit work_stealing_pool_a(size_t num_threads,T&& ... args):work_stealing_pool_a(num_threads,delay_start_t{},std::forward<T>(args)...)
+			{
+				start();
+			}
+
+			/*
+				Initializes the threadpool with a certain number of threads and arguments initialized to the given arguments.
+				Threads are not started, but tasks can be added.
+			*/
+			template<typename... T>
+			explicit work_stealing_pool_a(size_t num_threads,delay_start_t,T&& ... args):
+				_queues(make_queues(num_threads)),
+				_queued(0),_unfinished(0),_sleepers(0),_helpers(0),_next(0),_finished(0),
+				_running(false),_active(false),
+				_input(std::forward<T>(args)...),
+				_workers(num_threads)
+			{
+				assert(num_threads!=0);
+			}
+
+			/*
+				Starts the threadpool with number of threads equal to the hardware concurrency.
+			*/
+			work_stealing_pool_a():work_stealing_pool_a(hardware_concurrency_or(1))
+			{}
+
+			/*
+				Initializes the threadpool with number of threads equal to the hardware concurrency.
+				Threads not started.
+			*/
+			explicit work_stealing_pool_a(delay_start_t t):work_stealing_pool_a(hardware_concurrency_or(1),t)
+			{}
+
+			work_stealing_pool_a(work_stealing_pool_a const&)=delete;
+			work_stealing_pool_a& operator=(work_stealing_pool_a const&)=delete;
+
+			/*
+				Waits for all jobs to finish and then ends the threads.
+			*/
+			~work_stealing_pool_a() noexcept
+			{
+				join();
+			}
+
+			/*
+				Set the args passed to the threads. Unsynchronized as you should not be modifying args that are actively being read from.
+			*/
+			template<typename... TplArgs>
+			void set_args(TplArgs&& ... args)
+			{
+				_input=TaskInput(std::forward<TplArgs>(args)...);
+			}
+
+			/*
+				Starts threads.
+			*/
+			void start()
+			{
+				if(!_running)
+				{
+					_running=true;
+					_active=true;
+					for(size_t i=0;i<_workers.size();++i)
+					{
+						_workers[i]=thread_pool_detail::joining_thread(&work_stealing_pool_a::task_loop,this,i);
+					}
+				}
+			}
+
+			/*
+				Makes threads look for tasks. Useful after stop() has been called to reactivate job search.
+			*/
+			void reactivate()
+			{
+				_active=true;
+				wake_all();
+			}
+
+			/*
+				Makes threads stop looking for jobs.
+			*/
+			void stop()
+			{
+				_active=false;
+			}
+
+			/*
+				Signals thread pool to stop looking for work and wakes a waiting master thread.
+			*/
+			void signal_stop()
+			{
+				_active=false;
+				notify_done();
+			}
+
+			/*
+				Signals thread pool to terminate.
+			*/
+			void signal_terminate()
+			{
+				_running=false;
+				_active=false;
+				wake_all();
+				notify_done();
+			}
+
+			_EXLIB_THREAD_POOL_NODISCARD bool running() const noexcept
+			{
+				return _running;
+			}
+
+			_EXLIB_THREAD_POOL_NODISCARD bool active() const noexcept
+			{
+				return _active;
+			}
+
+			/*
+				Waits for all jobs to be finished or for it to be stop()ed.
+				Must not be called from a task of this pool; use help_until there.
+			*/
+			void wait()
+			{
+				std::unique_lock<std::mutex> lock(_done_mtx);
+				_done.wait(lock,[this]
+					{
+						return idle();
+					});
+			}
+
+			/*
+				Runs queued tasks on the calling thread until done() returns true.
+				Lets a task wait on subtasks it spawned without tying up a worker.
+			*/
+			template<typename Done>
+			void help_until(Done&& done)
+			{
+				auto const& id=thread_pool_detail::current_worker();
+				bool const own=id.pool==this;
+				while(!done())
+				{
+					auto task=take(own?id.index:_next.load(std::memory_order_relaxed)%_queues.size(),own);
+					if(task)
+					{
+						run(task);
+						continue;
+					}
+					//whatever done() waits on is running elsewhere; sleep until some task finishes
+					std::unique_lock<std::mutex> lock(_sleep_mtx);
+					++_helpers;
+					_progress.wait_for(lock,std::chrono::milliseconds(1),[this,&done]
+						{
+							return _queued!=0||done();
+						});
+					--_helpers;
+				}
+			}
+
+			/*
+				Runs queued tasks of group on the calling thread until done() returns true.
+				Other tasks are left alone, so a wait cannot get stuck behind a long unrelated task
+				it happened to pick up.
+			*/
+			template<typename Done>
+			void help_until(Done&& done,void const* group)
+			{
+				auto const& id=thread_pool_detail::current_worker();
+				bool const own=id.pool==this;
+				while(!done())
+				{
+					size_t const seen=_finished.load();
+					auto task=take_in(own?id.index:_next.load(std::memory_order_relaxed)%_queues.size(),own,group);
+					if(task)
+					{
+						run(task);
+						continue;
+					}
+					//the group's tasks that are left are running elsewhere; sleep until some task finishes
+					std::unique_lock<std::mutex> lock(_sleep_mtx);
+					++_helpers;
+					_progress.wait_for(lock,std::chrono::milliseconds(1),[this,&done,seen]
+						{
+							return _finished!=seen||done();
+						});
+					--_helpers;
+				}
+			}
+
+			/*
+				Makes threads stop looking for jobs and ends threads. Jobs not yet started are discarded.
+			*/
+			void terminate()
+			{
+				signal_terminate();
+				join_all();
+				clear();
+			}
+
+			/*
+				Waits for all jobs to finish and ends threads.
+			*/
+			void join()
+			{
+				if(_running)
+				{
+					wait();
+				}
+				signal_terminate();
+				join_all();
+			}
+
+			/*
+				Adds task(s) to the back of a deque and wakes an appropriate number of threads.
+				Tasks must define operator() that can take in Args...
+				or optionally parent_ref as a first argument and then Args...
+			*/
+			template<typename... Tasks>
+			void push_back(Tasks&& ... tasks)
+			{
+				int expand[]={(enqueue(make_job(std::forward<Tasks>(tasks)),false),0)...};
+				(void)expand;
+			}
+
+			/*
+				Adds task(s) to the front of a deque and wakes an appropriate number of threads.
+				Tasks must define operator() that can take in Args...
+				or optionally parent_ref as a first argument and then Args...
+			*/
+			template<typename... Tasks>
+			void push_front(Tasks&& ... tasks)
+			{
+				int expand[]={(enqueue(make_job(std::forward<Tasks>(tasks)),true),0)...};
+				(void)expand;
+			}
+
+			/*
+				push_back for tasks of group, which help_until(done,group) can run.
+			*/
+			template<typename... Tasks>
+			void push_back_in(void const* group,Tasks&& ... tasks)
+			{
+				int expand[]={(enqueue(make_job(std::forward<Tasks>(tasks)),false,group),0)...};
+				(void)expand;
+			}
+
+			/*
+				push_front for tasks of group, which help_until(done,group) can run.
+			*/
+			template<typename... Tasks>
+			void push_front_in(void const* group,Tasks&& ... tasks)
+			{
+				int expand[]={(enqueue(make_job(std::forward<Tasks>(tasks)),true,group),0)...};
+				(void)expand;
+			}
+
+			/*
+				Adds task(s) reading from the given iterators.
+				Returns the number of tasks added.
+			*/
+			template<typename Iter>
+			size_t append(Iter begin,Iter end)
+			{
+				size_t count=0;
+				for(;begin!=end;++begin)
+				{
+					enqueue(make_job(*begin),false);
+					++count;
+				}
+				return count;
+			}
+
+			/*
+				Clears the jobs that have not started.
+			*/
+			void clear()
+			{
+				size_t removed=0;
+				for(auto& q:_queues)
+				{
+					std::lock_guard<std::mutex> lock(q->mtx);
+					removed+=q->jobs.size();
+					q->jobs.clear();
+				}
+				_queued-=removed;
+				if((_unfinished-=removed)==0)
+				{
+					notify_done();
+				}
+			}
+
+			/*
+				Changes the number of threads. Queued jobs are kept.
+			*/
+			void num_threads(size_t size)
+			{
+				assert(size!=0);
+				if(size==num_threads())
+				{
+					return;
+				}
+				bool const was_running=_running;
+				if(was_running)
+				{
+					_running=false;
+					wake_all();
+					join_all();
+				}
+				std::deque<std::unique_ptr<job>> pending;
+				for(auto& q:_queues)
+				{
+					std::move(q->jobs.begin(),q->jobs.end(),std::back_inserter(pending));
+				}
+				_queues=make_queues(size);
+				for(size_t i=0;i<pending.size();++i)
+				{
+					_queues[i%size]->jobs.push_back(std::move(pending[i]));
+				}
+				_workers.clear();
+				_workers.resize(size);
+				if(was_running)
+				{
+					start();
+				}
+			}
+
+			/*
+				The number of threads.
+			*/
+			_EXLIB_THREAD_POOL_NODISCARD size_t num_threads() const noexcept
+			{
+				return _workers.size();
+			}
+
+			/*
+				The number of jobs waiting to be started.
+			*/
+			_EXLIB_THREAD_POOL_NODISCARD size_t num_jobs() const noexcept
+			{
+				return _queued;
+			}
+
+			/*
+				Whether no jobs are waiting to be started.
+			*/
+			_EXLIB_THREAD_POOL_NODISCARD bool empty() const noexcept
+			{
+				return num_jobs()==0;
+			}
+
+			/*
+				Returns a future representing the result of running the given task asynchronously.
+			*/
+			template<typename Task>
+			_EXLIB_THREAD_POOL_NODISCARD auto async(Task&& task) -> std::future<decltype(thread_pool_detail::fake_invoke<parent_ref,Args...>(std::forward<Task>(task)))>
+			{
+				thread_pool_detail::TaskDoer<Task,parent_ref,Args...> doer{std::forward<Task>(task)};
+				auto future=doer.promise.get_future();
+				push_back(std::move(doer));
+				return future;
+			}
+
+			/*
+				Returns a future representing the result of running the given task asynchronously.
+			*/
+			template<typename Task,typename... Extra>
+			_EXLIB_THREAD_POOL_NODISCARD auto async(Task&& task,Extra...) -> std::future<decltype(thread_pool_detail::fake_invoke<Args...>(std::forward<Task>(task)))>
+			{
+				static_assert(sizeof...(Extra)==0,"These arguments are only for SFINAE. Use lambda capture/bind if you want to arguments passed to a functor.");
+				thread_pool_detail::TaskDoer<Task,Args...> doer{std::forward<Task>(task)};
+				auto future=doer.promise.get_future();
+				push_back(std::move(doer));
+				return future;
+			}
+
+		private:
+			using TaskInput=std::tuple<thread_pool_detail::wrap_reference_t<Args>...>;
+			struct job {
+				void const* group=nullptr;
+				virtual void operator()(parent_ref,TaskInput const& input) noexcept=0;
+				virtual ~job()=default;
+			};
+			template<typename BaseFunc>
+			struct job_impl:job {
+				BaseFunc task;
+				template<typename F>
+				job_impl(F&& f):task(std::forward<F>(f))
+				{}
+				void operator()(parent_ref,TaskInput const& input) noexcept override
+				{
+					thread_pool_detail::apply(task,input);
+				}
+			};
+			template<typename BaseFunc>
+			struct job_impl_accept_parent:job {
+				BaseFunc task;
+				template<typename F>
+				job_impl_accept_parent(F&& f):task(std::forward<F>(f))
+				{}
+				void operator()(parent_ref tp,TaskInput const& input) noexcept override
+				{
+					thread_pool_detail::apply_fa(task,tp,input);
+				}
+			};
+
+			//overload to try to fit to pass arguments without parent
+			template<typename Task,typename... Extra>
+			static std::unique_ptr<job> make_job(Task&& the_task,Extra...)
+			{
+				return make_job2(std::forward<Task>(the_task));
+			}
+
+			//overload to try to fit to pass arguments with parent
+			template<typename Task>
+			static auto make_job(Task&& the_task) -> decltype(thread_pool_detail::fake_invoke<parent_ref,Args...>(std::forward<Task>(the_task)),std::unique_ptr<job>())
+			{
+				static_assert(noexcept(thread_pool_detail::fake_invoke<parent_ref,Args...>(std::forward<Task>(the_task))),"Tasks cannot throw (work_stealing_pool_a has no exception handling mechanism); use async/promise if you need errors.");
+				return std::unique_ptr<job>(new job_impl_accept_parent<thread_pool_detail::remove_cvref_t<Task>>(std::forward<Task>(the_task)));
+			}
+
+			template<typename Task,typename... Extra>
+			static std::unique_ptr<job> make_job2(Task&& the_task,Extra...)
+			{
+				static_assert(!std::is_same<Task,Task>::value,"Task fails to accepts proper arguments; must accept (parent_ref, Args...), or (Args...)");
+			}
+
+			template<typename Task>
+			static auto make_job2(Task&& the_task) -> decltype(thread_pool_detail::fake_invoke<Args...>(std::forward<Task>(the_task)),std::unique_ptr<job>())
+			{
+				static_assert(noexcept(thread_pool_detail::fake_invoke<Args...>(std::forward<Task>(the_task))),"Tasks cannot throw (work_stealing_pool_a has no exception handling mechanism); use async/promise if you need errors.");
+				return std::unique_ptr<job>(new job_impl<thread_pool_detail::remove_cvref_t<Task>>(std::forward<Task>(the_task)));
+			}
+
+			struct worker_queue {
+				std::mutex mtx;
+				std::deque<std::unique_ptr<job>> jobs;
+			};
+
+			static std::vector<std::unique_ptr<worker_queue>> make_queues(size_t n)
+			{
+				std::vector<std::unique_ptr<worker_queue>> queues(n);
+				for(auto& q:queues)
+				{
+					q.reset(new worker_queue());
+				}
+				return queues;
+			}
+
+			bool idle() const noexcept
+			{
+				return !_active||_unfinished==0;
+			}
+
+			void notify_done()
+			{
+				{
+					std::lock_guard<std::mutex> lock(_done_mtx);
+				}
+				_done.notify_all();
+			}
+
+			void wake_all()
+			{
+				{
+					std::lock_guard<std::mutex> lock(_sleep_mtx);
+				}
+				_wake.notify_all();
+			}
+
+			void enqueue(std::unique_ptr<job> task,bool front,void const* group=nullptr)
+			{
+				task->group=group;
+				++_unfinished;
+				auto const& id=thread_pool_detail::current_worker();
+				size_t const index=id.pool==this?id.index:_next.fetch_add(1,std::memory_order_relaxed)%_queues.size();
+				{
+					auto& q=*_queues[index];
+					std::lock_guard<std::mutex> lock(q.mtx);
+					//counted before the job is visible, so a thief taking it at once cannot take _queued below zero
+					++_queued;
+					if(front)
+					{
+						q.jobs.push_front(std::move(task));
+					}
+					else
+					{
+						q.jobs.push_back(std::move(task));
+					}
+				}
+				//a sleeper checks _queued under _sleep_mtx before waiting, so taking it here means the wake cannot be missed
+				if(_sleepers!=0)
+				{
+					{
+						std::lock_guard<std::mutex> lock(_sleep_mtx);
+					}
+					_wake.notify_one();
+				}
+			}
+
+			/*
+				Takes the front of queue index if own, then steals from the backs of the others.
+			*/
+			std::unique_ptr<job> take(size_t index,bool own)
+			{
+				std::unique_ptr<job> task;
+				size_t const n=_queues.size();
+				if(own)
+				{
+					auto& q=*_queues[index];
+					std::lock_guard<std::mutex> lock(q.mtx);
+					if(!q.jobs.empty())
+					{
+						task=std::move(q.jobs.front());
+						q.jobs.pop_front();
+					}
+				}
+				for(size_t k=own?1:0;!task&&k<n;++k)
+				{
+					auto& q=*_queues[(index+k)%n];
+					std::lock_guard<std::mutex> lock(q.mtx);
+					if(!q.jobs.empty())
+					{
+						task=std::move(q.jobs.back());
+						q.jobs.pop_back();
+					}
+				}
+				if(task)
+				{
+					--_queued;
+				}
+				return task;
+			}
+
+			/*
+				take restricted to the tasks of group, searching each deque from the end take would use.
+			*/
+			std::unique_ptr<job> take_in(size_t index,bool own,void const* group)
+			{
+				std::unique_ptr<job> task;
+				size_t const n=_queues.size();
+				auto const in_group=[group](std::unique_ptr<job> const& j)
+				{
+					return j->group==group;
+				};
+				if(own)
+				{
+					auto& q=*_queues[index];
+					std::lock_guard<std::mutex> lock(q.mtx);
+					auto const it=std::find_if(q.jobs.begin(),q.jobs.end(),in_group);
+					if(it!=q.jobs.end())
+					{
+						task=std::move(*it);
+						q.jobs.erase(it);
+					}
+				}
+				for(size_t k=own?1:0;!task&&k<n;++k)
+				{
+					auto& q=*_queues[(index+k)%n];
+					std::lock_guard<std::mutex> lock(q.mtx);
+					auto const it=std::find_if(q.jobs.rbegin(),q.jobs.rend(),in_group);
+					if(it!=q.jobs.rend())
+					{
+						task=std::move(*it);
+						q.jobs.erase(std::next(it).base());
+					}
+				}
+				if(task)
+				{
+					--_queued;
+				}
+				return task;
+			}
+
+			void run(std::unique_ptr<job>& task) noexcept
+			{
+				(*task)(parent_ref{*this},_input);
+				task.reset();
+				++_finished;
+				if(--_unfinished==0)
+				{
+					notify_done();
+				}
+				if(_helpers!=0)
+				{
+					{
+						std::lock_guard<std::mutex> lock(_sleep_mtx);
+					}
+					_progress.notify_all();
+				}
+			}
+
+			void join_all()
+			{
+				for(auto& thread:_workers)
+				{
+					if(thread.joinable())
+					{
+						thread.join();
+					}
+				}
+			}
+
+			void task_loop(size_t index) noexcept
+			{
+				thread_pool_detail::current_worker()={this,index};
+				while(_running)
+				{
+					if(_active)
+					{
+						auto task=take(index,true);
+						if(task)
+						{
+							run(task);
+							continue;
+						}
+					}
+					std::unique_lock<std::mutex> lock(_sleep_mtx);
+					++_sleepers;
+					_wake.wait(lock,[this]
+						{
+							return !_running||(_active&&_queued!=0);
+						});
+					--_sleepers;
+				}
+			}
+
+			std::vector<std::unique_ptr<worker_queue>> _queues;
+			//tasks sitting in the deques
+			std::atomic<size_t> _queued;
+			//tasks queued or running
+			std::atomic<size_t> _unfinished;
+			std::atomic<size_t> _sleepers;
+			//threads blocked in help_until
+			std::atomic<size_t> _helpers;
+			//round robin position for tasks pushed from outside the pool
+			std::atomic<size_t> _next;
+			//tasks run so far, so a group helper can tell whether anything finished while it looked
+			std::atomic<size_t> _finished;
+			//whether threads are running
+			std::atomic<bool> _running;
+			//whether threads are actively looking for jobs
+			std::atomic<bool> _active;
+			std::mutex _sleep_mtx;
+			std::condition_variable _wake;
+			std::condition_variable _progress;
+			std::mutex mutable _done_mtx;
+			std::condition_variable _done;
+			TaskInput _input;
+			std::vector<thread_pool_detail::joining_thread> _workers;
+		};
+	}
+
+	using thread_pool_impl::work_stealing_pool_a;
+	using work_stealing_pool=work_stealing_pool_a<>;
+}
+#endif